@@ -35,6 +35,54 @@ data:extend(
       name = "shader/staticmesh_opaque_frag",
       shader = "/shaders/staticmesh_opaque_frag.spv",
       stage = "frag"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_shadow_vert",
+      shader = "/shaders/staticmesh_shadow_vert.spv",
+      stage = "vert"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_opaque_compact_vert",
+      shader = "/shaders/staticmesh_opaque_compact_vert.spv",
+      stage = "vert"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_shadow_compact_vert",
+      shader = "/shaders/staticmesh_shadow_compact_vert.spv",
+      stage = "vert"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_shadow_frag",
+      shader = "/shaders/staticmesh_shadow_frag.spv",
+      stage = "frag"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_cull_comp",
+      shader = "/shaders/staticmesh_cull_comp.spv",
+      stage = "comp"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_compact_comp",
+      shader = "/shaders/staticmesh_compact_comp.spv",
+      stage = "comp"
+    },
+    {
+      type = 'shader',
+      name = "shader/staticmesh_cull_late_comp",
+      shader = "/shaders/staticmesh_cull_late_comp.spv",
+      stage = "comp"
+    },
+    {
+      type = 'shader',
+      name = "shader/hiz_build_comp",
+      shader = "/shaders/hiz_build_comp.spv",
+      stage = "comp"
     }
   }
 )
@@ -142,7 +190,20 @@ data:extend(
             {
                 stage = "vert",
                 offset = 0,
-                size = 16
+                size = 40
+            }
+        }
+    },
+    {
+        type = "pipeline_layout",
+        name = "layout/cull",
+        ds_layouts = {
+        },
+        push_constants = {
+            {
+                stage = "comp",
+                offset = 0,
+                size = 40
             }
         }
     }
@@ -182,6 +243,53 @@ data:extend(
             {enable = false}
         },
         renderStage = "opaque",
+        compactVariant = "pipeline/staticmesh_opaque_compact",
+        vertices = {
+        }
+    },
+    {
+        type = "material_pipeline",
+        name = "pipeline/staticmesh_opaque_compact",
+        layout = "layout/general",
+        vertexShader = "shader/staticmesh_opaque_compact_vert",
+        fragmentShader = "shader/staticmesh_opaque_frag",
+        depthTestEnable = true,
+        depthWriteEnable = true,
+        blends = {
+            {enable = false}
+        },
+        renderStage = "opaque",
+        vertices = {
+        }
+    },
+    {
+        type = "material_pipeline",
+        name = "pipeline/staticmesh_shadow",
+        layout = "layout/general",
+        vertexShader = "shader/staticmesh_shadow_vert",
+        fragmentShader = "shader/staticmesh_shadow_frag",
+        depthTestEnable = true,
+        depthWriteEnable = true,
+        depthClamp = true,
+        blends = {
+        },
+        renderStage = "shadow",
+        compactVariant = "pipeline/staticmesh_shadow_compact",
+        vertices = {
+        }
+    },
+    {
+        type = "material_pipeline",
+        name = "pipeline/staticmesh_shadow_compact",
+        layout = "layout/general",
+        vertexShader = "shader/staticmesh_shadow_compact_vert",
+        fragmentShader = "shader/staticmesh_shadow_frag",
+        depthTestEnable = true,
+        depthWriteEnable = true,
+        depthClamp = true,
+        blends = {
+        },
+        renderStage = "shadow",
         vertices = {
         }
     },
@@ -207,4 +315,33 @@ data:extend(
   }
 )
 
+data:extend(
+  {
+    {
+        type = "compute_pipeline",
+        name = "compute/staticmesh_cull",
+        layout = "layout/cull",
+        computeShader = "shader/staticmesh_cull_comp"
+    },
+    {
+        type = "compute_pipeline",
+        name = "compute/staticmesh_compact",
+        layout = "layout/cull",
+        computeShader = "shader/staticmesh_compact_comp"
+    },
+    {
+        type = "compute_pipeline",
+        name = "compute/staticmesh_cull_late",
+        layout = "layout/cull",
+        computeShader = "shader/staticmesh_cull_late_comp"
+    },
+    {
+        type = "compute_pipeline",
+        name = "compute/hiz_build",
+        layout = "layout/cull",
+        computeShader = "shader/hiz_build_comp"
+    }
+  }
+)
+
 --print(serpent.block(data.raw))
\ No newline at end of file
@@ -5,4 +5,13 @@ glslc --target-env=vulkan1.2  -o rml_vert.spv rml.vert
 glslc --target-env=vulkan1.2  -o staticmesh_opaque_vert.spv staticmesh_opaque.vert
 glslc --target-env=vulkan1.2  -o staticmesh_opaque_frag.spv staticmesh_opaque.frag
 glslc --target-env=vulkan1.2  -o screenquad_vert.spv screenquad.vert
+glslc --target-env=vulkan1.2  -o staticmesh_cull_comp.spv staticmesh_cull.comp
+glslc --target-env=vulkan1.2  -o staticmesh_compact_comp.spv staticmesh_compact.comp
+glslc --target-env=vulkan1.2  -o staticmesh_cull_late_comp.spv staticmesh_cull_late.comp
+glslc --target-env=vulkan1.2  -o hiz_build_comp.spv hiz_build.comp
 
+glslc --target-env=vulkan1.2  -o staticmesh_shadow_vert.spv staticmesh_shadow.vert
+glslc --target-env=vulkan1.2  -o staticmesh_shadow_frag.spv staticmesh_shadow.frag
+
+glslc --target-env=vulkan1.2  -o staticmesh_opaque_compact_vert.spv staticmesh_opaque_compact.vert
+glslc --target-env=vulkan1.2  -o staticmesh_shadow_compact_vert.spv staticmesh_shadow_compact.vert
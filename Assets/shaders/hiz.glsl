@@ -0,0 +1,68 @@
+#define HIZ_MAX_LEVELS 16
+
+// Each level holds the farthest depth under its texels. Level 0 is the largest power of two
+// that fits in the depth buffer, offsets index depth[] where each level starts.
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer HiZPyramid
+{
+    uvec2 size;
+    uint levels;
+    uint pad0;
+    uint offsets[HIZ_MAX_LEVELS];
+    float depth[];
+};
+
+float hiZTexel(HiZPyramid hiZ, uint level, uvec2 levelSize, uvec2 p)
+{
+    return hiZ.depth[hiZ.offsets[level] + p.y * levelSize.x + p.x];
+}
+
+// True when the sphere is entirely behind what was drawn into the pyramid with viewProjection
+bool sphereOccluded(vec4 sphere, mat4 viewProjection, HiZPyramid hiZ)
+{
+    vec2 lo = vec2(1.0);
+    vec2 hi = vec2(0.0);
+    float nearest = 1.0;
+
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = sphere.xyz + sphere.w * vec3(
+            (i & 1) != 0 ? 1.0 : -1.0,
+            (i & 2) != 0 ? 1.0 : -1.0,
+            (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+
+        // Reaching behind the camera, it can't be bounded on screen
+        if (clip.w <= 0.0) {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        // The main pass flips Y in its viewport
+        vec2 uv = vec2(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5);
+
+        lo = min(lo, uv);
+        hi = max(hi, uv);
+        nearest = min(nearest, ndc.z);
+    }
+
+    if (nearest <= 0.0) {
+        return false;
+    }
+
+    lo = clamp(lo, 0.0, 1.0);
+    hi = clamp(hi, 0.0, 1.0);
+
+    // The level where the rectangle is no wider than a texel, so it touches at most 2x2 of them
+    vec2 extent = (hi - lo) * vec2(hiZ.size);
+    float level = clamp(ceil(log2(max(max(extent.x, extent.y), 1.0))), 0.0, float(hiZ.levels - 1));
+    uint l = uint(level);
+
+    uvec2 levelSize = max(hiZ.size >> l, uvec2(1));
+    uvec2 a = min(uvec2(lo * vec2(levelSize)), levelSize - 1);
+    uvec2 b = min(uvec2(hi * vec2(levelSize)), levelSize - 1);
+
+    float farthest = max(
+        max(hiZTexel(hiZ, l, levelSize, a), hiZTexel(hiZ, l, levelSize, uvec2(b.x, a.y))),
+        max(hiZTexel(hiZ, l, levelSize, uvec2(a.x, b.y)), hiZTexel(hiZ, l, levelSize, b)));
+
+    return nearest > farthest;
+}
@@ -125,7 +125,7 @@ void main() {
 
     vec4 shadowCoord = (biasMat * lighting.cascades[cascadeIndex].viewProjMatrix) * vec4(inPos, 1.0);
     //shadow = textureProj(shadowCoord / shadowCoord.w, vec2(0.0), cascadeIndex);
-    //shadow = filterPCF(shadowCoord / shadowCoord.w, cascadeIndex);
+    shadow = filterPCF(shadowCoord / shadowCoord.w, cascadeIndex);
     vec3 N = normalize(inNormal);
 	vec3 L = normalize(-lighting.light_direction);
 	vec3 H = normalize(L + inViewPos);
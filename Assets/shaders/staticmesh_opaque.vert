@@ -36,7 +36,7 @@ struct DrawCommand {
 };
 
 struct InstanceData {
-    mat4 transform;
+    uint transformSlot;
     uint materialID;
 };
 
@@ -50,11 +50,16 @@ layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer Re
     Vertex vertices[];
 };
 
-layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadInstances
+layout(buffer_reference, std430, buffer_reference_align = 8) readonly buffer ReadInstances
 {
     InstanceData instance[];
 };
 
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadTransforms
+{
+    mat4 transforms[];
+};
+
 layout(std430, set=0, binding =3) readonly buffer M {
     Material materials[];
 };
@@ -66,6 +71,7 @@ layout(push_constant) uniform uPushConstant {
     //uint cascadeIndex;
     ReadVertex src;
     ReadInstances inst;
+    ReadTransforms table;
  } pc;
 
 out gl_PerVertex { vec4 gl_Position; };
@@ -83,7 +89,7 @@ void main()
     vec2 inUV = v.aUv;
     vec3 inNormal = v.aNormal;
 
-    mat4 local = pc.inst.instance[gl_InstanceIndex].transform;
+    mat4 local = pc.table.transforms[pc.inst.instance[gl_InstanceIndex].transformSlot];
     uint matId = pc.inst.instance[gl_InstanceIndex].materialID;
     outTexId = materials[matId].colorMapIndex;
 
@@ -0,0 +1,111 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive: enable
+//#extension GL_vulkan_glsl : enable
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+#include "lighting.glsl"
+
+layout (set = 0, binding = 0) uniform U {
+	mat4 projection;
+	mat4 view;
+    vec3 viewPos;
+} uboCamera;
+
+layout(set = 0, binding = 1) uniform B {
+    Lighting lighting;
+};
+
+layout(set = 0, binding = 2) uniform sampler2DArray shadowMap;
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+    //mat4 transform;
+    //uint materialIndex;
+};
+
+struct InstanceData {
+    uint transformSlot;
+    uint materialID;
+};
+
+struct Material {
+    uint colorMapIndex;
+    float roughness;
+};
+
+// x: position xy unorm16, y: position z unorm16, z: octahedral normal snorm16, w: uv half
+// The two entries before gl_BaseVertex hold the mesh bounds minimum and extent
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadVertex
+{
+    uvec4 vertices[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 8) readonly buffer ReadInstances
+{
+    InstanceData instance[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadTransforms
+{
+    mat4 transforms[];
+};
+
+layout(std430, set=0, binding =3) readonly buffer M {
+    Material materials[];
+};
+
+layout(set=0, binding =4) uniform sampler2D textures[];
+
+layout(push_constant) uniform uPushConstant {
+    //mat4 local; 
+    //uint cascadeIndex;
+    ReadVertex src;
+    ReadInstances inst;
+    ReadTransforms table;
+ } pc;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+layout(location=0) out vec3 outPos;
+layout(location=1) out vec3 outNormal;
+layout(location=2) out vec2 outUv;
+layout(location=3) out vec3 outViewPos;
+layout(location=4) flat out uint outTexId;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    uvec4 v = pc.src.vertices[gl_VertexIndex];
+    vec3 boundsMin = uintBitsToFloat(pc.src.vertices[gl_BaseVertex - 2].xyz);
+    vec3 boundsExtent = uintBitsToFloat(pc.src.vertices[gl_BaseVertex - 1].xyz);
+
+    vec3 inPos = boundsMin + vec3(unpackUnorm2x16(v.x), unpackUnorm2x16(v.y).x) * boundsExtent;
+    vec2 inUV = unpackHalf2x16(v.w);
+    vec3 inNormal = octDecode(unpackSnorm2x16(v.z));
+
+    mat4 local = pc.table.transforms[pc.inst.instance[gl_InstanceIndex].transformSlot];
+    uint matId = pc.inst.instance[gl_InstanceIndex].materialID;
+    outTexId = materials[matId].colorMapIndex;
+
+    vec4 p = uboCamera.projection * uboCamera.view * local * vec4(inPos, 1.0);
+
+    outPos = (local * vec4(inPos,1)).xyz;
+    outUv = inUV;
+    gl_Position = p;
+
+    outViewPos = (uboCamera.view * vec4(outPos, 1.0)).xyz;
+    outNormal =  normalize(local * vec4(inNormal, 0.0)).xyz; 
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive: enable
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+#include "lighting.glsl"
+
+layout(set = 0, binding = 1) uniform B {
+    Lighting lighting;
+};
+
+struct Vertex {
+    vec3 aPos;
+    vec3 aNormal;
+    vec2 aUv;
+};
+
+struct InstanceData {
+    uint transformSlot;
+    uint materialID;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadVertex
+{
+    Vertex vertices[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 8) readonly buffer ReadInstances
+{
+    InstanceData instance[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadTransforms
+{
+    mat4 transforms[];
+};
+
+// Tightly packed xyz, present when the bundle carries a position stream
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer ReadPositions
+{
+    float positions[];
+};
+
+layout(push_constant) uniform uPushConstant {
+    ReadVertex src;
+    ReadInstances inst;
+    ReadTransforms table;
+    uint cascadeIndex;
+    ReadPositions positions;
+ } pc;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+    vec3 inPos;
+    if (uvec2(pc.positions) != uvec2(0)) {
+        uint ix = uint(gl_VertexIndex) * 3;
+        inPos = vec3(pc.positions.positions[ix], pc.positions.positions[ix + 1], pc.positions.positions[ix + 2]);
+    } else {
+        inPos = pc.src.vertices[gl_VertexIndex].aPos;
+    }
+    mat4 local = pc.table.transforms[pc.inst.instance[gl_InstanceIndex].transformSlot];
+
+    gl_Position = lighting.cascades[pc.cascadeIndex].viewProjMatrix * local * vec4(inPos, 1.0);
+}
@@ -0,0 +1,54 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive: enable
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+#include "lighting.glsl"
+
+layout(set = 0, binding = 1) uniform B {
+    Lighting lighting;
+};
+
+struct InstanceData {
+    uint transformSlot;
+    uint materialID;
+};
+
+// Only the quantized position is read, the two entries before gl_BaseVertex hold the mesh
+// bounds minimum and extent
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadVertex
+{
+    uvec4 vertices[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 8) readonly buffer ReadInstances
+{
+    InstanceData instance[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ReadTransforms
+{
+    mat4 transforms[];
+};
+
+layout(push_constant) uniform uPushConstant {
+    ReadVertex src;
+    ReadInstances inst;
+    ReadTransforms table;
+    uint cascadeIndex;
+ } pc;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+    uvec4 v = pc.src.vertices[gl_VertexIndex];
+    vec3 boundsMin = uintBitsToFloat(pc.src.vertices[gl_BaseVertex - 2].xyz);
+    vec3 boundsExtent = uintBitsToFloat(pc.src.vertices[gl_BaseVertex - 1].xyz);
+
+    vec3 inPos = boundsMin + vec3(unpackUnorm2x16(v.x), unpackUnorm2x16(v.y).x) * boundsExtent;
+    mat4 local = pc.table.transforms[pc.inst.instance[gl_InstanceIndex].transformSlot];
+
+    gl_Position = lighting.cascades[pc.cascadeIndex].viewProjMatrix * local * vec4(inPos, 1.0);
+}
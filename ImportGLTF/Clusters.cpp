@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <unordered_set>
+#include "Clusters.h"
+
+namespace
+{
+    void finishCluster(
+        const RxAssets::MeshSaveData & md,
+        MeshCluster & cluster)
+    {
+        float min[3] = {1e30f, 1e30f, 1e30f};
+        float max[3] = {-1e30f, -1e30f, -1e30f};
+        float axis[3] = {};
+
+        for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+            const auto & p0 = md.vertices[md.indices[i]];
+            const auto & p1 = md.vertices[md.indices[i + 1]];
+            const auto & p2 = md.vertices[md.indices[i + 2]];
+
+            for (auto * p: {&p0, &p1, &p2}) {
+                min[0] = std::min(min[0], p->x);
+                min[1] = std::min(min[1], p->y);
+                min[2] = std::min(min[2], p->z);
+                max[0] = std::max(max[0], p->x);
+                max[1] = std::max(max[1], p->y);
+                max[2] = std::max(max[2], p->z);
+            }
+
+            const float e1[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+            const float e2[3] = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+            axis[0] += e1[1] * e2[2] - e1[2] * e2[1];
+            axis[1] += e1[2] * e2[0] - e1[0] * e2[2];
+            axis[2] += e1[0] * e2[1] - e1[1] * e2[0];
+        }
+
+        for (uint32_t k = 0; k < 3; k++) {
+            cluster.center[k] = (min[k] + max[k]) * 0.5f;
+        }
+
+        float radius = 0.f;
+        for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i++) {
+            const auto & p = md.vertices[md.indices[i]];
+            const float d[3] = {p.x - cluster.center[0], p.y - cluster.center[1], p.z - cluster.center[2]};
+            radius = std::max(radius, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+        }
+        cluster.radius = radius;
+
+        // The cone covers every face normal. Once they spread past 90 degrees no view direction
+        // sees only back faces, and the cutoff of 1 keeps the cluster from being cone culled
+        const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        cluster.coneCutoff = 1.f;
+        cluster.coneAxis[0] = 0.f;
+        cluster.coneAxis[1] = 0.f;
+        cluster.coneAxis[2] = 1.f;
+        if (length <= 0.f) {
+            return;
+        }
+        for (uint32_t k = 0; k < 3; k++) {
+            cluster.coneAxis[k] = axis[k] / length;
+        }
+
+        float min_dot = 1.f;
+        for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+            const auto & p0 = md.vertices[md.indices[i]];
+            const auto & p1 = md.vertices[md.indices[i + 1]];
+            const auto & p2 = md.vertices[md.indices[i + 2]];
+
+            const float e1[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+            const float e2[3] = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+            const float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]
+            };
+            const float n_length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (n_length <= 0.f) {
+                continue;
+            }
+            min_dot = std::min(
+                min_dot,
+                (n[0] * cluster.coneAxis[0] + n[1] * cluster.coneAxis[1] + n[2] * cluster.coneAxis[2]) /
+                n_length
+            );
+        }
+
+        if (min_dot > 0.f) {
+            cluster.coneCutoff = std::sqrt(1.f - min_dot * min_dot);
+        }
+    }
+}
+
+std::vector<MeshCluster> BuildClusters(
+    const RxAssets::MeshSaveData & md,
+    uint32_t maxVertices,
+    uint32_t maxTriangles)
+{
+    std::vector<MeshCluster> clusters;
+
+    for (uint32_t p = 0; p < md.primitives.size(); p++) {
+        const auto & prim = md.primitives[p];
+        std::unordered_set<uint32_t> vertices;
+        MeshCluster cluster{.firstIndex = prim.firstIndex, .subMeshIndex = p};
+
+        for (uint32_t i = prim.firstIndex; i + 2 < prim.firstIndex + prim.indexCount; i += 3) {
+            uint32_t added = 0;
+            for (uint32_t k = 0; k < 3; k++) {
+                added += vertices.contains(md.indices[i + k]) ? 0 : 1;
+            }
+
+            if (vertices.size() + added > maxVertices || cluster.indexCount / 3 == maxTriangles) {
+                finishCluster(md, cluster);
+                clusters.push_back(cluster);
+                cluster = MeshCluster{.firstIndex = i, .subMeshIndex = p};
+                vertices.clear();
+            }
+
+            vertices.insert(&md.indices[i], &md.indices[i] + 3);
+            cluster.indexCount += 3;
+        }
+
+        if (cluster.indexCount > 0) {
+            finishCluster(md, cluster);
+            clusters.push_back(cluster);
+        }
+    }
+
+    return clusters;
+}
+
+void WriteClusters(const std::filesystem::path & path, const std::vector<MeshCluster> & clusters)
+{
+    std::ofstream fs(path, std::ios::binary);
+
+    const uint32_t header[4] = {
+        cluster_file_magic, cluster_file_version, static_cast<uint32_t>(clusters.size()), 0
+    };
+    fs.write(reinterpret_cast<const char *>(header), sizeof(header));
+    fs.write(
+        reinterpret_cast<const char *>(clusters.data()),
+        static_cast<std::streamsize>(clusters.size() * sizeof(MeshCluster))
+    );
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <RXAssets.h>
+
+constexpr uint32_t cluster_max_vertices = 64;
+constexpr uint32_t cluster_max_triangles = 124;
+
+// "RXCL", followed by the version, cluster count and the clusters themselves
+constexpr uint32_t cluster_file_magic = 0x4c435852;
+constexpr uint32_t cluster_file_version = 1;
+
+// A run of triangles in a primitive's index range. firstIndex is relative to the start of the
+// mesh's indices like a primitive's. The sphere and normal cone are in mesh space, coneCutoff
+// is the sine of the cone's half angle and 1 when the normals spread too far to cull by
+struct MeshCluster
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t subMeshIndex;
+    float radius;
+    float center[3];
+    float coneCutoff;
+    float coneAxis[3];
+    uint32_t pad;
+};
+
+static_assert(sizeof(MeshCluster) == 48);
+
+// Splits each primitive of md, in its current triangle order, into clusters of at most
+// maxVertices unique vertices and maxTriangles triangles
+std::vector<MeshCluster> BuildClusters(
+    const RxAssets::MeshSaveData & md,
+    uint32_t maxVertices,
+    uint32_t maxTriangles);
+
+void WriteClusters(const std::filesystem::path & path, const std::vector<MeshCluster> & clusters);
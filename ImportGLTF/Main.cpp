@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <iomanip>
 #include <chrono>
+#include <algorithm>
 #include <cstdlib>
 #include <direct.h>
 #include <fstream>
@@ -10,6 +11,9 @@
 #include "Args.h"
 #include "nlohmann/json.hpp"
 #include "RXAssetManager.h"
+#include "Clusters.h"
+#include "Optimize.h"
+#include "Simplify.h"
 //#include "stb_image.h"
 #include "spdlog/spdlog.h"
 //#include "glslang/Public/ShaderLang.h"
@@ -200,6 +204,9 @@ void CreateMeshCommand(args::Subparser & parser)
     args::Positional<std::string> assetFolder(addGroup, "asset-dir", "Asset Folder");
     args::Positional<std::string> assetLocation(addGroup, "asset-location", "Asset Prefix");
     //args::PositionalList<std::string> jsonFiles(addGroup, "json", "asset desc files");
+    args::ValueFlag<uint32_t> lodCount(parser, "count", "Levels of detail to generate", {"lods"}, 3);
+    args::ValueFlag<float> lodRatio(parser, "ratio", "Triangle ratio between levels of detail", {"lod-ratio"}, 0.5f);
+    args::Flag noOptimize(parser, "no-optimize", "Keep the source triangle and vertex order", {"no-optimize"});
 
     std::vector<std::pair<std::string, nlohmann::json>> json_data;
 
@@ -214,6 +221,47 @@ void CreateMeshCommand(args::Subparser & parser)
     tinygltf::Model model;
 
     CreateGTLFData(gltf_path.generic_string(), gli, model);
+
+    std::vector<VertexCacheStats> source_stats;
+    for (auto & prim: gli.md.primitives) {
+        source_stats.push_back(
+            AnalyzeVertexCache(gli.md.indices, prim.firstIndex, prim.indexCount, vertex_cache_size)
+        );
+    }
+
+    if (!noOptimize) {
+        WeldVertices(gli.md);
+    }
+    auto lods = GenerateLods(gli.md, lodCount.Get(), lodRatio.Get());
+
+    if (!noOptimize) {
+        auto optimize = [&](uint32_t firstIndex, uint32_t indexCount) {
+            OptimizeVertexCache(gli.md.indices, firstIndex, indexCount, vertex_cache_size);
+            OptimizeOverdraw(
+                gli.md.vertices, gli.md.indices, firstIndex, indexCount, vertex_cache_size, 1.05f
+            );
+        };
+        for (auto & prim: gli.md.primitives) {
+            optimize(prim.firstIndex, prim.indexCount);
+        }
+        for (auto & lod: lods) {
+            for (auto & sm: lod.subMeshes) {
+                optimize(sm.firstIndex, sm.indexCount);
+            }
+        }
+        OptimizeVertexFetch(gli.md);
+    }
+
+    for (size_t i = 0; i < gli.md.primitives.size(); i++) {
+        auto & prim = gli.md.primitives[i];
+        auto stats = AnalyzeVertexCache(
+            gli.md.indices, prim.firstIndex, prim.indexCount, vertex_cache_size
+        );
+        spdlog::info(
+            "Primitive {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", i,
+            source_stats[i].acmr, stats.acmr, source_stats[i].atvr, stats.atvr
+        );
+    }
     for (auto & image: gli.ims) {
         if (!image.name.empty()) {
             auto image_path = asset_path / image.name;
@@ -231,8 +279,15 @@ void CreateMeshCommand(args::Subparser & parser)
     auto mesh_path = asset_path;
     mesh_path /= gltf_path.filename();
     auto mesh_lua = mesh_path;
+    auto mesh_clusters = mesh_path;
     mesh_path.replace_extension(".mesh");
     mesh_lua.replace_extension(".lua");
+    mesh_clusters.replace_extension(".clusters");
+
+    // Clusters follow the final triangle order, so they are built after optimising
+    auto clusters = BuildClusters(gli.md, cluster_max_vertices, cluster_max_triangles);
+    WriteClusters(mesh_clusters, clusters);
+    spdlog::info("{} clusters", clusters.size());
 
 
     std::ofstream fs(mesh_path, std::ios::binary);
@@ -250,6 +305,7 @@ void CreateMeshCommand(args::Subparser & parser)
     fslua << "      mesh = \"" << asset_loc << "/" << mesh_path.filename().generic_string() << "\",\n";
     fslua << "      vertices = " << gli.md.vertices.size() << ",\n";
     fslua << "      indices = " << gli.md.indices.size() << ",\n";
+    fslua << "      clusters = \"" << asset_loc << "/" << mesh_clusters.filename().generic_string() << "\",\n";
     fslua << "      submeshes = {\n";
     for (auto sm: gli.md.primitives) {
         fslua << "        {\n";
@@ -259,6 +315,28 @@ void CreateMeshCommand(args::Subparser & parser)
         fslua << "        },\n";
     }
     fslua << "      },\n";
+    if (!lods.empty()) {
+        fslua << "      lods = {\n";
+        for (auto & lod: lods) {
+            // Switch to a level once its error is under a pixel on a 1080 line display
+            const float coverage = std::min(1.0f, 1.0f / (std::max(lod.error, 1e-6f) * 1080.0f));
+
+            fslua << "        {\n";
+            fslua << "          error = " << lod.error << ",\n";
+            fslua << "          coverage = " << coverage << ",\n";
+            fslua << "          submeshes = {\n";
+            for (auto & sm: lod.subMeshes) {
+                fslua << "            {\n";
+                fslua << "              first_index = " << sm.firstIndex << ",\n";
+                fslua << "              index_count = " << sm.indexCount << ",\n";
+                fslua << "              material = " << sm.materialIndex << "\n";
+                fslua << "            },\n";
+            }
+            fslua << "          }\n";
+            fslua << "        },\n";
+        }
+        fslua << "      },\n";
+    }
     fslua << "      materials = {\n";
     for (auto ms: gli.mats) {
 
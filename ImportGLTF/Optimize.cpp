@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include "Optimize.h"
+
+namespace
+{
+    // FIFO post transform cache, a vertex stays cached until size more misses have happened
+    struct FifoCache
+    {
+        explicit FifoCache(uint32_t cacheSize)
+            : size(cacheSize)
+        {}
+
+        bool access(uint32_t vertex)
+        {
+            auto it = stamps.find(vertex);
+            if (it != stamps.end() && misses - it->second < size) {
+                return true;
+            }
+            stamps[vertex] = misses++;
+            return false;
+        }
+
+        std::unordered_map<uint32_t, uint32_t> stamps;
+        uint32_t misses{};
+        uint32_t size;
+    };
+
+    struct Cluster
+    {
+        uint32_t firstTriangle;
+        uint32_t triangleCount;
+        float sortKey;
+    };
+}
+
+VertexCacheStats AnalyzeVertexCache(
+    const std::vector<uint32_t> & indices,
+    uint32_t first,
+    uint32_t count,
+    uint32_t cacheSize)
+{
+    if (count < 3) {
+        return {0.f, 0.f};
+    }
+
+    FifoCache cache(cacheSize);
+    for (uint32_t i = first; i < first + count; i++) {
+        cache.access(indices[i]);
+    }
+
+    return {
+        static_cast<float>(cache.misses) / static_cast<float>(count / 3),
+        static_cast<float>(cache.misses) / static_cast<float>(cache.stamps.size())
+    };
+}
+
+void WeldVertices(RxAssets::MeshSaveData & md)
+{
+    for (auto & prim: md.primitives) {
+        std::unordered_map<std::string_view, uint32_t> unique;
+
+        for (uint32_t i = prim.firstIndex; i < prim.firstIndex + prim.indexCount; i++) {
+            const auto & vertex = md.vertices[md.indices[i]];
+            const std::string_view key(reinterpret_cast<const char *>(&vertex), sizeof(vertex));
+
+            auto [it, inserted] = unique.try_emplace(key, md.indices[i]);
+            md.indices[i] = it->second;
+        }
+    }
+}
+
+void OptimizeVertexCache(
+    std::vector<uint32_t> & indices,
+    uint32_t first,
+    uint32_t count,
+    uint32_t cacheSize)
+{
+    const uint32_t triangle_count = count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Work with vertices numbered within the range
+    std::unordered_map<uint32_t, uint32_t> local_of;
+    std::vector<uint32_t> global_of;
+    std::vector<uint32_t> local(triangle_count * 3);
+
+    for (uint32_t i = 0; i < triangle_count * 3; i++) {
+        auto [it, inserted] = local_of.try_emplace(
+            indices[first + i], static_cast<uint32_t>(global_of.size())
+        );
+        if (inserted) {
+            global_of.push_back(indices[first + i]);
+        }
+        local[i] = it->second;
+    }
+    const auto vertex_count = static_cast<uint32_t>(global_of.size());
+
+    // Triangles around each vertex, and how many of them are still to be emitted
+    std::vector<uint32_t> live(vertex_count, 0);
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+
+    for (auto v: local) {
+        live[v]++;
+    }
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < triangle_count * 3; i++) {
+        adjacency[fill[local[i]]++] = i / 3;
+    }
+
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+    int64_t fanning = 0;
+
+    while (fanning >= 0) {
+        const auto f = static_cast<uint32_t>(fanning);
+
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t k = offsets[f]; k < offsets[f + 1]; k++) {
+            const uint32_t t = adjacency[k];
+            if (emitted[t]) {
+                continue;
+            }
+            for (uint32_t j = 0; j < 3; j++) {
+                const uint32_t v = local[t * 3 + j];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > cacheSize) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // Prefer the oldest candidate that will still be cached once its triangles are emitted
+        int64_t best = -1;
+        int64_t best_priority = -1;
+        for (auto v: candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cacheSize) {
+                priority = time - cache_time[v];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        // Otherwise back track through recently used vertices, then scan for any left
+        while (best < 0 && !dead_end.empty()) {
+            const uint32_t d = dead_end.back();
+            dead_end.pop_back();
+            if (live[d] > 0) {
+                best = d;
+            }
+        }
+        while (best < 0 && cursor < vertex_count) {
+            if (live[cursor] > 0) {
+                best = cursor;
+            }
+            cursor++;
+        }
+
+        fanning = best;
+    }
+
+    for (uint32_t i = 0; i < triangle_count * 3; i++) {
+        indices[first + i] = global_of[output[i]];
+    }
+}
+
+void OptimizeOverdraw(
+    const std::vector<RxAssets::MeshSaveVertex> & vertices,
+    std::vector<uint32_t> & indices,
+    uint32_t first,
+    uint32_t count,
+    uint32_t cacheSize,
+    float threshold)
+{
+    const uint32_t triangle_count = count / 3;
+    if (triangle_count < 2) {
+        return;
+    }
+
+    const auto baseline = AnalyzeVertexCache(indices, first, count, cacheSize);
+    const float split_acmr = baseline.acmr * threshold;
+
+    // Hard boundaries are where the cache order starts over, every vertex of a triangle missing
+    std::vector<uint32_t> boundaries;
+    {
+        FifoCache cache(cacheSize);
+        for (uint32_t t = 0; t < triangle_count; t++) {
+            uint32_t misses = 0;
+            for (uint32_t j = 0; j < 3; j++) {
+                misses += cache.access(indices[first + t * 3 + j]) ? 0 : 1;
+            }
+            if (t == 0 || misses == 3) {
+                boundaries.push_back(t);
+            }
+        }
+        boundaries.push_back(triangle_count);
+    }
+
+    // Each is split again wherever the cluster so far, starting from a cold cache, does as well
+    // as the whole range, so drawing it elsewhere costs little
+    std::vector<Cluster> clusters;
+    for (size_t b = 0; b + 1 < boundaries.size(); b++) {
+        std::optional<FifoCache> cache;
+        uint32_t cluster_misses = 0;
+
+        for (uint32_t t = boundaries[b]; t < boundaries[b + 1]; t++) {
+            const bool split = cache.has_value() &&
+                static_cast<float>(cluster_misses) <=
+                baseline.acmr * static_cast<float>(clusters.back().triangleCount);
+
+            if (!cache.has_value() || split) {
+                clusters.push_back({t, 0, 0.f});
+                cache.emplace(cacheSize);
+                cluster_misses = 0;
+            }
+            for (uint32_t j = 0; j < 3; j++) {
+                cluster_misses += cache->access(indices[first + t * 3 + j]) ? 0 : 1;
+            }
+            clusters.back().triangleCount++;
+        }
+    }
+
+    if (clusters.size() < 2) {
+        return;
+    }
+
+    // Area weighted centroids and normals of the range and of each cluster
+    auto triangle = [&](uint32_t t, float centroid[3], float normal[3]) {
+        const auto & p0 = vertices[indices[first + t * 3]];
+        const auto & p1 = vertices[indices[first + t * 3 + 1]];
+        const auto & p2 = vertices[indices[first + t * 3 + 2]];
+
+        const float e1[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+        const float e2[3] = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+
+        normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        centroid[0] = (p0.x + p1.x + p2.x) / 3.f;
+        centroid[1] = (p0.y + p1.y + p2.y) / 3.f;
+        centroid[2] = (p0.z + p1.z + p2.z) / 3.f;
+
+        return std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    };
+
+    float mesh_centroid[3] = {};
+    float mesh_area = 0.f;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        float c[3], n[3];
+        const float area = triangle(t, c, n);
+        for (uint32_t k = 0; k < 3; k++) {
+            mesh_centroid[k] += c[k] * area;
+        }
+        mesh_area += area;
+    }
+    if (mesh_area <= 0.f) {
+        return;
+    }
+    for (float & c: mesh_centroid) {
+        c /= mesh_area;
+    }
+
+    for (auto & cluster: clusters) {
+        float centroid[3] = {};
+        float normal[3] = {};
+        float area = 0.f;
+
+        for (uint32_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++) {
+            float c[3], n[3];
+            const float a = triangle(t, c, n);
+            for (uint32_t k = 0; k < 3; k++) {
+                centroid[k] += c[k] * a;
+                normal[k] += n[k];
+            }
+            area += a;
+        }
+
+        const float length = std::sqrt(
+            normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]
+        );
+        if (area <= 0.f || length <= 0.f) {
+            continue;
+        }
+
+        // Clusters facing away from the middle of the mesh are the likely occluders
+        for (uint32_t k = 0; k < 3; k++) {
+            cluster.sortKey += (centroid[k] / area - mesh_centroid[k]) * normal[k] / length;
+        }
+    }
+
+    std::ranges::stable_sort(
+        clusters, [](const Cluster & a, const Cluster & b) {
+            return a.sortKey > b.sortKey;
+        }
+    );
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(triangle_count * 3);
+    for (auto & cluster: clusters) {
+        auto begin = indices.begin() + first + cluster.firstTriangle * 3;
+        sorted.insert(sorted.end(), begin, begin + cluster.triangleCount * 3);
+    }
+
+    if (AnalyzeVertexCache(sorted, 0, triangle_count * 3, cacheSize).acmr <= split_acmr) {
+        std::ranges::copy(sorted, indices.begin() + first);
+    }
+}
+
+void OptimizeVertexFetch(RxAssets::MeshSaveData & md)
+{
+    constexpr uint32_t unused = ~0u;
+
+    std::vector<uint32_t> remap(md.vertices.size(), unused);
+    std::vector<RxAssets::MeshSaveVertex> vertices;
+    vertices.reserve(md.vertices.size());
+
+    for (auto & index: md.indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(md.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    md.vertices = std::move(vertices);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <RXAssets.h>
+
+// Post transform cache size the index orderings are tuned for and measured against
+constexpr uint32_t vertex_cache_size = 16;
+
+struct VertexCacheStats
+{
+    // Cache misses per triangle, 0.5 is ideal for a large regular mesh and 3 the worst
+    float acmr;
+    // Cache misses per vertex referenced, 1.0 is ideal
+    float atvr;
+};
+
+// Simulates a FIFO cache over count indices starting at first
+VertexCacheStats AnalyzeVertexCache(
+    const std::vector<uint32_t> & indices,
+    uint32_t first,
+    uint32_t count,
+    uint32_t cacheSize);
+
+// Merges identical vertices within each primitive. Vertices are never shared between
+// primitives so material seams stay split for the simplifier
+void WeldVertices(RxAssets::MeshSaveData & md);
+
+// Reorders the triangles of an index range for the post transform cache (Tipsify)
+void OptimizeVertexCache(
+    std::vector<uint32_t> & indices,
+    uint32_t first,
+    uint32_t count,
+    uint32_t cacheSize);
+
+// Reorders clusters of a cache optimised range so outward facing ones draw first, as long as
+// the range's ACMR gets no worse than threshold times its current value
+void OptimizeOverdraw(
+    const std::vector<RxAssets::MeshSaveVertex> & vertices,
+    std::vector<uint32_t> & indices,
+    uint32_t first,
+    uint32_t count,
+    uint32_t cacheSize,
+    float threshold);
+
+// Renumbers vertices in the order the index list first uses them and drops unused ones
+void OptimizeVertexFetch(RxAssets::MeshSaveData & md);
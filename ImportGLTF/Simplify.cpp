@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <queue>
+#include "Simplify.h"
+
+namespace
+{
+    // Symmetric 4x4 error quadric, summed from the planes of the triangles around a vertex
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        // Sum of the plane weights
+        double weight;
+
+        void addPlane(double a, double b, double c, double d, double w)
+        {
+            a2 += w * a * a;
+            ab += w * a * b;
+            ac += w * a * c;
+            ad += w * a * d;
+            b2 += w * b * b;
+            bc += w * b * c;
+            bd += w * b * d;
+            c2 += w * c * c;
+            cd += w * c * d;
+            d2 += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric & o)
+        {
+            a2 += o.a2;
+            ab += o.ab;
+            ac += o.ac;
+            ad += o.ad;
+            b2 += o.b2;
+            bc += o.bc;
+            bd += o.bd;
+            c2 += o.c2;
+            cd += o.cd;
+            d2 += o.d2;
+            weight += o.weight;
+        }
+
+        [[nodiscard]] double evaluate(double x, double y, double z) const
+        {
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                + c2 * z * z + 2 * cd * z
+                + d2;
+        }
+
+        // Weighted mean of the squared distances to the planes. Unlike evaluate, which scales
+        // with the weights as well, this is a squared distance in mesh units.
+        [[nodiscard]] double distance2(double x, double y, double z) const
+        {
+            return weight > 0.0 ? std::max(0.0, evaluate(x, y, z) / weight) : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator>(const Collapse & o) const
+        {
+            return cost > o.cost;
+        }
+    };
+
+    std::array<double, 3> triangleNormal(
+        const std::vector<RxAssets::MeshSaveVertex> & vertices,
+        uint32_t i0,
+        uint32_t i1,
+        uint32_t i2)
+    {
+        const auto & p0 = vertices[i0];
+        const auto & p1 = vertices[i1];
+        const auto & p2 = vertices[i2];
+
+        const double e1[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+        const double e2[3] = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+
+        return {
+            e1[1] * e2[2] - e1[2] * e2[1],
+            e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0]
+        };
+    }
+}
+
+std::vector<bool> FindLockedVertices(
+    const std::vector<RxAssets::MeshSaveVertex> & vertices,
+    const std::vector<uint32_t> & indices)
+{
+    std::map<std::array<float, 3>, uint32_t> positions;
+    std::vector<uint32_t> weld(vertices.size());
+    std::vector<uint32_t> shared;
+
+    // Vertices merged away by welding are still in the list but no longer split anything
+    std::vector<bool> referenced(vertices.size(), false);
+    for (auto index: indices) {
+        referenced[index] = true;
+    }
+
+    for (size_t v = 0; v < vertices.size(); v++) {
+        if (!referenced[v]) {
+            continue;
+        }
+        auto [it, inserted] = positions.try_emplace(
+            {vertices[v].x, vertices[v].y, vertices[v].z},
+            static_cast<uint32_t>(shared.size()));
+        if (inserted) {
+            shared.push_back(0);
+        }
+        weld[v] = it->second;
+        shared[it->second]++;
+    }
+
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> edges;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        for (size_t k = 0; k < 3; k++) {
+            auto a = weld[indices[t + k]];
+            auto b = weld[indices[t + (k + 1) % 3]];
+            if (a != b) {
+                edges[std::minmax(a, b)]++;
+            }
+        }
+    }
+
+    std::vector<bool> border(shared.size(), false);
+    for (auto & [edge, count]: edges) {
+        if (count == 1) {
+            border[edge.first] = true;
+            border[edge.second] = true;
+        }
+    }
+
+    std::vector<bool> locked(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++) {
+        locked[v] = referenced[v] && (shared[weld[v]] > 1 || border[weld[v]]);
+    }
+    return locked;
+}
+
+std::vector<uint32_t> SimplifyIndices(
+    const std::vector<RxAssets::MeshSaveVertex> & vertices,
+    const std::vector<uint32_t> & indices,
+    const std::vector<bool> & locked,
+    size_t targetIndexCount,
+    float maxError,
+    float & error)
+{
+    const size_t triangle_count = indices.size() / 3;
+
+    std::vector<uint32_t> triangles(indices.begin(), indices.begin() + triangle_count * 3);
+    std::vector<bool> alive(triangle_count, true);
+    std::vector<bool> removed(vertices.size(), false);
+    std::vector<uint32_t> versions(vertices.size(), 0);
+    std::vector<Quadric> quadrics(vertices.size(), Quadric{});
+    std::vector<std::vector<uint32_t>> adjacency(vertices.size());
+
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        const uint32_t * tri = &triangles[t * 3];
+        for (uint32_t k = 0; k < 3; k++) {
+            adjacency[tri[k]].push_back(t);
+        }
+
+        auto n = triangleNormal(vertices, tri[0], tri[1], tri[2]);
+        const double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len <= 0.0) {
+            continue;
+        }
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+
+        const auto & p = vertices[tri[0]];
+        const double d = -(n[0] * p.x + n[1] * p.y + n[2] * p.z);
+
+        // Weighting by area keeps large flat regions from being dominated by slivers
+        for (uint32_t k = 0; k < 3; k++) {
+            quadrics[tri[k]].addPlane(n[0], n[1], n[2], d, len * 0.5);
+        }
+    }
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+
+    auto push_collapse = [&](uint32_t from, uint32_t to)
+    {
+        if (locked[from]) {
+            return;
+        }
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        const auto & p = vertices[to];
+        const double cost = q.distance2(p.x, p.y, p.z);
+        queue.push({cost, from, to, versions[from], versions[to]});
+    };
+
+    // Moving a vertex must not turn any of its remaining triangles over
+    auto flips = [&](uint32_t from, uint32_t to)
+    {
+        for (auto t: adjacency[from]) {
+            if (!alive[t]) {
+                continue;
+            }
+            std::array<uint32_t, 3> tri{triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2]};
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                continue;
+            }
+            auto n0 = triangleNormal(vertices, tri[0], tri[1], tri[2]);
+            std::replace(tri.begin(), tri.end(), from, to);
+            auto n1 = triangleNormal(vertices, tri[0], tri[1], tri[2]);
+
+            if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            auto a = triangles[t * 3 + k];
+            auto b = triangles[t * 3 + (k + 1) % 3];
+            if (a != b) {
+                push_collapse(a, b);
+                push_collapse(b, a);
+            }
+        }
+    }
+
+    const double max_cost = static_cast<double>(maxError) * maxError;
+    double worst_cost = 0.0;
+    size_t live_indices = triangle_count * 3;
+
+    while (live_indices > targetIndexCount && !queue.empty()) {
+        auto c = queue.top();
+        queue.pop();
+
+        if (removed[c.from] || removed[c.to] ||
+            versions[c.from] != c.fromVersion || versions[c.to] != c.toVersion) {
+            continue;
+        }
+        if (c.cost > max_cost) {
+            break;
+        }
+        if (flips(c.from, c.to)) {
+            continue;
+        }
+
+        for (auto t: adjacency[c.from]) {
+            if (!alive[t]) {
+                continue;
+            }
+            uint32_t * tri = &triangles[t * 3];
+            if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                alive[t] = false;
+                live_indices -= 3;
+                continue;
+            }
+            std::replace(tri, tri + 3, c.from, c.to);
+            adjacency[c.to].push_back(t);
+        }
+        adjacency[c.from].clear();
+
+        quadrics[c.to].add(quadrics[c.from]);
+        removed[c.from] = true;
+        versions[c.to]++;
+        worst_cost = std::max(worst_cost, c.cost);
+
+        for (auto t: adjacency[c.to]) {
+            if (!alive[t]) {
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                auto w = triangles[t * 3 + k];
+                if (w != c.to) {
+                    push_collapse(c.to, w);
+                    push_collapse(w, c.to);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(live_indices);
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        if (alive[t]) {
+            result.insert(result.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+        }
+    }
+
+    error = static_cast<float>(std::sqrt(worst_cost));
+    return result;
+}
+
+std::vector<LodLevel> GenerateLods(RxAssets::MeshSaveData & md, uint32_t lodCount, float ratio)
+{
+    std::vector<LodLevel> lods;
+
+    const float dx = md.maxpx - md.minpx;
+    const float dy = md.maxpy - md.minpy;
+    const float dz = md.maxpz - md.minpz;
+    const float diagonal = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+    if (lodCount == 0 || md.primitives.empty() || diagonal <= 0.f) {
+        return lods;
+    }
+
+    const auto locked = FindLockedVertices(md.vertices, md.indices);
+
+    std::vector<std::vector<uint32_t>> current(md.primitives.size());
+    for (size_t i = 0; i < md.primitives.size(); i++) {
+        auto first = md.indices.begin() + md.primitives[i].firstIndex;
+        current[i].assign(first, first + md.primitives[i].indexCount);
+    }
+
+    float error = 0.f;
+
+    for (uint32_t level = 0; level < lodCount; level++) {
+        std::vector<std::vector<uint32_t>> next(current.size());
+        size_t before = 0;
+        size_t after = 0;
+        float level_error = 0.f;
+
+        for (size_t i = 0; i < current.size(); i++) {
+            const size_t target = static_cast<size_t>(
+                static_cast<float>(current[i].size() / 3) * ratio) * 3;
+            float e = 0.f;
+            next[i] = SimplifyIndices(md.vertices, current[i], locked, target, FLT_MAX, e);
+            level_error = std::max(level_error, e / diagonal);
+            before += current[i].size();
+            after += next[i].size();
+        }
+
+        // Locked seams eventually stop the chain from getting any simpler
+        if (after == 0 || static_cast<float>(after) > static_cast<float>(before) * 0.95f) {
+            break;
+        }
+
+        // Each level is simplified from the last, so the errors accumulate down the chain
+        error += level_error;
+
+        auto & lod = lods.emplace_back();
+        lod.error = error;
+        for (size_t i = 0; i < next.size(); i++) {
+            lod.subMeshes.push_back({
+                static_cast<uint32_t>(md.indices.size()),
+                static_cast<uint32_t>(next[i].size()),
+                static_cast<int32_t>(md.primitives[i].materialIndex)
+            });
+            md.indices.insert(md.indices.end(), next[i].begin(), next[i].end());
+        }
+        current = std::move(next);
+    }
+
+    return lods;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <RXAssets.h>
+
+struct LodSubMesh
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t materialIndex;
+};
+
+struct LodLevel
+{
+    float error;
+    std::vector<LodSubMesh> subMeshes;
+};
+
+// Marks vertices that must not be collapsed: any vertex sharing its position with another
+// vertex (uv, normal and material seams) and any vertex on an open border of the mesh
+std::vector<bool> FindLockedVertices(
+    const std::vector<RxAssets::MeshSaveVertex> & vertices,
+    const std::vector<uint32_t> & indices);
+
+// Collapses edges onto existing vertices until the index count reaches targetIndexCount or
+// no collapse is cheaper than maxError. The result indexes the same vertex list. error
+// receives the largest collapse error, as a distance in mesh units
+std::vector<uint32_t> SimplifyIndices(
+    const std::vector<RxAssets::MeshSaveVertex> & vertices,
+    const std::vector<uint32_t> & indices,
+    const std::vector<bool> & locked,
+    size_t targetIndexCount,
+    float maxError,
+    float & error);
+
+// Builds up to lodCount simplified levels for every primitive of md, each level aiming for
+// ratio times the triangles of the previous one. Level indices are appended to md.indices
+// after the base mesh; errors are relative to the mesh bounds diagonal
+std::vector<LodLevel> GenerateLods(RxAssets::MeshSaveData & md, uint32_t lodCount, float ratio);
@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <vector>
+#include "DeviceInfo.h"
+#include "Log.h"
+
+namespace RxEngine
+{
+    namespace
+    {
+        bool getCacheHeader(VkDevice device, VkPipelineCacheHeaderVersionOne & header)
+        {
+            VkPipelineCacheCreateInfo pcci{};
+            pcci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+            VkPipelineCache cache{VK_NULL_HANDLE};
+            if (vkCreatePipelineCache(device, &pcci, nullptr, &cache) != VK_SUCCESS) {
+                return false;
+            }
+
+            size_t size = 0;
+            vkGetPipelineCacheData(device, cache, &size, nullptr);
+            std::vector<char> data(size);
+            const bool ok = size >= sizeof(header) &&
+                vkGetPipelineCacheData(device, cache, &size, data.data()) == VK_SUCCESS &&
+                size >= sizeof(header);
+            vkDestroyPipelineCache(device, cache, nullptr);
+
+            if (ok) {
+                std::memcpy(&header, data.data(), sizeof(header));
+            }
+            return ok;
+        }
+    }
+
+    DeviceInfo::DeviceInfo(RxCore::Device * device)
+    {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (!getCacheHeader(device->getDevice(), header)) {
+            spdlog::warn("Unable to identify the physical device, GPU features are off");
+            return;
+        }
+
+        VkApplicationInfo ai{};
+        ai.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        ai.pApplicationName = "RxEngine device query";
+        ai.apiVersion = VK_API_VERSION_1_2;
+
+        VkInstanceCreateInfo ici{};
+        ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        ici.pApplicationInfo = &ai;
+
+        VkInstance instance{VK_NULL_HANDLE};
+        if (vkCreateInstance(&ici, nullptr, &instance) != VK_SUCCESS) {
+            spdlog::warn("Unable to identify the physical device, GPU features are off");
+            return;
+        }
+
+        uint32_t count = 0;
+        vkEnumeratePhysicalDevices(instance, &count, nullptr);
+        std::vector<VkPhysicalDevice> physical_devices(count);
+        vkEnumeratePhysicalDevices(instance, &count, physical_devices.data());
+
+        for (auto pd: physical_devices) {
+            VkPhysicalDeviceProperties props{};
+            vkGetPhysicalDeviceProperties(pd, &props);
+            if (props.vendorID != header.vendorID || props.deviceID != header.deviceID ||
+                std::memcmp(props.pipelineCacheUUID, header.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+                continue;
+            }
+
+            VkPhysicalDeviceVulkan12Features features12{};
+            features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+            VkPhysicalDeviceFeatures2 features{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            // The 1.2 block may only be chained for a device that has it
+            if (props.apiVersion >= VK_API_VERSION_1_2) {
+                features.pNext = &features12;
+            }
+            vkGetPhysicalDeviceFeatures2(pd, &features);
+
+            found_ = true;
+            timestampPeriod_ = props.limits.timestampPeriod;
+            multiDrawIndirect_ = features.features.multiDrawIndirect;
+            drawIndirectFirstInstance_ = features.features.drawIndirectFirstInstance;
+            drawIndirectCount_ = features12.drawIndirectCount;
+            pipelineStatisticsQuery_ = features.features.pipelineStatisticsQuery;
+            inheritedQueries_ = features.features.inheritedQueries;
+            break;
+        }
+
+        vkDestroyInstance(instance, nullptr);
+
+        if (!found_) {
+            spdlog::warn("Unable to identify the physical device, GPU features are off");
+        }
+    }
+}
@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "Vulkan/Device.h"
+
+namespace RxEngine
+{
+    // Limits and features of the physical device behind RxCore's device, which RxCore keeps to
+    // itself. The device is found again through an instance of our own, as the one whose vendor,
+    // device and pipelineCacheUUID match the header of an empty pipeline cache made on ours.
+    //
+    // The features are what the device supports. Using one still needs RxCore to have enabled it
+    // when it created the device, so the renderer lets each be turned off from the config.
+    class DeviceInfo
+    {
+    public:
+        explicit DeviceInfo(RxCore::Device * device);
+
+        // False when the physical device couldn't be found, everything below is then off
+        [[nodiscard]] bool found() const
+        {
+            return found_;
+        }
+
+        // Nanoseconds per timestamp tick
+        [[nodiscard]] float timestampPeriod() const
+        {
+            return timestampPeriod_;
+        }
+
+        [[nodiscard]] bool multiDrawIndirect() const
+        {
+            return multiDrawIndirect_;
+        }
+
+        [[nodiscard]] bool drawIndirectFirstInstance() const
+        {
+            return drawIndirectFirstInstance_;
+        }
+
+        [[nodiscard]] bool drawIndirectCount() const
+        {
+            return drawIndirectCount_;
+        }
+
+        [[nodiscard]] bool pipelineStatisticsQuery() const
+        {
+            return pipelineStatisticsQuery_;
+        }
+
+        [[nodiscard]] bool inheritedQueries() const
+        {
+            return inheritedQueries_;
+        }
+
+    private:
+        bool found_{};
+        float timestampPeriod_{};
+        bool multiDrawIndirect_{};
+        bool drawIndirectFirstInstance_{};
+        bool drawIndirectCount_{};
+        bool pipelineStatisticsQuery_{};
+        bool inheritedQueries_{};
+    };
+}
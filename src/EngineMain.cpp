@@ -38,6 +38,7 @@
 #include "Modules/Environment/Environment.h"
 #include "Modules/ImGui/ImGuiRender.hpp"
 #include "Modules/Lighting/Lighting.h"
+#include "Modules/Render.h"
 #include "Modules/Stats/Stats.h"
 #include "Modules/Prototypes/Prototypes.h"
 #include "Modules/RmlUI/RmlUI.h"
@@ -112,6 +113,36 @@ namespace RxEngine
                  }
              );
 
+        world->createSystem("Engine:UploadRing")
+             .inGroup("Pipeline:PreFrame")
+             .execute(
+                 [this](ecs::World *) {
+                     uploadRing_->beginFrame();
+                 }
+             );
+
+        world->createSystem("Engine:FlushUploads")
+             .inGroup("Pipeline:Render")
+             .withStreamWrite<Render::ComputeCommand>()
+             .execute(
+                 [this](ecs::World * w) {
+                     auto record = uploadService_->flush();
+                     if (record) {
+                         w->getStream<Render::ComputeCommand>()
+                          ->add<Render::ComputeCommand>({Render::ComputeStage::Upload, std::move(record)});
+                     }
+                 }
+             );
+
+        world->createSystem("Engine:SavePipelineCache")
+             .inGroup("Pipeline:PostFrame")
+             .withInterval(30.0f)
+             .execute(
+                 [this](ecs::World *) {
+                     pipelineCache_->save();
+                 }
+             );
+
         world->createSystem("Engine:Clean")
              .inGroup("Pipeline:PostFrame")
              .execute(
@@ -330,6 +361,25 @@ namespace RxEngine
             //RxCore::threadResources.device = d;
         };
         RxCore::threadResources.setDevice(d);
+        deviceInfo_ = std::make_unique<DeviceInfo>(d);
+
+        uploadRing_ = std::make_unique<UploadRing>(
+            d,
+            static_cast<VkDeviceSize>(getUint32ConfigValue("render", "uploadRingMB", 64)) * 1024 * 1024
+        );
+        uploadService_ = std::make_unique<UploadService>(
+            d,
+            static_cast<VkDeviceSize>(getUint32ConfigValue("render", "uploadPageMB", 16)) * 1024 * 1024
+        );
+
+        std::filesystem::path pipeline_cache_path;
+        if (getBoolConfigValue("render", "pipelineCache", true)) {
+            if (auto pref_path = SDL_GetPrefPath("RxEngine", windowTitle)) {
+                pipeline_cache_path = std::filesystem::path(pref_path) / "pipeline.cache";
+                SDL_free(pref_path);
+            }
+        }
+        pipelineCache_ = std::make_unique<PipelineCache>(d, pipeline_cache_path);
 
         RxCore::JobManager::instance().startup();
 
@@ -400,6 +450,11 @@ namespace RxEngine
         delete lua;
 
         window_.reset();
+        pipelineCache_->save();
+        pipelineCache_.reset();
+        uploadService_.reset();
+        deviceInfo_.reset();
+        uploadRing_.reset();
         device_.reset();
         RxAssets::vfs()->shutdown();
         RxCore::Events::shutdown();
@@ -704,6 +759,11 @@ namespace RxEngine
         return device_->getUniformBufferAlignment(size);
     }
 
+    float EngineMain::getTimestampPeriod() const
+    {
+        return deviceInfo_->timestampPeriod();
+    }
+
     std::shared_ptr<RxCore::Buffer> EngineMain::createUniformBuffer(size_t size) const
     {
         return device_->createBuffer(
@@ -720,6 +780,15 @@ namespace RxEngine
         );
     }
 
+    std::shared_ptr<RxCore::Buffer> EngineMain::createIndirectBuffer(size_t size) const
+    {
+        return device_->createBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU, size
+        );
+    }
+
     void EngineMain::captureMouse(bool enable)
     {
         capturedMouse = enable;
@@ -43,6 +43,10 @@
 #include "Log.h"
 #include "Modules/Module.h"
 #include "Reflection.h"
+#include "UploadRing.h"
+#include "UploadService.h"
+#include "PipelineCache.h"
+#include "DeviceInfo.h"
 
 namespace RxAssets
 {
@@ -357,8 +361,31 @@ namespace RxEngine
                                       uint32_t defaultValue);
 
         [[nodiscard]] size_t getUniformBufferAlignment(size_t size) const;
+        [[nodiscard]] float getTimestampPeriod() const;
+
+        [[nodiscard]] const DeviceInfo * getDeviceInfo() const
+        {
+            return deviceInfo_.get();
+        }
+
         [[nodiscard]] std::shared_ptr<RxCore::Buffer> createUniformBuffer(size_t size) const;
         [[nodiscard]] std::shared_ptr<RxCore::Buffer> createStorageBuffer(size_t size) const;
+        [[nodiscard]] std::shared_ptr<RxCore::Buffer> createIndirectBuffer(size_t size) const;
+
+        [[nodiscard]] UploadRing * getUploadRing() const
+        {
+            return uploadRing_.get();
+        }
+
+        [[nodiscard]] UploadService * getUploadService() const
+        {
+            return uploadService_.get();
+        }
+
+        [[nodiscard]] PipelineCache * getPipelineCache() const
+        {
+            return pipelineCache_.get();
+        }
 
         template<class T, typename ...Args>
         void addModule(Args && ... args);
@@ -414,6 +441,10 @@ namespace RxEngine
     private:
         std::unique_ptr<RxCore::Window> window_;
         std::unique_ptr<RxCore::Device, std::function<void(RxCore::Device *)>> device_;
+        std::unique_ptr<UploadRing> uploadRing_;
+        std::unique_ptr<UploadService> uploadService_;
+        std::unique_ptr<PipelineCache> pipelineCache_;
+        std::unique_ptr<DeviceInfo> deviceInfo_;
 
         std::vector<std::shared_ptr<Module>> modules;
         std::vector<std::shared_ptr<Module>> userModules;
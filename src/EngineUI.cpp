@@ -53,9 +53,66 @@ namespace RxEngine
             ImGui::Text("%d", fs->frames[fs->index].drawCalls);
             ImGui::TableNextRow();
             ImGui::TableNextColumn();
+            ImGui::Text("API Draw Calls");
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", fs->frames[fs->index].apiDrawCalls);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
             ImGui::Text("Triangles");
             ImGui::TableNextColumn();
             ImGui::Text("%d", fs->frames[fs->index].triangles);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("GPU Time");
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f ms", fs->frames[fs->index].gpuTime);
+            for (uint32_t p = 0; p < GpuPassCount; p++) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("  %s", gpu_pass_names[p]);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f ms", fs->frames[fs->index].gpuPassTimes[p]);
+            }
+            for (uint32_t c = 0; c < NUM_CASCADES; c++) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("    Cascade %u", c);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f ms", fs->frames[fs->index].gpuCascadeTimes[c]);
+            }
+            if (fs->frames[fs->index].pipelineStatistics) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("Pipeline Statistics");
+                ImGui::TableNextColumn();
+                ImGui::Text(
+                    "%llu VS, %llu clipped, %llu FS, %llu CS",
+                    fs->frames[fs->index].vertexInvocations,
+                    fs->frames[fs->index].clippingPrimitives,
+                    fs->frames[fs->index].fragmentInvocations,
+                    fs->frames[fs->index].computeInvocations
+                );
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("Occlusion Culled");
+            ImGui::TableNextColumn();
+            ImGui::Text(
+                "%d / %d",
+                fs->frames[fs->index].occlusionCulled,
+                fs->frames[fs->index].occlusionTested
+            );
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("Upload Ring");
+            ImGui::TableNextColumn();
+            ImGui::Text(
+                "%lld KB frame, %lld / %lld KB in flight (peak %lld KB)",
+                fs->frames[fs->index].uploadBytes / 1024,
+                fs->frames[fs->index].uploadInFlight / 1024,
+                fs->frames[fs->index].uploadCapacity / 1024,
+                fs->frames[fs->index].uploadPeak / 1024
+            );
         }
     }
 
@@ -0,0 +1,256 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "Culling.h"
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RX_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define RX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace RxEngine
+{
+    namespace
+    {
+        bool cpuHasAvx2()
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+            __cpuid(info, 1);
+            const bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                (_xgetbv(0) & 0x6) == 0x6;
+            if (!os_saves_ymm) {
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        void cullScalar(
+            const CullSpheres & s,
+            const CullPlanes & p,
+            uint32_t begin,
+            uint32_t end,
+            std::vector<uint32_t> & visible)
+        {
+            for (uint32_t i = begin; i < end; i++) {
+                bool inside = true;
+                for (uint32_t j = 0; j < p.count; j++) {
+                    auto & plane = p.planes[j];
+                    // Summed in the same order as the vector kernels so they agree exactly
+                    const float d = s.x[i] * plane.x + plane.w + s.y[i] * plane.y + s.z[i] * plane.z;
+                    if (d > s.radius[i]) {
+                        inside = false;
+                        break;
+                    }
+                }
+                if (inside) {
+                    visible.push_back(i);
+                }
+            }
+        }
+
+        void appendMask(uint32_t base, uint32_t mask, std::vector<uint32_t> & visible)
+        {
+            while (mask) {
+                unsigned long bit;
+#if defined(_MSC_VER)
+                _BitScanForward(&bit, mask);
+#else
+                bit = static_cast<unsigned long>(__builtin_ctz(mask));
+#endif
+                visible.push_back(base + static_cast<uint32_t>(bit));
+                mask &= mask - 1;
+            }
+        }
+
+        uint32_t cullSSE(
+            const CullSpheres & s,
+            const CullPlanes & p,
+            uint32_t begin,
+            uint32_t end,
+            std::vector<uint32_t> & visible)
+        {
+            __m128 px[6], py[6], pz[6], pw[6];
+            for (uint32_t j = 0; j < p.count; j++) {
+                px[j] = _mm_set1_ps(p.planes[j].x);
+                py[j] = _mm_set1_ps(p.planes[j].y);
+                pz[j] = _mm_set1_ps(p.planes[j].z);
+                pw[j] = _mm_set1_ps(p.planes[j].w);
+            }
+
+            uint32_t i = begin;
+            for (; i + 4 <= end; i += 4) {
+                const __m128 x = _mm_loadu_ps(&s.x[i]);
+                const __m128 y = _mm_loadu_ps(&s.y[i]);
+                const __m128 z = _mm_loadu_ps(&s.z[i]);
+                const __m128 r = _mm_loadu_ps(&s.radius[i]);
+
+                __m128 outside = _mm_setzero_ps();
+                for (uint32_t j = 0; j < p.count; j++) {
+                    __m128 d = _mm_add_ps(_mm_mul_ps(x, px[j]), pw[j]);
+                    d = _mm_add_ps(d, _mm_mul_ps(y, py[j]));
+                    d = _mm_add_ps(d, _mm_mul_ps(z, pz[j]));
+                    outside = _mm_or_ps(outside, _mm_cmpgt_ps(d, r));
+                }
+                appendMask(i, ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xf, visible);
+            }
+            return i;
+        }
+
+        RX_TARGET_AVX2 uint32_t cullAVX2(
+            const CullSpheres & s,
+            const CullPlanes & p,
+            uint32_t begin,
+            uint32_t end,
+            std::vector<uint32_t> & visible)
+        {
+            __m256 px[6], py[6], pz[6], pw[6];
+            for (uint32_t j = 0; j < p.count; j++) {
+                px[j] = _mm256_set1_ps(p.planes[j].x);
+                py[j] = _mm256_set1_ps(p.planes[j].y);
+                pz[j] = _mm256_set1_ps(p.planes[j].z);
+                pw[j] = _mm256_set1_ps(p.planes[j].w);
+            }
+
+            uint32_t i = begin;
+            for (; i + 8 <= end; i += 8) {
+                const __m256 x = _mm256_loadu_ps(&s.x[i]);
+                const __m256 y = _mm256_loadu_ps(&s.y[i]);
+                const __m256 z = _mm256_loadu_ps(&s.z[i]);
+                const __m256 r = _mm256_loadu_ps(&s.radius[i]);
+
+                __m256 outside = _mm256_setzero_ps();
+                for (uint32_t j = 0; j < p.count; j++) {
+                    __m256 d = _mm256_add_ps(_mm256_mul_ps(x, px[j]), pw[j]);
+                    d = _mm256_add_ps(d, _mm256_mul_ps(y, py[j]));
+                    d = _mm256_add_ps(d, _mm256_mul_ps(z, pz[j]));
+                    outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, r, _CMP_GT_OQ));
+                }
+                appendMask(i, ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xff, visible);
+            }
+            return i;
+        }
+    }
+
+    CullPlanes makeCullPlanes(const DirectX::BoundingFrustum & frustum)
+    {
+        DirectX::XMVECTOR planes[6];
+        frustum.GetPlanes(
+            &planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]
+        );
+
+        CullPlanes cp{};
+        cp.count = 6;
+        for (uint32_t i = 0; i < 6; i++) {
+            DirectX::XMStoreFloat4(&cp.planes[i], planes[i]);
+        }
+        return cp;
+    }
+
+    CullPlanes makeCullPlanes(const DirectX::BoundingOrientedBox & box)
+    {
+        const auto orientation = DirectX::XMLoadFloat4(&box.Orientation);
+        const auto centre = DirectX::XMLoadFloat3(&box.Center);
+        const float extents[3] = {box.Extents.x, box.Extents.y, box.Extents.z};
+        const DirectX::XMVECTOR axes[3] = {
+            DirectX::g_XMIdentityR0, DirectX::g_XMIdentityR1, DirectX::g_XMIdentityR2
+        };
+
+        // A slab per box axis, tests a sphere against the box faces only which is conservative
+        // near the edges in the same way as the frustum test
+        CullPlanes cp{};
+        cp.count = 6;
+        for (uint32_t i = 0; i < 3; i++) {
+            const auto axis = DirectX::XMVector3Rotate(axes[i], orientation);
+            const float d = DirectX::XMVectorGetX(DirectX::XMVector3Dot(axis, centre));
+
+            DirectX::XMFLOAT3 a;
+            DirectX::XMStoreFloat3(&a, axis);
+            cp.planes[i * 2] = {a.x, a.y, a.z, -d - extents[i]};
+            cp.planes[i * 2 + 1] = {-a.x, -a.y, -a.z, d - extents[i]};
+        }
+        return cp;
+    }
+
+    CullIsa cullIsa()
+    {
+        static const CullIsa isa = cpuHasAvx2() ? CullIsa::AVX2 : CullIsa::SSE;
+        return isa;
+    }
+
+    void cullSpheres(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        uint32_t begin,
+        uint32_t end,
+        std::vector<uint32_t> & visible)
+    {
+        cullSpheres(spheres, planes, begin, end, visible, cullIsa());
+    }
+
+    void cullSpheres(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        uint32_t begin,
+        uint32_t end,
+        std::vector<uint32_t> & visible,
+        CullIsa isa)
+    {
+        uint32_t i;
+        switch (isa) {
+            case CullIsa::AVX2:
+                i = cullAVX2(spheres, planes, begin, end, visible);
+                break;
+            case CullIsa::SSE:
+                i = cullSSE(spheres, planes, begin, end, visible);
+                break;
+            default:
+                i = begin;
+                break;
+        }
+        cullScalar(spheres, planes, i, end, visible);
+    }
+
+    void cullSpheres(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        std::vector<uint32_t> & visible)
+    {
+        cullSpheres(spheres, planes, 0, spheres.size(), visible);
+    }
+}
@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "DirectXMath.h"
+#include "DirectXCollision.h"
+
+namespace RxEngine
+{
+    // Bounding spheres held as separate component arrays so the culling kernels can load
+    // 4 or 8 of them at a time.
+    struct CullSpheres
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> radius;
+
+        [[nodiscard]] uint32_t size() const
+        {
+            return static_cast<uint32_t>(x.size());
+        }
+
+        void clear()
+        {
+            resize(0);
+        }
+
+        void reserve(size_t count)
+        {
+            x.reserve(count);
+            y.reserve(count);
+            z.reserve(count);
+            radius.reserve(count);
+        }
+
+        void resize(size_t count)
+        {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+            radius.resize(count);
+        }
+
+        void set(size_t ix, const DirectX::BoundingSphere & sphere)
+        {
+            x[ix] = sphere.Center.x;
+            y[ix] = sphere.Center.y;
+            z[ix] = sphere.Center.z;
+            radius[ix] = sphere.Radius;
+        }
+
+        void push_back(const DirectX::BoundingSphere & sphere)
+        {
+            x.push_back(sphere.Center.x);
+            y.push_back(sphere.Center.y);
+            z.push_back(sphere.Center.z);
+            radius.push_back(sphere.Radius);
+        }
+
+        void copy(size_t dst, size_t src)
+        {
+            x[dst] = x[src];
+            y[dst] = y[src];
+            z[dst] = z[src];
+            radius[dst] = radius[src];
+        }
+    };
+
+    // Planes facing out of the volume, a sphere is outside when dot(centre, plane) > radius
+    struct CullPlanes
+    {
+        DirectX::XMFLOAT4 planes[6];
+        uint32_t count;
+    };
+
+    enum class CullIsa
+    {
+        Scalar,
+        SSE,
+        AVX2
+    };
+
+    CullPlanes makeCullPlanes(const DirectX::BoundingFrustum & frustum);
+    CullPlanes makeCullPlanes(const DirectX::BoundingOrientedBox & box);
+
+    // The widest kernel the CPU supports, picked on first use
+    CullIsa cullIsa();
+
+    // Appends the index of each sphere in [begin, end) that is not outside any plane
+    void cullSpheres(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        uint32_t begin,
+        uint32_t end,
+        std::vector<uint32_t> & visible);
+
+    // As above with the given kernel rather than the widest, which the CPU must support. All
+    // kernels produce the same list.
+    void cullSpheres(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        uint32_t begin,
+        uint32_t end,
+        std::vector<uint32_t> & visible,
+        CullIsa isa);
+
+    void cullSpheres(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        std::vector<uint32_t> & visible);
+}
@@ -0,0 +1,291 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace DirectX;
+
+namespace RxEngine
+{
+    OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+    {
+        resize(width, height);
+    }
+
+    void OcclusionBuffer::resize(uint32_t width, uint32_t height)
+    {
+        tilesX_ = std::max((width + tile_width - 1) / tile_width, 1u);
+        tilesY_ = std::max((height + tile_height - 1) / tile_height, 1u);
+        width_ = tilesX_ * tile_width;
+        height_ = tilesY_ * tile_height;
+
+        depth_.resize(static_cast<size_t>(width_) * height_);
+        tileMax_.resize(static_cast<size_t>(tilesX_) * tilesY_);
+        clear();
+    }
+
+    void OcclusionBuffer::clear()
+    {
+        std::fill(depth_.begin(), depth_.end(), 1.0f);
+        std::fill(tileMax_.begin(), tileMax_.end(), 1.0f);
+        triangles_.clear();
+    }
+
+    void OcclusionBuffer::addOccluder(
+        const XMFLOAT3 * vertices,
+        const uint32_t * indices,
+        uint32_t indexCount,
+        const XMMATRIX & worldViewProjection)
+    {
+        const float w = static_cast<float>(width_);
+        const float h = static_cast<float>(height_);
+
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            Triangle t{};
+            bool clipped = false;
+
+            for (uint32_t k = 0; k < 3; k++) {
+                const auto clip = XMVector4Transform(
+                    XMVectorSetW(XMLoadFloat3(&vertices[indices[i + k]]), 1.0f),
+                    worldViewProjection
+                );
+                const float cw = XMVectorGetW(clip);
+                // Dropping a triangle only ever loses occlusion
+                if (cw <= 0.0f || XMVectorGetZ(clip) < 0.0f) {
+                    clipped = true;
+                    break;
+                }
+                t.x[k] = (XMVectorGetX(clip) / cw * 0.5f + 0.5f) * w;
+                t.y[k] = (0.5f - XMVectorGetY(clip) / cw * 0.5f) * h;
+                t.z[k] = XMVectorGetZ(clip) / cw;
+            }
+
+            if (clipped) {
+                continue;
+            }
+            if (std::max({t.x[0], t.x[1], t.x[2]}) < 0.0f || std::min({t.x[0], t.x[1], t.x[2]}) > w ||
+                std::max({t.y[0], t.y[1], t.y[2]}) < 0.0f || std::min({t.y[0], t.y[1], t.y[2]}) > h) {
+                continue;
+            }
+            triangles_.push_back(t);
+        }
+    }
+
+    void OcclusionBuffer::rasterize()
+    {
+        rasterize(0, height_);
+    }
+
+    void OcclusionBuffer::rasterize(uint32_t rowBegin, uint32_t rowEnd)
+    {
+        assert(rowBegin % tile_height == 0);
+        assert(rowEnd % tile_height == 0 && rowEnd <= height_);
+
+        for (auto & t: triangles_) {
+            rasterizeTriangle(t, rowBegin, rowEnd);
+        }
+
+        for (uint32_t ty = rowBegin / tile_height; ty < rowEnd / tile_height; ty++) {
+            for (uint32_t tx = 0; tx < tilesX_; tx++) {
+                float farthest = 0.0f;
+                for (uint32_t y = ty * tile_height; y < (ty + 1) * tile_height; y++) {
+                    const float * row = &depth_[y * width_ + tx * tile_width];
+                    farthest = std::max(farthest, *std::max_element(row, row + tile_width));
+                }
+                tileMax_[ty * tilesX_ + tx] = farthest;
+            }
+        }
+    }
+
+    void OcclusionBuffer::rasterizeTriangle(const Triangle & t, uint32_t rowBegin, uint32_t rowEnd)
+    {
+        float x[3] = {t.x[0], t.x[1], t.x[2]};
+        float y[3] = {t.y[0], t.y[1], t.y[2]};
+        float z[3] = {t.z[0], t.z[1], t.z[2]};
+
+        // Wound so the edge functions are positive inside, either facing is drawn
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (std::abs(area) < 1e-6f) {
+            return;
+        }
+        if (area < 0.0f) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        // Pixels whose centres lie within the triangle's bounds
+        const int32_t min_x = std::max(
+            static_cast<int32_t>(std::ceil(std::min({x[0], x[1], x[2]}) - 0.5f)), 0
+        );
+        const int32_t max_x = std::min(
+            static_cast<int32_t>(std::floor(std::max({x[0], x[1], x[2]}) - 0.5f)) + 1,
+            static_cast<int32_t>(width_)
+        );
+        const int32_t min_y = std::max(
+            static_cast<int32_t>(std::ceil(std::min({y[0], y[1], y[2]}) - 0.5f)), static_cast<int32_t>(rowBegin)
+        );
+        const int32_t max_y = std::min(
+            static_cast<int32_t>(std::floor(std::max({y[0], y[1], y[2]}) - 0.5f)) + 1,
+            static_cast<int32_t>(rowEnd)
+        );
+        if (min_x >= max_x || min_y >= max_y) {
+            return;
+        }
+
+        // Edge functions e = a * x + b * y + c, evaluated at pixel centres
+        float ea[3], eb[3], ec[3];
+        for (uint32_t k = 0; k < 3; k++) {
+            const uint32_t n = (k + 1) % 3;
+            ea[k] = y[k] - y[n];
+            eb[k] = x[n] - x[k];
+            ec[k] = -(ea[k] * x[k] + eb[k] * y[k]);
+        }
+
+        // Depth plane, taken at the farthest point of each pixel and never past the triangle
+        const float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        const float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+        const float zc = z[0] - dzdx * x[0] - dzdy * y[0] + 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+        const auto z_limit = XMVectorReplicate(std::max({z[0], z[1], z[2]}));
+
+        const auto lane = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+        const auto zero = XMVectorZero();
+
+        XMVECTOR step_a[3];
+        for (uint32_t k = 0; k < 3; k++) {
+            step_a[k] = XMVectorReplicate(ea[k] * 4.0f);
+        }
+        const auto step_z = XMVectorReplicate(dzdx * 4.0f);
+
+        // Four pixels at a time, rows start on a multiple of four so the stores stay in the row
+        const int32_t start_x = min_x & ~3;
+
+        for (int32_t py = min_y; py < max_y; py++) {
+            const float cy = static_cast<float>(py) + 0.5f;
+            const auto xs = XMVectorAdd(XMVectorReplicate(static_cast<float>(start_x)), lane);
+
+            XMVECTOR e[3];
+            for (uint32_t k = 0; k < 3; k++) {
+                e[k] = XMVectorMultiplyAdd(
+                    XMVectorReplicate(ea[k]), xs, XMVectorReplicate(eb[k] * cy + ec[k])
+                );
+            }
+            auto pz = XMVectorMultiplyAdd(XMVectorReplicate(dzdx), xs, XMVectorReplicate(dzdy * cy + zc));
+
+            float * row = &depth_[static_cast<size_t>(py) * width_];
+
+            for (int32_t px = start_x; px < max_x; px += 4) {
+                auto inside = XMVectorAndInt(
+                    XMVectorAndInt(XMVectorGreaterOrEqual(e[0], zero), XMVectorGreaterOrEqual(e[1], zero)),
+                    XMVectorGreaterOrEqual(e[2], zero)
+                );
+
+                auto * dst = reinterpret_cast<XMFLOAT4 *>(row + px);
+                const auto current = XMLoadFloat4(dst);
+                const auto drawn = XMVectorMin(current, XMVectorMin(pz, z_limit));
+                XMStoreFloat4(dst, XMVectorSelect(current, drawn, inside));
+
+                for (uint32_t k = 0; k < 3; k++) {
+                    e[k] = XMVectorAdd(e[k], step_a[k]);
+                }
+                pz = XMVectorAdd(pz, step_z);
+            }
+        }
+    }
+
+    bool OcclusionBuffer::boxOccluded(const BoundingBox & box, const XMMATRIX & viewProjection) const
+    {
+        XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+        box.GetCorners(corners);
+
+        const float w = static_cast<float>(width_);
+        const float h = static_cast<float>(height_);
+
+        // Unclamped, so a box wholly off one side of the screen is found below
+        float min_x = std::numeric_limits<float>::max();
+        float max_x = -std::numeric_limits<float>::max();
+        float min_y = std::numeric_limits<float>::max();
+        float max_y = -std::numeric_limits<float>::max();
+        float nearest = 1.0f;
+
+        for (auto & corner: corners) {
+            const auto clip = XMVector4Transform(
+                XMVectorSetW(XMLoadFloat3(&corner), 1.0f), viewProjection
+            );
+            const float cw = XMVectorGetW(clip);
+            // Reaching past the near plane, it can't be bounded on screen
+            if (cw <= 0.0f || XMVectorGetZ(clip) < 0.0f) {
+                return false;
+            }
+            const float sx = (XMVectorGetX(clip) / cw * 0.5f + 0.5f) * w;
+            const float sy = (0.5f - XMVectorGetY(clip) / cw * 0.5f) * h;
+
+            min_x = std::min(min_x, sx);
+            max_x = std::max(max_x, sx);
+            min_y = std::min(min_y, sy);
+            max_y = std::max(max_y, sy);
+            nearest = std::min(nearest, XMVectorGetZ(clip) / cw);
+        }
+
+        if (max_x < 0.0f || min_x > w || max_y < 0.0f || min_y > h) {
+            return false;
+        }
+
+        // Every pixel the rectangle touches
+        const auto x0 = static_cast<uint32_t>(std::max(std::floor(min_x), 0.0f));
+        const auto x1 = static_cast<uint32_t>(std::min(std::floor(max_x), w - 1.0f));
+        const auto y0 = static_cast<uint32_t>(std::max(std::floor(min_y), 0.0f));
+        const auto y1 = static_cast<uint32_t>(std::min(std::floor(max_y), h - 1.0f));
+
+        for (uint32_t ty = y0 / tile_height; ty <= y1 / tile_height; ty++) {
+            for (uint32_t tx = x0 / tile_width; tx <= x1 / tile_width; tx++) {
+                if (nearest > tileMax_[ty * tilesX_ + tx]) {
+                    continue;
+                }
+
+                const uint32_t py0 = std::max(y0, ty * tile_height);
+                const uint32_t py1 = std::min(y1, (ty + 1) * tile_height - 1);
+                const uint32_t px0 = std::max(x0, tx * tile_width);
+                const uint32_t px1 = std::min(x1, (tx + 1) * tile_width - 1);
+
+                for (uint32_t py = py0; py <= py1; py++) {
+                    for (uint32_t px = px0; px <= px1; px++) {
+                        if (nearest <= depth_[py * width_ + px]) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+}
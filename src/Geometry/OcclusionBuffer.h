@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "DirectXMath.h"
+#include "DirectXCollision.h"
+
+namespace RxEngine
+{
+    // Low resolution depth buffer that large occluders are drawn into on the CPU, to cull what
+    // they hide before any draw commands are built. Holds no engine or GPU state so it can be
+    // driven on its own.
+    //
+    // A pixel is written when its centre is inside a triangle, with the farthest depth the
+    // triangle has across the pixel. Occluder hulls are expected to sit inside the meshes they
+    // stand in for, which covers the half pixel a triangle's edge can be overstated by.
+    class OcclusionBuffer
+    {
+    public:
+        static constexpr uint32_t tile_width = 8;
+        static constexpr uint32_t tile_height = 8;
+
+        OcclusionBuffer() = default;
+        OcclusionBuffer(uint32_t width, uint32_t height);
+
+        // Both sizes are rounded up to whole tiles. Clears the buffer.
+        void resize(uint32_t width, uint32_t height);
+
+        // Sets every pixel to the far plane and drops any queued triangles
+        void clear();
+
+        // Queues the triangles of a hull to be drawn. worldViewProjection takes the vertices to
+        // clip space with depth 0 at the near plane, triangles reaching past it are dropped.
+        void addOccluder(
+            const DirectX::XMFLOAT3 * vertices,
+            const uint32_t * indices,
+            uint32_t indexCount,
+            const DirectX::XMMATRIX & worldViewProjection);
+
+        // Draws the queued triangles into rows [rowBegin, rowEnd) and updates the tiles in them.
+        // Bands of whole tile rows can be drawn by separate jobs at the same time.
+        void rasterize(uint32_t rowBegin, uint32_t rowEnd);
+        void rasterize();
+
+        // True when the box, in world space, is entirely behind the occluders drawn
+        [[nodiscard]] bool boxOccluded(
+            const DirectX::BoundingBox & box,
+            const DirectX::XMMATRIX & viewProjection) const;
+
+        [[nodiscard]] uint32_t width() const
+        {
+            return width_;
+        }
+
+        [[nodiscard]] uint32_t height() const
+        {
+            return height_;
+        }
+
+        [[nodiscard]] uint32_t triangleCount() const
+        {
+            return static_cast<uint32_t>(triangles_.size());
+        }
+
+        [[nodiscard]] float depth(uint32_t x, uint32_t y) const
+        {
+            return depth_[y * width_ + x];
+        }
+
+    private:
+        // Screen space, x and y in pixels from the top left and z the clip space depth
+        struct Triangle
+        {
+            float x[3];
+            float y[3];
+            float z[3];
+        };
+
+        void rasterizeTriangle(const Triangle & t, uint32_t rowBegin, uint32_t rowEnd);
+
+        uint32_t width_{};
+        uint32_t height_{};
+        uint32_t tilesX_{};
+        uint32_t tilesY_{};
+        std::vector<float> depth_;
+        // Farthest depth in each tile
+        std::vector<float> tileMax_;
+        std::vector<Triangle> triangles_;
+    };
+}
@@ -23,6 +23,7 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <cmath>
 #include <Modules/RTSCamera/RTSCamera.h>
 #include <Modules/SceneCamera/SceneCamera.h>
 #include <Modules/Scene/SceneModule.h>
@@ -30,18 +31,33 @@
 #include "EngineMain.hpp"
 
 #include "Modules/Render.h"
+#include "Modules/Lighting/Lighting.h"
 #include "Vulkan/ThreadResources.h"
 
 namespace RxEngine
 {
     void DynamicMeshModule::startup()
     {
+        positionStream_ = engine_->getBoolConfigValue("render", "positionStream", true);
+        textureFeedback_ = engine_->getBoolConfigValue("render", "textureStreaming", false);
+
         instanceBuffers.count = 5;
         instanceBuffers.sizes.resize(5);
         instanceBuffers.buffers.resize(5);
+        instanceBuffers.indirectSizes.resize(5);
+        instanceBuffers.indirectBuffers.resize(5);
+
+        shadowInstanceBuffers_.resize(NUM_CASCADES);
+        for (auto & sib: shadowInstanceBuffers_) {
+            sib.count = 5;
+            sib.sizes.resize(5);
+            sib.buffers.resize(5);
+            sib.indirectSizes.resize(5);
+            sib.indirectBuffers.resize(5);
+        }
 
         worldObjects_ = world_->createQuery<SceneNode, WorldTransform, DynamicMesh,
-                                  WorldBoundingSphere>()
+                                  WorldBoundingSphere, InstanceSlot>()
                               .withJob()
                               .withInheritance(true).id;
 
@@ -52,6 +68,7 @@ namespace RxEngine
               .withRead<DescriptorSet>()
               .withRead<PipelineLayout>()
               .withRead<DynamicMesh>()
+              .withWrite<TextureFeedback>()
               .withJob()
               .execute(
                   [this](ecs::World *) {
@@ -60,6 +77,22 @@ namespace RxEngine
                   }
               );
 
+        world_->createSystem("DynamicMesh:ShadowRender")
+              .inGroup("Pipeline:Render")
+              .withStreamWrite<Render::ShadowRenderCommand>()
+              .withRead<CurrentMainDescriptorSet>()
+              .withRead<DescriptorSet>()
+              .withRead<PipelineLayout>()
+              .withRead<DynamicMesh>()
+              .withRead<ShadowCascadeData>()
+              .withJob()
+              .execute(
+                  [this](ecs::World *) {
+                      OPTICK_EVENT("DynamicMesh:ShadowRender")
+                      createShadowRenderCommands();
+                  }
+              );
+
         world_->createSystem("DynamicMesh:Cleanup")
               .inGroup("Pipeline:PostFrame")
               .withInterval(2.0f)
@@ -78,9 +111,15 @@ namespace RxEngine
     }
 
     void DynamicMeshModule::shutdown()
-    {}
+    {
+        world_->lookup("DynamicMesh:ShadowRender").destroy();
+
+        shadowInstanceBuffers_.clear();
+    }
 
-    ecs::entity_t createDynamicMeshBundle(RxCore::Device * device, ecs::World * world)
+    ecs::entity_t createDynamicMeshBundle(RxCore::Device * device,
+                                          ecs::World * world,
+                                          bool positionStream)
     {
         auto mbe = world->newEntity();
 
@@ -88,21 +127,15 @@ namespace RxEngine
             mb->vertexCount = 0;
             mb->indexCount = 0;
             mb->vertexSize = sizeof(DynamicMeshVertex);
-            mb->maxVertexCount = (32 * 1024 * 1024 / mb->vertexSize);
-            mb->maxIndexCount = mb->maxVertexCount * 3 / 2;
+            mb->positionStream = positionStream;
+            mb->vertexLimit = (32 * 1024 * 1024 / mb->vertexSize);
+            mb->indexLimit = mb->vertexLimit * 3 / 2;
 
-            mb->vertexBuffer = device->createBuffer(
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                VMA_MEMORY_USAGE_GPU_ONLY, mb->maxVertexCount * mb->vertexSize
-                );
-
-            mb->indexBuffer = device->createIndexBuffer(
-                VMA_MEMORY_USAGE_GPU_ONLY, static_cast<uint32_t>(mb->maxVertexCount * sizeof(uint32_t)),
-                false
-                );
-
-            mb->address = mb->vertexBuffer->getDeviceAddress();
+            createBundleBuffers(
+                device, mb, bundleCapacityFor(0, mb->vertexLimit), bundleCapacityFor(0, mb->indexLimit)
+            );
+            mb->vertexRanges.reset(mb->maxVertexCount);
+            mb->indexRanges.reset(mb->maxIndexCount);
         });
 
         world->getSingletonUpdate<DynamicMeshActiveBundle>()->currentBundle = mbe.id;
@@ -110,7 +143,9 @@ namespace RxEngine
         return mbe.id;
     }
 
-    ecs::entity_t getActiveDynamicMeshBundle(RxCore::Device * device, ecs::World * world)
+    ecs::entity_t getActiveDynamicMeshBundle(RxCore::Device * device,
+                                             ecs::World * world,
+                                             bool positionStream)
     {
         auto bundle = world->getSingleton<DynamicMeshActiveBundle>();
 
@@ -123,31 +158,26 @@ namespace RxEngine
             return bundle->currentBundle;
         }
 
-        return createDynamicMeshBundle(device, world);
+        return createDynamicMeshBundle(device, world, positionStream);
     }
 
-    void copyToBuffers(RxCore::Device * device,
-                       const std::vector<DynamicMeshVertex> & meshVertices,
-                       const std::vector<uint32_t> & meshIndices,
-                       MeshBundle * smb)
+    uint64_t copyToBuffers(UploadService * uploads,
+                           const std::vector<DynamicMeshVertex> & meshVertices,
+                           const std::vector<uint32_t> & meshIndices,
+                           const MeshBundle * smb,
+                           const MeshBundleEntry & range)
     {
         size_t v_size = meshVertices.size() * sizeof(DynamicMeshVertex);
         size_t i_size = meshIndices.size() * sizeof(uint32_t);
 
-        auto cb = device->transferCommandPool_->createTransferCommandBuffer();
-        cb->begin();
-
-        const auto b1 = device->createStagingBuffer(v_size, meshVertices.data());
-        const auto b2 = device->createStagingBuffer(i_size, meshIndices.data());
-
-        cb->copyBuffer(b1, smb->vertexBuffer, 0, smb->vertexCount * smb->vertexSize, v_size);
-        cb->copyBuffer(b2, smb->indexBuffer, 0, smb->indexCount * sizeof(uint32_t), i_size);
-
-        smb->vertexCount += static_cast<uint32_t>(meshVertices.size());
-        smb->indexCount += static_cast<uint32_t>(meshIndices.size());
-
-        cb->end();
-        cb->submitAndWait();
+        uploads->uploadBuffer(
+            smb->vertexBuffer->handle(), static_cast<VkDeviceSize>(range.vertexOffset) * smb->vertexSize,
+            meshVertices.data(), v_size
+        );
+        return uploads->uploadBuffer(
+            smb->indexBuffer->handle(), range.indexOffset * sizeof(uint32_t),
+            meshIndices.data(), i_size
+        );
     }
 
     ecs::EntityHandle DynamicMeshModule::createDynamicMeshObject(
@@ -158,28 +188,40 @@ namespace RxEngine
         const std::vector<DynamicSubMeshEntry> & submeshes
     )
     {
-        auto mb = getActiveDynamicMeshBundle(device, world);
-
-        {
-            auto smb = world->get<MeshBundle>(mb);
-
-            if (vertices.size() + smb->vertexCount > smb->maxVertexCount ||
-                indices.size() + smb->indexCount > smb->maxIndexCount) {
-                mb = createDynamicMeshBundle(device, world);
-                world->getSingletonUpdate<DynamicMeshActiveBundle>()->currentBundle = mb;
+        auto uploads = engine_->getUploadService();
+        ecs::EntityHandle dynamic_mesh_entity = world->newEntity();
+
+        MeshBundleEntry range{};
+        auto allocate = [&](ecs::entity_t bundle) {
+            bool allocated = false;
+            world->update<MeshBundle>(bundle, [&](MeshBundle * smb){
+                allocated = allocateBundleRanges(
+                    device, uploads, smb, dynamic_mesh_entity.id,
+                    static_cast<uint32_t>(vertices.size()),
+                    static_cast<uint32_t>(indices.size()), range
+                );
+            });
+            return allocated;
+        };
+
+        auto mb = getActiveDynamicMeshBundle(device, world, positionStream_);
+        if (!allocate(mb)) {
+            mb = createDynamicMeshBundle(device, world, positionStream_);
+            if (!allocate(mb)) {
+                spdlog::error("Dynamic mesh is too large for a mesh bundle");
+                dynamic_mesh_entity.destroy();
+                return {};
             }
         }
         if (!world->has<ecs::Component>(mb)) {
             world->setAsParent(mb);
         }
-        auto smb = world->get<MeshBundle>(mb);
 
-        ecs::EntityHandle dynamic_mesh_entity;
-        dynamic_mesh_entity = world->newEntity()
+        dynamic_mesh_entity
             .set<Mesh>(
                 {
-                    .vertexOffset = smb->vertexCount,
-                    .indexOffset = smb->indexCount,
+                    .vertexOffset = range.vertexOffset,
+                    .indexOffset = range.indexOffset,
                     .indexCount = static_cast<uint32_t>(indices.size())
                 }
                 )
@@ -187,16 +229,25 @@ namespace RxEngine
                 .addParent(mb)
                 .set<InBundle>({{mb}});
 
-        world->update<MeshBundle>(mb, [&](MeshBundle * smb){
-            copyToBuffers(device, vertices, indices, smb);
-            smb->entries.push_back(dynamic_mesh_entity);
-        });
+        const auto smb = world->get<MeshBundle>(mb);
+        if (smb->positionStream) {
+            std::vector<DirectX::XMFLOAT3> positions(vertices.size());
+            std::transform(
+                vertices.begin(), vertices.end(), positions.begin(),
+                [](const DynamicMeshVertex & v) {
+                    return v.point;
+                }
+            );
+            uploadBundlePositions(uploads, smb, range, positions);
+        }
+        const uint64_t upload_ticket = copyToBuffers(uploads, vertices, indices, smb, range);
 
 
         //auto smu = dynamic_mesh_entity.getUpdate<Mesh>();
         //std::vector<ecs::entity_t> mEntities;
 
         dynamic_mesh_entity.update<Mesh>([&](Mesh * smu){
+            smu->uploadTicket = upload_ticket;
             uint32_t ix = 0;
             for (auto & submesh: submeshes) {
                 //sm->subMeshes.push_back(
@@ -234,86 +285,105 @@ namespace RxEngine
         auto scene_camera = world_->getSingleton<SceneCamera>();
         auto frustum = world_->get<CameraFrustum>(scene_camera->camera);
 
-        DirectX::XMVECTOR planes[6];
-        frustum->frustum.GetPlanes(
-            &planes[0], &planes[1], &planes[2], &planes[3], &planes[4],
-            &planes[5]
-        );
+        const CullPlanes planes = makeCullPlanes(frustum->frustum);
 
-        std::vector<std::tuple<const RenderDetailCache *, ecs::entity_t, uint32_t>> instances;
-        std::atomic<size_t> ix = 0;
+        CullSpheres spheres;
+        std::vector<const Mesh *> meshes;
+        std::vector<uint32_t> entity_slots;
+        std::atomic<size_t> ex = 0;
         {
             OPTICK_EVENT("Collect instances")
             auto res = world_->getResults(worldObjects_);
             {
                 OPTICK_EVENT("Resize");
-                if (instances.size() < res.count() * 2) {
-                    instances.resize(res.count() * 2);
-                    mats.resize(res.count() * 2);
-                }
+                spheres.resize(res.count());
+                meshes.resize(res.count());
+                entity_slots.resize(res.count());
             }
 
-            res.each<WorldTransform, WorldBoundingSphere, Mesh>(
+            res.each<WorldBoundingSphere, Mesh, InstanceSlot>(
                 [&](ecs::EntityHandle e,
-                    const WorldTransform * wt,
                     const WorldBoundingSphere * lbs,
-                    const Mesh * mesh
+                    const Mesh * mesh,
+                    const InstanceSlot * is
                 ) {
-                    DirectX::BoundingSphere bs = lbs->boundSphere;
+                    size_t ix2 = ex++;
+                    spheres.set(ix2, lbs->boundSphere);
+                    meshes[ix2] = mesh;
+                    entity_slots[ix2] = is->slot;
+                }
+            );
+            spheres.resize(ex);
+        }
 
-                    auto tx = XMLoadFloat4x4(&wt->transform);
-//                    lbs->boundSphere.Transform(bs, tx);
+        std::vector<uint32_t> visible;
+        {
+            OPTICK_EVENT("Cull")
+            visible.reserve(spheres.size());
+            cullSpheres(spheres, planes, visible);
+        }
 
-                    for (auto & plane: planes) {
-                        DirectX::XMVECTOR c = DirectX::XMLoadFloat3(&bs.Center);
-                        c = DirectX::XMVectorSetW(c, 1.f);
+        const auto eye = DirectX::XMLoadFloat3(&frustum->frustum.Origin);
+        const float coverage_scale = std::abs(scene_camera->shaderData.projection._22);
+        TextureFeedback * feedback = nullptr;
+        if (textureFeedback_) {
+            feedback = world_->getSingletonUpdate<TextureFeedback>();
+        }
 
-                        DirectX::XMVECTOR Dist = DirectX::XMVector4Dot(c, plane);
-                        if (DirectX::XMVectorGetX(Dist) > bs.Radius) {
-                            return;
-                        }
+        std::vector<std::pair<const RenderDetailCache *, uint32_t>> instances;
+        std::vector<DrawSortItem> items;
+        {
+            OPTICK_EVENT("Expand Submeshes")
+            // Key ids only have to agree within a frame, starting afresh keeps them dense
+            sortKeys_.clear();
+            slots.clear();
+            instances.reserve(visible.size() * 2);
+            slots.reserve(visible.size() * 2);
+            items.reserve(visible.size() * 2);
+
+            for (auto ei: visible) {
+                float coverage = 0.0f;
+                if (feedback) {
+                    const float distance = DirectX::XMVectorGetX(
+                        DirectX::XMVector3Length(
+                            DirectX::XMVectorSubtract(
+                                DirectX::XMVectorSet(spheres.x[ei], spheres.y[ei], spheres.z[ei], 0.0f), eye
+                            )
+                        )
+                    );
+                    coverage = distance > spheres.radius[ei]
+                                   ? spheres.radius[ei] * coverage_scale / distance
+                                   : 1.0f;
+                }
+                for (auto & sm: meshes[ei]->subMeshes) {
+                    auto rdc = world_->get<RenderDetailCache>(sm);
+                    if (!rdc || !rdc->opaquePipeline) {
+                        break;
                     }
-                    for (auto & sm: mesh->subMeshes) {
-                        auto rdc = world_->get<RenderDetailCache>(sm);
-                        if (!rdc || !rdc->opaquePipeline) {
-                            return;
-                        }
+                    auto mm = world_->get<Material>(rdc->material);
+                    const auto ix2 = static_cast<uint32_t>(instances.size());
+
+                    if (feedback) {
+                        feedback->note(mm->sequence, coverage);
+                    }
+
+                    instances.emplace_back(rdc, mm->sequence);
+                    slots.push_back(entity_slots[ei]);
+                    items.push_back(
                         {
-                            size_t ix2 = ix++;
-                            //size_t ix = mats.size();
-                            mats[ix2] = wt->transform;
-
-                            instances[ix2] = {
-                                rdc, rdc->opaquePipeline,
-                                /*
-                  rdc->opaquePipeline, rdc->bundle, rdc->vertexOffset,
-                  rdc->indexOffset,
-                  rdc->indexCount, rdc->material,
-                                 */
-                                static_cast<uint32_t>(ix2)
-                            };
+                            sortKeys_.makeKey(
+                                rdc->opaquePipeline, rdc->bundle, rdc->vertexOffset,
+                                rdc->indexOffset, mm->sequence
+                            ),
+                            ix2
                         }
-                    }
+                    );
                 }
-            );
+            }
         }
         {
             OPTICK_EVENT("Sort Meshes")
-            std::sort(
-                instances.begin(),
-                instances.begin() + ix,
-                [](const auto & a, const auto & b) {
-                    auto &[ar, apipeline, am] = a;
-                    auto &[br, bpipeline, bm] = b;
-                    if (apipeline < bpipeline) {
-                        return true;
-                    }
-                    if (apipeline > bpipeline) {
-                        return false;
-                    }
-                    return (ar->bundle < br->bundle);
-                }
-            );
+            radixSortDrawItems(items, sortScratch_);
         }
         IndirectDrawSet ids;
         {
@@ -324,9 +394,9 @@ namespace RxEngine
             uint32_t headerIndex = 0;
             uint32_t commandIndex = 0;
 
-            for (size_t i = 0; i < ix; i++) {
-                auto & instance = instances[i];
-                auto &[rdc, rpipeline, m] = instance;
+            for (auto & item: items) {
+                auto &[rdc, material] = instances[item.index];
+                auto rpipeline = rdc->opaquePipeline;
 
                 if (prevPL != rpipeline || rdc->bundle != prevBundle) {
 
@@ -348,16 +418,14 @@ namespace RxEngine
                 commandIndex = static_cast<uint32_t>(ids.commands.size());
                 ids.commands.push_back(
                     {
-                        rdc->indexCount,
-                        rdc->vertexOffset,
-                        rdc->indexOffset, 0, static_cast<uint32_t>(ids.instances.size())
+                        rdc->indexCount, 0, rdc->indexOffset,
+                        static_cast<int32_t>(rdc->vertexOffset),
+                        static_cast<uint32_t>(ids.instances.size())
                     }
                 );
                 ids.headers[headerIndex].commandCount++;
 
-                auto mm = world_->get<Material>(rdc->material);
-
-                ids.instances.push_back({mats[m], mm->sequence, 0, 0, 0});
+                ids.instances.push_back({slots[item.index], material});
                 ids.commands[commandIndex].instanceCount++;
             }
         }
@@ -365,27 +433,142 @@ namespace RxEngine
             return;
         }
 
-        createInstanceBuffer(ids);
-        MeshModule::drawInstances(
-            instanceBuffers.buffers[instanceBuffers.ix], world_, pipeline,
-            layout, ids
-        );
+        const auto buffers = MeshModule::createInstanceBuffer(engine_, ids, instanceBuffers);
+        MeshModule::drawInstances(buffers, world_, pipeline, layout, ids);
     }
 
-    void DynamicMeshModule::createInstanceBuffer(IndirectDrawSet & ids)
+    void DynamicMeshModule::createShadowRenderCommands()
     {
-        instanceBuffers.ix = (instanceBuffers.ix + 1) % instanceBuffers.count;
-        if (instanceBuffers.sizes[instanceBuffers.ix] < ids.instances.size()) {
-            auto n = ids.instances.size() * 2;
-            auto b = engine_->createStorageBuffer(n * sizeof(IndirectDrawInstance));
-
-            instanceBuffers.buffers[instanceBuffers.ix] = b;
-            b->map();
-            instanceBuffers.sizes[instanceBuffers.ix] = static_cast<uint32_t>(n);
+        OPTICK_CATEGORY("Render Dynamic Shadows", ::Optick::Category::Rendering)
+
+        if (!shadowPipeline_.isAlive()) {
+            shadowPipeline_ = world_->lookup("pipeline/staticmesh_shadow");
+        }
+        auto pipeline = shadowPipeline_.get<GraphicsPipeline>();
+
+        if (!pipeline) {
+            return;
+        }
+        const auto layout = shadowPipeline_.getRelated<UsesLayout, PipelineLayout>();
+
+        auto scd = world_->getSingleton<ShadowCascadeData>();
+        if (!scd || scd->cascades.empty()) {
+            return;
         }
 
-        instanceBuffers.buffers[instanceBuffers.ix]->update(
-            ids.instances.data(),
-            ids.instances.size() * sizeof(IndirectDrawInstance));
+        CullSpheres casters;
+        std::vector<const Mesh *> meshes;
+        std::vector<uint32_t> slots;
+        std::atomic<size_t> ix = 0;
+        {
+            OPTICK_EVENT("Collect casters")
+            auto res = world_->getResults(worldObjects_);
+            casters.resize(res.count());
+            meshes.resize(res.count());
+            slots.resize(res.count());
+
+            res.each<WorldBoundingSphere, Mesh, InstanceSlot>(
+                [&](ecs::EntityHandle e,
+                    const WorldBoundingSphere * lbs,
+                    const Mesh * mesh,
+                    const InstanceSlot * is
+                ) {
+                    size_t ix2 = ix++;
+                    casters.set(ix2, lbs->boundSphere);
+                    meshes[ix2] = mesh;
+                    slots[ix2] = is->slot;
+                }
+            );
+        }
+
+        if (ix == 0) {
+            return;
+        }
+        casters.resize(ix);
+
+        const auto cascade_count = std::min(
+            static_cast<uint32_t>(scd->cascades.size()),
+            static_cast<uint32_t>(shadowInstanceBuffers_.size())
+        );
+
+        shadowSortKeys_.clear();
+
+        // Dynamic casters are few, so the cascades are recorded in turn
+        for (uint32_t cascade = 0; cascade < cascade_count; cascade++) {
+            std::vector<uint32_t> selected;
+            Renderer::cullEntitiesOrtho(scd->cascades[cascade].boBox, casters, selected);
+
+            std::vector<std::pair<const RenderDetailCache *, uint32_t>> instances;
+            std::vector<DrawSortItem> items;
+            for (auto ci: selected) {
+                for (auto & sm: meshes[ci]->subMeshes) {
+                    auto rdc = world_->get<RenderDetailCache>(sm);
+                    if (!rdc || !rdc->shadowPipeline) {
+                        continue;
+                    }
+                    items.push_back(
+                        {
+                            shadowSortKeys_.makeKey(
+                                rdc->shadowPipeline, rdc->bundle, rdc->vertexOffset, rdc->indexOffset, 0
+                            ),
+                            static_cast<uint32_t>(instances.size())
+                        }
+                    );
+                    instances.emplace_back(rdc, ci);
+                }
+            }
+            radixSortDrawItems(items, shadowSortScratch_);
+
+            IndirectDrawSet ids;
+            ecs::entity_t prevPL = 0;
+            ecs::entity_t prevBundle = 0;
+            uint32_t headerIndex = 0;
+
+            for (auto & item: items) {
+                auto &[rdc, ci] = instances[item.index];
+                if (prevPL != rdc->shadowPipeline || rdc->bundle != prevBundle) {
+                    headerIndex = static_cast<uint32_t>(ids.headers.size());
+                    ids.headers.push_back(
+                        IndirectDrawCommandHeader{
+                            rdc->shadowPipeline,
+                            rdc->bundle,
+                            static_cast<uint32_t>(ids.commands.size()),
+                            0
+                        }
+                    );
+
+                    prevPL = rdc->shadowPipeline;
+                    prevBundle = rdc->bundle;
+                }
+
+                ids.commands.push_back(
+                    {
+                        rdc->indexCount, 1, rdc->indexOffset,
+                        static_cast<int32_t>(rdc->vertexOffset),
+                        static_cast<uint32_t>(ids.instances.size())
+                    }
+                );
+                ids.headers[headerIndex].commandCount++;
+
+                auto mm = world_->get<Material>(rdc->material);
+                ids.instances.push_back({slots[ci], mm->sequence});
+            }
+
+            if (ids.instances.empty()) {
+                continue;
+            }
+
+            const auto buffers = MeshModule::createInstanceBuffer(
+                engine_, ids, shadowInstanceBuffers_[cascade]
+            );
+
+            auto command = MeshModule::drawShadowInstances(
+                buffers, world_, pipeline, layout, ids, cascade, SHADOW_MAP_SIZE
+            );
+            command.cached = false;
+
+            world_->getStream<Render::ShadowRenderCommand>()
+                  ->add<Render::ShadowRenderCommand>(command);
+        }
     }
 }
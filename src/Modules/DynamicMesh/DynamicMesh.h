@@ -26,6 +26,7 @@
 #pragma once
 #include <Modules/StaticMesh/StaticMesh.h>
 #include <Modules/Mesh/Mesh.h>
+#include <Modules/Mesh/DrawSort.h>
 #include "Modules/Module.h"
 #include "DirectXCollision.h"
 #include "Modules/Renderer/Renderer.hpp"
@@ -94,13 +95,22 @@ namespace RxEngine
         );
     protected:
         void createOpaqueRenderCommands();
-        void createInstanceBuffer(IndirectDrawSet & ids);
+        void createShadowRenderCommands();
 
     private:
         ecs::EntityHandle pipeline_{};
+        ecs::EntityHandle shadowPipeline_{};
         ecs::queryid_t worldObjects_{};
 
-        std::vector<DirectX::XMFLOAT4X4> mats{};
+        std::vector<uint32_t> slots{};
+        DrawSortKeys sortKeys_{};
+        std::vector<DrawSortItem> sortScratch_{};
+        DrawSortKeys shadowSortKeys_{};
+        std::vector<DrawSortItem> shadowSortScratch_{};
         InstanceBuffers instanceBuffers{};
+        std::vector<InstanceBuffers> shadowInstanceBuffers_{};
+        bool positionStream_{};
+        // Coverage per material is added to TextureFeedback for texture streaming
+        bool textureFeedback_{};
     };
 }
@@ -453,6 +453,41 @@ namespace RxEngine
         return std::pair(vb, ib);
     }
 
+    auto uploadBuffers(UploadRing * ring)
+    {
+        OPTICK_EVENT("Upload IMGui Buffers")
+
+        const auto dd = ImGui::GetDrawData();
+
+        auto vertices = ring->allocate(dd->TotalVtxCount * sizeof(ImDrawVert), 16);
+        if (!vertices) {
+            return std::pair(vertices, UploadAllocation{});
+        }
+        auto indices = ring->allocate(dd->TotalIdxCount * sizeof(ImDrawIdx), 16);
+        if (!indices) {
+            return std::pair(UploadAllocation{}, indices);
+        }
+
+        VkDeviceSize vbOffset = 0;
+        VkDeviceSize idxOffset = 0;
+
+        for (auto n = 0; n < dd->CmdListsCount; n++) {
+            auto cmdList = dd->CmdLists[n];
+
+            ring->write(
+                vertices, vbOffset, cmdList->VtxBuffer.Data,
+                cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
+            ring->write(
+                indices, idxOffset, cmdList->IdxBuffer.Data,
+                cmdList->IdxBuffer.Size * sizeof(ImDrawIdx));
+
+            vbOffset += cmdList->VtxBuffer.Size * sizeof(ImDrawVert);
+            idxOffset += cmdList->IdxBuffer.Size * sizeof(ImDrawIdx);
+        }
+
+        return std::pair(vertices, indices);
+    }
+
     void IMGuiRender::createRenderCommands()
     {
         OPTICK_CATEGORY("Render UI", ::Optick::Category::UI)
@@ -484,12 +519,13 @@ namespace RxEngine
             return;
         }
 
-        // Create Vertex/Index Buffers
-        auto [vb, ib] = createBuffers(engine_->getDevice());
+        // Vertex/Index data goes in the upload ring, only falling back to buffers of its own when
+        // the ring is full
+        auto [vertices, indices] = uploadBuffers(engine_->getUploadRing());
         uint32_t triangles = 0;
         uint32_t drawCalls = 0;
 
-        buf->begin(pipeline->renderPass, pipeline->subPass);
+        const bool inherited = Render::beginSecondary(world_, buf, pipeline->renderPass, pipeline->subPass);
         {
             buf->useLayout(layout->layout);
             OPTICK_GPU_CONTEXT(buf->Handle())
@@ -517,8 +553,16 @@ namespace RxEngine
                 VK_SHADER_STAGE_VERTEX_BIT, 0,
                 sizeof(pd), static_cast<void *>(&pd));
 
-            buf->bindVertexBuffer(vb);
-            buf->bindIndexBuffer(ib);
+            if (vertices && indices) {
+                vkCmdBindVertexBuffers(buf->Handle(), 0, 1, &vertices.buffer, &vertices.offset);
+                vkCmdBindIndexBuffer(
+                    buf->Handle(), indices.buffer, indices.offset,
+                    sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+            } else {
+                auto [vb, ib] = createBuffers(engine_->getDevice());
+                buf->bindVertexBuffer(vb);
+                buf->bindIndexBuffer(ib);
+            }
             buf->setViewport(0, 0, dd->DisplaySize.x, dd->DisplaySize.y, 0, 1);
 
             uint32_t vb_offset = 0;
@@ -553,7 +597,7 @@ namespace RxEngine
                 idx_offset += cmd_list->IdxBuffer.Size;
             }
         }
-        buf->end();
+        Render::endSecondary(buf, inherited);
 
         world_->getStream<Render::EngineUiRenderCommand>()
               ->add<Render::EngineUiRenderCommand>({buf, triangles, drawCalls});
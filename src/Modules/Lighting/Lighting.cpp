@@ -4,6 +4,7 @@
 #include "Modules/RTSCamera/RTSCamera.h"
 #include "Modules/SceneCamera/SceneCamera.h"
 #include "Vulkan/Buffer.hpp"
+#include <cstring>
 //#include "RxCore.h"
 
 constexpr int lighting_buffer_count = 5;
@@ -30,6 +31,10 @@ namespace RxEngine
         lighting->shaderData.diffAmount = 0.3f;
         lighting->shaderData.light_direction = {0.407f, -.707f, 0.8f};
 
+        cacheShadows_ = engine_->getBoolConfigValue("shadows", "cached", true);
+        firstSlicedCascade_ = engine_->getUint32ConfigValue("shadows", "firstSlicedCascade", 2);
+        slicedCascadeInterval_ = engine_->getUint32ConfigValue("shadows", "slicedCascadeInterval", 4);
+
 
         world_->createSystem("Lighting:NextFrame")
               .inGroup("Pipeline:PreRender")
@@ -79,6 +84,7 @@ namespace RxEngine
               .withRead<RTSCamera>()
               .withRead<CameraProjection>()
               .withWrite<ShadowCascadeData>()
+              .withWrite<Lighting>()
               .execute<>([this](ecs::World * w)
               {
                   createShadowCascadeData();
@@ -90,6 +96,7 @@ namespace RxEngine
         world_->deleteSystem(world_->lookup("Lighting:updateDescriptor"));
         world_->deleteSystem(world_->lookup("Lighting:setDescriptor"));
         world_->deleteSystem(world_->lookup("Lighting:NextFrame"));
+        world_->deleteSystem(world_->lookup("Lighting:CreateCascadeData"));
 
         world_->removeSingleton<Lighting>();
     }
@@ -173,10 +180,23 @@ namespace RxEngine
                 radius = XMVectorMax(d, radius);
             }
 
-            float extent = XMVectorGetX(radius);
+            // Round the extent and snap the centre to whole texels in light space, so the cascade
+            // only changes when the camera has moved at least a texel
+            float extent = std::ceil(XMVectorGetX(radius) * 16.0f) / 16.0f;
             auto lightDir = XMLoadFloat3(&lightDirection);
             lightDir = XMVector3Normalize(lightDir);
 
+            const float texel_size = extent * 2.0f / static_cast<float>(SHADOW_MAP_SIZE);
+            auto lightRotation = XMMatrixLookAtRH(XMVectorZero(), lightDir,
+                                                  XMVectorSet(0.707f, 0.707f, 0, 0));
+            auto lightSpaceCenter = XMVector3TransformCoord(frustumCenter, lightRotation);
+            lightSpaceCenter = XMVectorScale(
+                XMVectorFloor(XMVectorScale(lightSpaceCenter, 1.0f / texel_size)),
+                texel_size
+            );
+            frustumCenter = XMVector3TransformCoord(
+                lightSpaceCenter, XMMatrixInverse(nullptr, lightRotation));
+
             auto viewPos = frustumCenter;
             //auto lookAt = frustumCenter;
             viewPos = XMVectorSubtract(frustumCenter, XMVectorScale(lightDir, extent * 1.0f));
@@ -187,7 +207,8 @@ namespace RxEngine
                                       {extent, extent, extent * 2.0f},
                                       {0.f, 0.f, 0.f, 1.f});
             BoundingOrientedBox bobox2;
-            bobox.Transform(bobox2, lightView);
+            // The box is axis aligned in light space, so take it back into world space
+            bobox.Transform(bobox2, XMMatrixInverse(nullptr, lightView));
             XMStoreFloat3(&bobox2.Center, frustumCenter);
             auto lightProj = XMMatrixOrthographicRH(extent * 2.0f, extent * 2.0f, 0.f,
                                                     extent * 2.0f);
@@ -204,7 +225,7 @@ namespace RxEngine
 
     void LightingModule::createShadowCascadeData()
     {
-        const int numberCascades = 4;
+        const uint32_t numberCascades = NUM_CASCADES;
 
         auto sc = world_->getSingleton<SceneCamera>();
         auto camera = world_->get<RTSCamera>(sc->camera);
@@ -215,6 +236,56 @@ namespace RxEngine
 
         calculateCascades(numberCascades, camera, proj, scd, lightDirection);
 
+        scd.cached = cacheShadows_;
+        scd.refreshMask = 0;
+
+        if (!cacheShadows_) {
+            scd.refreshMask = (1u << numberCascades) - 1;
+        } else {
+            const bool light_changed =
+                cachedCascades_.size() != numberCascades ||
+                !XMVector3Equal(XMLoadFloat3(&lightDirection), XMLoadFloat3(&cachedLightDirection_));
+
+            cachedCascades_.resize(numberCascades);
+            cachedLightDirection_ = lightDirection;
+
+            for (uint32_t i = 0; i < numberCascades; i++) {
+                const bool moved = std::memcmp(
+                    &scd.cascades[i].viewProjMatrix,
+                    &cachedCascades_[i].viewProjMatrix,
+                    sizeof(XMFLOAT4X4)
+                ) != 0;
+
+                if (!light_changed && !moved) {
+                    continue;
+                }
+                // Far cascades take turns, until then they keep rendering with their previous
+                // matrices so the cached depth stays valid
+                const bool due = light_changed ||
+                                 i < firstSlicedCascade_ ||
+                                 slicedCascadeInterval_ <= 1 ||
+                                 (shadowFrame_ + i) % slicedCascadeInterval_ == 0;
+                if (due) {
+                    cachedCascades_[i] = scd.cascades[i];
+                    scd.refreshMask |= 1u << i;
+                }
+            }
+            scd.cascades = cachedCascades_;
+        }
+        shadowFrame_++;
+
         world_->setSingleton<ShadowCascadeData>(scd);
+
+        auto lighting = world_->getSingletonUpdate<Lighting>();
+
+        lighting->shaderData.light_direction = lightDirection;
+        lighting->shaderData.cascadeCount = numberCascades;
+        for (uint32_t i = 0; i < numberCascades; i++) {
+            lighting->shaderData.cascades[i].viewProjMatrix = scd.cascades[i].viewProjMatrix;
+            lighting->shaderData.cascades[i].splitDepth = scd.cascades[i].splitDepth;
+        }
+        lighting->lightingBuffer->update(&lighting->shaderData,
+                                         lighting->ix * lighting->bufferAlignment,
+                                         sizeof(LightingShaderData));
     }
 }
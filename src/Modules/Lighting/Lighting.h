@@ -32,6 +32,9 @@ namespace RxEngine
     {
         std::vector<ShadowCascade> cascades;
         std::vector<float> cascadeSplits;
+        // When cached, static casters are only drawn for cascades flagged in refreshMask
+        bool cached;
+        uint32_t refreshMask;
     };
 
     struct LightingShaderData
@@ -78,5 +81,13 @@ namespace RxEngine
                                DirectX::XMFLOAT3 lightDirection);
 
         void createShadowCascadeData();
+
+    private:
+        bool cacheShadows_{};
+        uint32_t firstSlicedCascade_{};
+        uint32_t slicedCascadeInterval_{};
+        uint64_t shadowFrame_{};
+        std::vector<ShadowCascade> cachedCascades_{};
+        DirectX::XMFLOAT3 cachedLightDirection_{};
     };
 }
@@ -25,6 +25,7 @@
 
 #include "Materials.h"
 
+#include <unordered_map>
 #include "AssetException.h"
 #include "EngineMain.hpp"
 #include "imgui.h"
@@ -36,6 +37,7 @@
 #include "RxECS.h"
 #include "Modules/Render.h"
 #include "fx/gltf.h"
+#include "TextureStreamer.h"
 
 namespace RxEngine
 {
@@ -83,6 +85,41 @@ namespace RxEngine
         }
     }
 
+    void textureStreamingUi(ecs::EntityHandle, const void * ptr)
+    {
+        auto stats = static_cast<const TextureStreamingStats *>(ptr);
+
+        if (stats) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("Resident");
+            ImGui::TableNextColumn();
+            ImGui::Text(
+                "%lld / %lld MB (wanted %lld MB)",
+                stats->residentBytes / (1024 * 1024),
+                stats->budget / (1024 * 1024),
+                stats->wantedBytes / (1024 * 1024)
+            );
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("Images");
+            ImGui::TableNextColumn();
+            ImGui::Text("%d full / %d, %d loading", stats->fullyResident, stats->images, stats->loading);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("Promotions");
+            ImGui::TableNextColumn();
+            ImGui::Text("%lld", stats->promotions);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("Evictions");
+            ImGui::TableNextColumn();
+            ImGui::Text("%lld", stats->evictions);
+        }
+    }
+
+    MaterialsModule::~MaterialsModule() = default;
+
     void MaterialsModule::startup()
     {
         world_->set<ComponentGui>(
@@ -128,6 +165,45 @@ namespace RxEngine
               );
 
         materialQuery = world_->createQuery<Material>().id;
+
+        if (textureStreamer_) {
+            world_->setSingleton<TextureFeedback>({});
+            world_->set<ComponentGui>(
+                world_->getComponentId<TextureStreamingStats>(),
+                ComponentGui{.editor = textureStreamingUi}
+            );
+            world_->setSingleton<TextureStreamingStats>(textureStreamer_->getStats());
+
+            // After the frame is submitted, so this frame's feedback is in
+            world_->createSystem("Material:StreamTextures")
+                  .inGroup("Pipeline:PostFrame")
+                  .withWrite<TextureFeedback>()
+                  .withRead<WindowDetails>()
+                  .withRead<Material>()
+                  .withWrite<MaterialImage>()
+                  .withWrite<TextureStreamingStats>()
+                  .execute(
+                      [this](ecs::World *)
+                      {
+                          streamTextures();
+                      }
+                  );
+
+            // Once the frame's set is picked, never during PostFrame when the set just submitted
+            // is still current and in flight
+            world_->createSystem("Material:RefreshTextures")
+                  .inGroup("Pipeline:PreRender")
+                  .withRead<Material>()
+                  .withRead<MaterialImage>()
+                  .withRead<CurrentMainDescriptorSet>()
+                  .withRead<DescriptorSet>()
+                  .execute(
+                      [this](ecs::World *)
+                      {
+                          refreshTextureDescriptors();
+                      }
+                  );
+        }
     }
 
     void MaterialsModule::shutdown()
@@ -135,6 +211,14 @@ namespace RxEngine
         world_->remove<ComponentGui>(world_->getComponentId<Material>());
         world_->lookup("Material:Pipelines").destroy();
         world_->lookup("Material:setDescriptor").destroy();
+
+        if (textureStreamer_) {
+            world_->remove<ComponentGui>(world_->getComponentId<TextureStreamingStats>());
+            world_->lookup("Material:StreamTextures").destroy();
+            world_->lookup("Material:RefreshTextures").destroy();
+            setTextureUpdates_.clear();
+            textureStreamer_.reset();
+        }
     }
 
     VkShaderStageFlags getStageFlags(const std::string & stage)
@@ -146,9 +230,11 @@ namespace RxEngine
             return VK_SHADER_STAGE_VERTEX_BIT;
         } else if (stage == "frag") {
             return VK_SHADER_STAGE_FRAGMENT_BIT;
+        } else if (stage == "comp") {
+            return VK_SHADER_STAGE_COMPUTE_BIT;
         } else {
             throw std::runtime_error(
-                R"(Invalid value for stage - valid values: "both", "frag", "vert")"
+                R"(Invalid value for stage - valid values: "both", "frag", "vert", "comp")"
             );
         }
 
@@ -177,6 +263,12 @@ namespace RxEngine
                         .shader = sh, .shaderAssetName = spv
                     }
                 );
+            } else if (stage == "comp") {
+                world->newEntityReplace(name.c_str()).set<ComputeShader>(
+                    {
+                        .shader = sh, .shaderAssetName = spv
+                    }
+                );
             } else {
                 world->newEntityReplace(name.c_str()).set<FragmentShader>(
                     {
@@ -571,6 +663,83 @@ namespace RxEngine
 
             loadPipeline(world, device, pipelineName, details);
         }
+
+        // Variants can be declared in any order, so they are linked once all are loaded
+        for (auto & [key, value]: pipelines) {
+            auto pipelineName = key.as<std::string>();
+
+            sol::table details = value;
+            sol::optional<std::string> compactVariant = details["compactVariant"];
+            if (!compactVariant.has_value()) {
+                continue;
+            }
+
+            auto ve = world->lookup(compactVariant.value().c_str());
+            if (!ve.isAlive() || !ve.has<MaterialPipelineDetails>()) {
+                spdlog::critical("Missing compact variant for pipeline {}", pipelineName.c_str());
+                throw RxAssets::AssetException("missing pipeline:", compactVariant.value());
+            }
+            world->lookup(pipelineName.c_str()).set<HasCompactVariant>({{ve.id}});
+        }
+    }
+
+    void loadComputePipeline(ecs::World * world,
+                             RxCore::Device * device,
+                             PipelineCache * pipelineCache,
+                             const std::string & name,
+                             sol::table & pipeline)
+    {
+        const std::string cs_name = pipeline["computeShader"];
+        const std::string layout_name = pipeline["layout"];
+
+        spdlog::debug("Loading compute pipeline {0} to world", name);
+
+        auto cse = world->lookup(cs_name.c_str());
+        if (!cse.isAlive() || !cse.has<ComputeShader>()) {
+            spdlog::critical("Missing shader for compute pipeline {}", name.c_str());
+            throw RxAssets::AssetException("missing shader:", cs_name);
+        }
+
+        auto lay = world->lookup(layout_name.c_str());
+        if (!lay.isAlive() || !lay.has<PipelineLayout>()) {
+            spdlog::critical("Missing layout for compute pipeline {}", name.c_str());
+            throw RxAssets::AssetException("missing layout:", layout_name);
+        }
+
+        VkComputePipelineCreateInfo cpci{};
+        cpci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        cpci.stage.module = cse.get<ComputeShader>()->shader->Handle();
+        cpci.stage.pName = "main";
+        cpci.layout = lay.get<PipelineLayout>()->layout;
+
+        VkPipeline pl;
+        auto rv = pipelineCache->createComputePipeline(cpci, pl);
+        assert(rv == VK_SUCCESS);
+        if (rv != VK_SUCCESS) {
+            spdlog::critical("Unable to create compute pipeline");
+            throw RxAssets::AssetException("failed to create compute pipeline:", name);
+        }
+
+        world->newEntityReplace(name.c_str())
+             .set<ComputePipeline>({std::make_shared<RxCore::Pipeline>(device, pl)})
+             .set<UsesComputeShader>({{cse.id}})
+             .set<UsesLayout>({{lay.id}});
+    }
+
+    void loadComputePipelines(ecs::World * world,
+                              RxCore::Device * device,
+                              PipelineCache * pipelineCache,
+                              sol::table & pipelines)
+    {
+        for (auto & [key, value]: pipelines) {
+            auto pipelineName = key.as<std::string>();
+
+            sol::table details = value;
+
+            loadComputePipeline(world, device, pipelineCache, pipelineName, details);
+        }
     }
 
     void getSamplerDetails(RxAssets::SamplerData & sd, sol::table & sampler)
@@ -704,7 +873,8 @@ namespace RxEngine
 
     ecs::EntityHandle loadOrGetImage(const std::string & name,
                                      ecs::World * world,
-                                     RxCore::Device * device)
+                                     RxCore::Device * device,
+                                     TextureStreamer * streamer)
     {
         auto e = world->lookup(name.c_str());
 
@@ -715,6 +885,11 @@ namespace RxEngine
         RxAssets::ImageData id{};
         RxAssets::Loader::loadImage(id, name);
 
+        if (streamer) {
+            auto ie = world->newEntityReplace(name.c_str());
+            return ie.set<MaterialImage>(streamer->addImage(ie.id, name, id));
+        }
+
         auto image = device->createImage(
             id.imType == RxAssets::eBC7
                 ? VK_FORMAT_BC7_UNORM_BLOCK
@@ -752,12 +927,13 @@ namespace RxEngine
 
     void loadTexture(ecs::World * world,
                      RxCore::Device * device,
+                     TextureStreamer * streamer,
                      std::string textureName,
                      sol::table details)
     {
         const std::string file_name = details["image"];
 
-        const auto image_entity = loadOrGetImage(file_name, world, device);
+        const auto image_entity = loadOrGetImage(file_name, world, device, streamer);
 
         RxAssets::SamplerData sd{};
 
@@ -771,13 +947,16 @@ namespace RxEngine
              .set<Render::MaterialSampler>({sampler_handle, 9999});
     }
 
-    void loadTextures(ecs::World * world, RxCore::Device * device, sol::table & textures)
+    void loadTextures(ecs::World * world,
+                      RxCore::Device * device,
+                      TextureStreamer * streamer,
+                      sol::table & textures)
     {
         for (auto & [key, value]: textures) {
             const std::string texture_name = key.as<std::string>();
             sol::table details = value;
 
-            loadTexture(world, device, texture_name, details);
+            loadTexture(world, device, streamer, texture_name, details);
         }
     }
 
@@ -842,18 +1021,15 @@ namespace RxEngine
                 throw RxAssets::AssetException("Not a valid shadowPipeline:", name);
             }
             e.set<HasShadowPipeline>({{eop.id}});
-        }
-#if 0
-        else if (mi.alpha == MaterialAlphaMode::Opaque) {
+        } else if (mi.alpha == MaterialAlphaMode::Opaque) {
             auto eop = world->lookup("pipeline/staticmesh_shadow");
 
             auto mpd = eop.get<MaterialPipelineDetails>();
             if (!mpd || mpd->stage != RxAssets::PipelineRenderStage::Shadow) {
-                throw RxAssets::AssetException("Not a valid opaquePipeline:", name);
+                throw RxAssets::AssetException("Not a valid shadowPipeline:", name);
             }
-            e.set<HasShadpwPipeline>({ {eop.id} });
+            e.set<HasShadowPipeline>({{eop.id}});
         }
-#endif
         if (transparentPipeline.has_value()) {
             auto eop = world->lookup(transparentPipeline.value().c_str());
 
@@ -919,10 +1095,22 @@ namespace RxEngine
         sol::optional<sol::table> layouts = data["pipeline_layout"];
         sol::optional<sol::table> textures = data["texture"];
         sol::optional<sol::table> pipelines = data["material_pipeline"];
+        sol::optional<sol::table> computePipelines = data["compute_pipeline"];
         sol::optional<sol::table> materials = data["material"];
 
         auto device = engine_->getDevice();
 
+        if (!textureStreamer_ && engine_->getBoolConfigValue("render", "textureStreaming", false)) {
+            textureStreamer_ = std::make_unique<TextureStreamer>(
+                device,
+                engine_->getUploadService(),
+                static_cast<VkDeviceSize>(engine_->getUint32ConfigValue("render", "textureBudgetMB", 256)) * 1024 *
+                1024,
+                engine_->getUint32ConfigValue("render", "textureTailSize", 64),
+                engine_->getUint32ConfigValue("render", "textureStreamingLoads", 4)
+            );
+        }
+
         if (shaders.has_value()) {
             loadShaderData(world_, device, shaders.value());
         }
@@ -932,8 +1120,11 @@ namespace RxEngine
         if (pipelines.has_value()) {
             loadPipelines(world_, device, pipelines.value());
         }
+        if (computePipelines.has_value()) {
+            loadComputePipelines(world_, device, engine_->getPipelineCache(), computePipelines.value());
+        }
         if (textures.has_value()) {
-            loadTextures(world_, device, textures.value());
+            loadTextures(world_, device, textureStreamer_.get(), textures.value());
         }
         if (materials.has_value()) {
             loadMaterials(world_, device, materials.value());
@@ -1125,11 +1316,9 @@ namespace RxEngine
         pdsci.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         pdsci.pDynamicStates = dynamicStates.data();
 
-        auto device = engine_->getDevice();
         std::vector<VkPipeline> pipelines(1);
 
-        auto rv = vkCreateGraphicsPipelines(device->getDevice(), nullptr, 1, &gpci, nullptr,
-                                            pipelines.data());
+        auto rv = engine_->getPipelineCache()->createGraphicsPipeline(gpci, pipelines[0]);
         //auto rv = device->getDevice().createGraphicsPipeline(nullptr, gpci);
         assert(rv == VK_SUCCESS);
         if(rv != VK_SUCCESS) {
@@ -1241,7 +1430,88 @@ namespace RxEngine
 
         ds->ds->updateDescriptor(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer);
         ds->ds->updateDescriptor(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, ts);
+        setTextureUpdates_[e.id] = textureUpdate_;
 
         e.addDeferred<MaterialDescriptor>();
     }
+
+    // Rewrites only the texture array. The set must not be in use by a frame in flight, so this is
+    // only done for the set of the frame about to be recorded. Entries are in material sequence
+    // order as createShaderMaterialData left them.
+    void MaterialsModule::updateTextureDescriptors(const DescriptorSet * ds)
+    {
+        std::vector<RxCore::CombinedSampler> ts;
+
+        world_->getResults(materialQuery).each<Material>(
+            [&](ecs::EntityHandle, Material * m)
+            {
+                auto te = m->materialTextures[0];
+
+                auto tx = world_->get<MaterialImage>(te, true);
+                auto sm = world_->get<Render::MaterialSampler>(te);
+
+                assert(m->sequence == ts.size());
+                ts.push_back({sm->sampler, tx->imageView});
+            }
+        );
+
+        if (!ts.empty()) {
+            ds->ds->updateDescriptor(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, ts);
+        }
+    }
+
+    void MaterialsModule::refreshTextureDescriptors()
+    {
+        auto cmds = world_->getSingleton<CurrentMainDescriptorSet>();
+        if (!cmds) {
+            return;
+        }
+        // A set that hasn't had its material data written yet picks the new images up then
+        auto it = setTextureUpdates_.find(cmds->descriptorSet);
+        if (it == setTextureUpdates_.end() || it->second == textureUpdate_) {
+            return;
+        }
+        updateTextureDescriptors(world_->get<DescriptorSet>(cmds->descriptorSet));
+        it->second = textureUpdate_;
+    }
+
+    void MaterialsModule::streamTextures()
+    {
+        OPTICK_EVENT()
+
+        // Each image is as wanted as the most covered material drawing with it
+        std::unordered_map<ecs::entity_t, float> coverage;
+        auto feedback = world_->getSingletonUpdate<TextureFeedback>();
+        if (feedback) {
+            world_->getResults(materialQuery).each<Material>(
+                [&](ecs::EntityHandle, Material * m)
+                {
+                    if (m->sequence >= feedback->coverage.size()) {
+                        return;
+                    }
+                    auto io = world_->get<ecs::InstanceOf>(m->materialTextures[0]);
+                    if (!io) {
+                        return;
+                    }
+                    auto & c = coverage[io->entity];
+                    c = std::max(c, feedback->coverage[m->sequence]);
+                }
+            );
+            feedback->coverage.clear();
+        }
+
+        auto wd = world_->getSingleton<WindowDetails>();
+        const auto swaps = textureStreamer_->update(coverage, wd ? wd->height : 1080);
+
+        for (auto & swap: swaps) {
+            world_->set<MaterialImage>(swap.entity, swap.image);
+        }
+
+        // The set just submitted may still be read, each set is rewritten when it next comes round
+        if (!swaps.empty()) {
+            textureUpdate_++;
+        }
+
+        world_->setSingleton<TextureStreamingStats>(textureStreamer_->getStats());
+    }
 }
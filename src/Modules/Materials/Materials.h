@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <unordered_map>
 #include "Modules/Module.h"
 #include "RXCore.h"
 #include "RXAssets.h"
@@ -56,6 +58,17 @@ namespace RxEngine
         std::string shaderAssetName{};
     };
 
+    struct ComputeShader
+    {
+        std::shared_ptr<RxCore::Shader> shader;
+        std::string shaderAssetName{};
+    };
+
+    struct ComputePipeline
+    {
+        std::shared_ptr<RxCore::Pipeline> pipeline;
+    };
+
     struct PipelineLayout
     {
         VkPipelineLayout layout;
@@ -69,6 +82,8 @@ namespace RxEngine
 
     struct UsesLayout : ecs::Relation {};
 
+    struct UsesComputeShader : ecs::Relation {};
+
     struct HasOpaquePipeline : ecs::Relation { };
 
     struct HasShadowPipeline : ecs::Relation { };
@@ -77,6 +92,9 @@ namespace RxEngine
 
     struct HasUiPipeline : ecs::Relation { };
 
+    // Same pipeline built for meshes stored in the compact vertex format
+    struct HasCompactVariant : ecs::Relation { };
+
     //struct HasPipeline {};
 
     struct MaterialPipelineDetails
@@ -125,6 +143,37 @@ namespace RxEngine
 
     struct MaterialDescriptor { };
 
+    // Largest share of the screen height covered by something drawn with each material this
+    // frame, indexed by Material::sequence. Added to by the mesh modules while they render and
+    // cleared once texture streaming has read it
+    struct TextureFeedback
+    {
+        std::vector<float> coverage;
+
+        void note(uint32_t material, float value)
+        {
+            if (coverage.size() <= material) {
+                coverage.resize(material + 1);
+            }
+            coverage[material] = std::max(coverage[material], value);
+        }
+    };
+
+    struct TextureStreamingStats
+    {
+        VkDeviceSize budget;
+        VkDeviceSize residentBytes;
+        // What every image would hold with all the mips its coverage asks for
+        VkDeviceSize wantedBytes;
+        uint32_t images;
+        uint32_t fullyResident;
+        uint32_t loading;
+        uint64_t promotions;
+        uint64_t evictions;
+    };
+
+    class TextureStreamer;
+
     struct MaterialShaderEntry
     {
         uint32_t colorTextureIndex;
@@ -136,6 +185,7 @@ namespace RxEngine
     public:
         MaterialsModule(ecs::World * world, EngineMain * engine, const ecs::entity_t moduleId)
             : Module(world, engine, moduleId) {}
+        ~MaterialsModule();
 
         void startup() override;
         void shutdown() override;
@@ -158,8 +208,16 @@ namespace RxEngine
                                     const RenderPasses * rp);
 
         void createShaderMaterialData(ecs::EntityHandle e, DescriptorSet * ds);
+        void updateTextureDescriptors(const DescriptorSet * ds);
+        void refreshTextureDescriptors();
+        void streamTextures();
     private:
         ecs::queryid_t materialQuery;
+        std::unique_ptr<TextureStreamer> textureStreamer_;
+        // Bumped whenever streaming swaps images, each main set remembers the value its texture
+        // array was last written at
+        uint64_t textureUpdate_{};
+        std::unordered_map<ecs::entity_t, uint64_t> setTextureUpdates_{};
         //static void materialGui(ecs::EntityHandle e);
     };
 }
@@ -0,0 +1,301 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "TextureStreamer.h"
+#include "Loader.h"
+#include "UploadService.h"
+#include "optick/optick.h"
+
+namespace RxEngine
+{
+    // Updates a replaced image is kept for, covering the frames that may still sample it
+    constexpr uint64_t retired_image_frames = 5;
+    // Share of its priority an image keeps each update its materials aren't seen
+    constexpr float priority_decay = 0.97f;
+    // Below this an image is no longer thought of as on screen and only wants its tail
+    constexpr float min_priority = 1e-4f;
+
+    TextureStreamer::TextureStreamer(RxCore::Device * device,
+                                     UploadService * uploads,
+                                     VkDeviceSize budget,
+                                     uint32_t tailSize,
+                                     uint32_t maxLoads)
+        : device_(device)
+        , uploads_(uploads)
+        , budget_(budget)
+        , tailSize_(tailSize)
+        , maxLoads_(std::max(maxLoads, 1u))
+    {}
+
+    TextureStreamer::~TextureStreamer()
+    {
+        // Jobs write into their loads, which go with the images
+        for (auto & si: images_) {
+            if (si.load && si.load->job) {
+                si.load->job->waitComplete();
+            }
+        }
+    }
+
+    VkDeviceSize TextureStreamer::bytesFrom(const StreamedImage & si, uint32_t topMip)
+    {
+        return std::accumulate(si.mipBytes.begin() + topMip, si.mipBytes.end(), VkDeviceSize{0});
+    }
+
+    // The mip with about one texel per pixel when the image is stretched once across the
+    // height of the screen its materials were seen covering
+    uint32_t TextureStreamer::wantedMipFor(const StreamedImage & si, uint32_t screenHeight)
+    {
+        if (si.priority < min_priority) {
+            return si.tailMip;
+        }
+        const float pixels = std::max(si.priority * static_cast<float>(screenHeight), 1.0f);
+        const float texels = static_cast<float>(std::max(si.mipExtents[0].width, si.mipExtents[0].height));
+        const float mip = std::max(std::floor(std::log2(texels / pixels)), 0.0f);
+
+        return std::min(static_cast<uint32_t>(mip), si.tailMip);
+    }
+
+    MaterialImage TextureStreamer::createImage(const StreamedImage & si,
+                                               const RxAssets::ImageData & data,
+                                               uint32_t topMip,
+                                               uint64_t & ticket)
+    {
+        auto image = device_->createImage(
+            si.format,
+            si.mipExtents[topMip],
+            static_cast<uint32_t>(si.mipExtents.size()) - topMip,
+            1,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_IMAGE_TYPE_2D
+        );
+        auto iv = device_->createImageView(image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        // Tickets complete in order, the last one covers every mip
+        for (uint32_t m = topMip; m < si.mipExtents.size(); m++) {
+            ticket = uploads_->uploadImage(
+                image,
+                m - topMip,
+                si.mipExtents[m],
+                data.mipLevels[m].bytes.data(),
+                data.mipLevels[m].bytes.size()
+            );
+        }
+
+        return {image, iv};
+    }
+
+    MaterialImage TextureStreamer::addImage(ecs::entity_t entity,
+                                            const std::string & fileName,
+                                            const RxAssets::ImageData & data)
+    {
+        StreamedImage si{};
+        si.entity = entity;
+        si.fileName = fileName;
+        si.format = data.imType == RxAssets::eBC7 ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+
+        for (auto & mip: data.mipLevels) {
+            si.mipExtents.push_back({mip.width, mip.height, 1});
+            si.mipBytes.push_back(mip.bytes.size());
+        }
+
+        si.tailMip = static_cast<uint32_t>(si.mipExtents.size()) - 1;
+        for (uint32_t m = 0; m < si.mipExtents.size(); m++) {
+            if (std::max(si.mipExtents[m].width, si.mipExtents[m].height) <= tailSize_) {
+                si.tailMip = m;
+                break;
+            }
+        }
+        si.residentMip = si.tailMip;
+        si.wantedMip = si.tailMip;
+
+        uint64_t ticket{};
+        si.image = createImage(si, data, si.tailMip, ticket);
+
+        images_.push_back(std::move(si));
+
+        return images_.back().image;
+    }
+
+    void TextureStreamer::startLoad(StreamedImage & si, uint32_t topMip)
+    {
+        si.load = std::make_unique<StreamLoad>();
+        si.load->topMip = topMip;
+
+        // The load outlives its job, it is only dropped once ready is seen
+        auto load = si.load.get();
+        si.load->job = RxCore::CreateJob<uint32_t>(
+            [load, file_name = si.fileName]() -> uint32_t {
+                OPTICK_EVENT("Stream Texture")
+                RxAssets::Loader::loadImage(load->data, file_name);
+                load->ready = true;
+                return 0;
+            }
+        );
+        si.load->job->schedule();
+    }
+
+    void TextureStreamer::startLoads()
+    {
+        uint32_t loading = 0;
+        VkDeviceSize committed = 0;
+        std::vector<StreamedImage *> wanting;
+        std::vector<StreamedImage *> holding;
+
+        for (auto & si: images_) {
+            if (si.load) {
+                loading++;
+                committed += std::max(bytesFrom(si, si.load->topMip), bytesFrom(si, si.residentMip));
+                continue;
+            }
+            committed += bytesFrom(si, si.residentMip);
+            if (si.wantedMip < si.residentMip) {
+                wanting.push_back(&si);
+            } else if (si.wantedMip > si.residentMip) {
+                holding.push_back(&si);
+            }
+        }
+
+        std::ranges::sort(
+            wanting, [](const StreamedImage * a, const StreamedImage * b) {
+                return a->priority > b->priority;
+            }
+        );
+        std::ranges::sort(
+            holding, [](const StreamedImage * a, const StreamedImage * b) {
+                return a->priority < b->priority;
+            }
+        );
+
+        auto victim = holding.begin();
+        for (auto * si: wanting) {
+            if (loading >= maxLoads_) {
+                break;
+            }
+
+            // Make room from images that are holding more than they want and matter less
+            const VkDeviceSize extra = bytesFrom(*si, si->wantedMip) - bytesFrom(*si, si->residentMip);
+            while (committed + extra > budget_ && loading < maxLoads_ &&
+                victim != holding.end() && (*victim)->priority < si->priority) {
+                auto & v = **victim;
+                committed -= bytesFrom(v, v.residentMip) - bytesFrom(v, v.wantedMip);
+                startLoad(v, v.wantedMip);
+                evictions_++;
+                loading++;
+                ++victim;
+            }
+            if (loading >= maxLoads_) {
+                break;
+            }
+
+            // Short of room, go as far towards the wanted mip as fits
+            const VkDeviceSize resident = bytesFrom(*si, si->residentMip);
+            uint32_t top = si->wantedMip;
+            while (top < si->residentMip && committed + bytesFrom(*si, top) - resident > budget_) {
+                top++;
+            }
+            if (top == si->residentMip) {
+                continue;
+            }
+
+            committed += bytesFrom(*si, top) - resident;
+            startLoad(*si, top);
+            promotions_++;
+            loading++;
+        }
+    }
+
+    std::vector<TextureSwap> TextureStreamer::update(
+        const std::unordered_map<ecs::entity_t, float> & coverage,
+        uint32_t screenHeight)
+    {
+        OPTICK_EVENT()
+
+        updateNo_++;
+        while (!retired_.empty() && retired_.front().first + retired_image_frames < updateNo_) {
+            retired_.pop_front();
+        }
+
+        for (auto & si: images_) {
+            const auto it = coverage.find(si.entity);
+            const float seen = it == coverage.end() ? 0.0f : it->second;
+            si.priority = std::max(si.priority * priority_decay, seen);
+            si.wantedMip = wantedMipFor(si, screenHeight);
+        }
+
+        std::vector<TextureSwap> swaps;
+        for (auto & si: images_) {
+            if (!si.load) {
+                continue;
+            }
+            auto & load = *si.load;
+
+            if (!load.image.image) {
+                if (!load.ready) {
+                    continue;
+                }
+                load.job->waitComplete();
+                load.image = createImage(si, load.data, load.topMip, load.ticket);
+                load.data = {};
+                continue;
+            }
+
+            if (!uploads_->isComplete(load.ticket)) {
+                continue;
+            }
+
+            retired_.emplace_back(updateNo_, std::move(si.image));
+            si.image = std::move(load.image);
+            si.residentMip = load.topMip;
+            si.load.reset();
+            swaps.push_back({si.entity, si.image});
+        }
+
+        startLoads();
+
+        return swaps;
+    }
+
+    TextureStreamingStats TextureStreamer::getStats() const
+    {
+        TextureStreamingStats stats{};
+        stats.budget = budget_;
+        stats.images = static_cast<uint32_t>(images_.size());
+        stats.promotions = promotions_;
+        stats.evictions = evictions_;
+
+        for (auto & si: images_) {
+            stats.residentBytes += bytesFrom(si, si.residentMip);
+            stats.wantedBytes += bytesFrom(si, si.wantedMip);
+            stats.fullyResident += si.residentMip == 0 ? 1 : 0;
+            stats.loading += si.load ? 1 : 0;
+        }
+
+        return stats;
+    }
+}
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "RxECS.h"
+#include "RXAssets.h"
+#include "Jobs/JobManager.hpp"
+#include "Vulkan/Device.h"
+#include "Materials.h"
+
+namespace RxEngine
+{
+    class UploadService;
+
+    struct TextureSwap
+    {
+        ecs::entity_t entity;
+        MaterialImage image;
+    };
+
+    // Keeps only the small tail mips of material images resident until their materials are
+    // seen on screen, then loads larger mips in the background, most covered first, within a
+    // budget of device memory. Images holding more than their coverage still asks for give
+    // their large mips back when something wanted more needs the room.
+    //
+    // A change of residency replaces the whole image: a job reads the file again, the new
+    // image is filled through the upload service and handed back to be set on the image
+    // entity once its copies have been recorded. The old image is released a few updates later.
+    class TextureStreamer
+    {
+    public:
+        TextureStreamer(RxCore::Device * device,
+                        UploadService * uploads,
+                        VkDeviceSize budget,
+                        uint32_t tailSize,
+                        uint32_t maxLoads);
+        ~TextureStreamer();
+
+        // Creates the image for a file that has just been read with its mips no larger than
+        // tailSize, and tracks it under the image entity
+        MaterialImage addImage(ecs::entity_t entity,
+                               const std::string & fileName,
+                               const RxAssets::ImageData & data);
+
+        // Folds the screen coverage seen for each image entity this frame into its priority,
+        // finishes and starts loads. Returns the images whose residency changed
+        std::vector<TextureSwap> update(const std::unordered_map<ecs::entity_t, float> & coverage,
+                                        uint32_t screenHeight);
+
+        [[nodiscard]] TextureStreamingStats getStats() const;
+
+    private:
+        struct StreamLoad
+        {
+            uint32_t topMip;
+            std::shared_ptr<RxCore::Job<uint32_t>> job;
+            std::atomic<bool> ready{};
+            RxAssets::ImageData data;
+            // Set once the file is read and the copies are queued
+            MaterialImage image;
+            uint64_t ticket{};
+        };
+
+        struct StreamedImage
+        {
+            ecs::entity_t entity;
+            std::string fileName;
+            VkFormat format;
+            std::vector<VkExtent3D> mipExtents;
+            std::vector<VkDeviceSize> mipBytes;
+            // Index in the file of the largest mip always resident, and of the largest mip in
+            // the image now
+            uint32_t tailMip;
+            uint32_t residentMip;
+            uint32_t wantedMip;
+            float priority;
+            MaterialImage image;
+            std::unique_ptr<StreamLoad> load;
+        };
+
+        static VkDeviceSize bytesFrom(const StreamedImage & si, uint32_t topMip);
+        static uint32_t wantedMipFor(const StreamedImage & si, uint32_t screenHeight);
+
+        MaterialImage createImage(const StreamedImage & si,
+                                  const RxAssets::ImageData & data,
+                                  uint32_t topMip,
+                                  uint64_t & ticket);
+        void startLoad(StreamedImage & si, uint32_t topMip);
+        void startLoads();
+
+        RxCore::Device * device_;
+        UploadService * uploads_;
+        VkDeviceSize budget_;
+        uint32_t tailSize_;
+        uint32_t maxLoads_;
+
+        std::vector<StreamedImage> images_{};
+        std::deque<std::pair<uint64_t, MaterialImage>> retired_{};
+        uint64_t updateNo_{};
+        uint64_t promotions_{};
+        uint64_t evictions_{};
+    };
+}
@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <array>
+#include "DrawSort.h"
+#include "Jobs/JobManager.hpp"
+#include "optick/optick.h"
+
+namespace RxEngine
+{
+    constexpr size_t radix_chunk_items = 16384;
+    constexpr uint32_t radix_max_chunks = 16;
+
+    namespace
+    {
+        template<typename Fn>
+        void runChunks(uint32_t count, Fn && fn)
+        {
+            if (count == 1) {
+                fn(0);
+                return;
+            }
+            std::vector<std::shared_ptr<RxCore::Job<uint32_t>>> jobs(count);
+            for (uint32_t c = 0; c < count; c++) {
+                jobs[c] = RxCore::CreateJob<uint32_t>(
+                    [&fn, c]() -> uint32_t {
+                        fn(c);
+                        return 0;
+                    }
+                );
+                jobs[c]->schedule();
+            }
+            for (auto & job: jobs) {
+                job->waitComplete();
+            }
+        }
+
+        uint32_t idFor(std::unordered_map<uint64_t, uint32_t> & ids, uint64_t value, uint32_t bits)
+        {
+            auto it = ids.find(value);
+            if (it != ids.end()) {
+                return it->second;
+            }
+            // Ids past the field width wrap, which only costs some batching, not correctness
+            // as long as the full key is compared when building commands
+            const auto id = static_cast<uint32_t>(ids.size()) & ((1u << bits) - 1);
+            ids.emplace(value, id);
+            return id;
+        }
+    }
+
+    uint64_t DrawSortKeys::makeKey(
+        ecs::entity_t pipeline,
+        ecs::entity_t bundle,
+        uint32_t vertexOffset,
+        uint32_t indexOffset,
+        uint32_t material)
+    {
+        const uint64_t p = idFor(pipelines_, pipeline, draw_key_pipeline_bits);
+        const uint64_t b = idFor(bundles_, bundle, draw_key_bundle_bits);
+        const uint64_t m = idFor(
+            meshes_,
+            (static_cast<uint64_t>(b) << 56) ^ (static_cast<uint64_t>(vertexOffset) << 28) ^ indexOffset,
+            draw_key_mesh_bits
+        );
+        const uint64_t mat = material & ((1u << draw_key_material_bits) - 1);
+
+        return (p << draw_key_pipeline_shift) |
+            (b << draw_key_bundle_shift) |
+            (m << draw_key_mesh_shift) |
+            (mat << draw_key_material_shift);
+    }
+
+    uint64_t DrawSortKeys::withDepth(uint64_t key, float depth)
+    {
+        constexpr uint32_t depth_max = (1u << draw_key_depth_bits) - 1;
+        const auto d = static_cast<uint32_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(depth_max));
+
+        return (key & ~static_cast<uint64_t>(depth_max)) | d;
+    }
+
+    void DrawSortKeys::clear()
+    {
+        pipelines_.clear();
+        bundles_.clear();
+        meshes_.clear();
+    }
+
+    void radixSortDrawItems(std::vector<DrawSortItem> & items, std::vector<DrawSortItem> & scratch)
+    {
+        OPTICK_EVENT()
+
+        const size_t n = items.size();
+        if (n < 2) {
+            return;
+        }
+        scratch.resize(n);
+
+        const auto chunk_count = static_cast<uint32_t>(
+            std::clamp<size_t>(n / radix_chunk_items, 1, radix_max_chunks)
+        );
+        const size_t chunk_size = (n + chunk_count - 1) / chunk_count;
+
+        std::vector<std::array<size_t, 256>> counts(chunk_count);
+
+        for (uint32_t shift = 0; shift < 64; shift += 8) {
+            runChunks(
+                chunk_count,
+                [&](uint32_t c) {
+                    auto & count = counts[c];
+                    count.fill(0);
+                    const size_t end = std::min(n, (c + 1) * chunk_size);
+                    for (size_t i = c * chunk_size; i < end; i++) {
+                        count[(items[i].key >> shift) & 0xff]++;
+                    }
+                }
+            );
+
+            // Every key has the same byte here, nothing would move
+            bool trivial = false;
+            for (uint32_t bucket = 0; bucket < 256 && !trivial; bucket++) {
+                size_t total = 0;
+                for (auto & count: counts) {
+                    total += count[bucket];
+                }
+                trivial = total == n;
+            }
+            if (trivial) {
+                continue;
+            }
+
+            // Turn counts into write offsets, by bucket then by chunk so the sort stays stable
+            size_t offset = 0;
+            for (uint32_t bucket = 0; bucket < 256; bucket++) {
+                for (auto & count: counts) {
+                    const size_t c = count[bucket];
+                    count[bucket] = offset;
+                    offset += c;
+                }
+            }
+
+            runChunks(
+                chunk_count,
+                [&](uint32_t c) {
+                    auto & dst = counts[c];
+                    const size_t end = std::min(n, (c + 1) * chunk_size);
+                    for (size_t i = c * chunk_size; i < end; i++) {
+                        scratch[dst[(items[i].key >> shift) & 0xff]++] = items[i];
+                    }
+                }
+            );
+            items.swap(scratch);
+        }
+    }
+}
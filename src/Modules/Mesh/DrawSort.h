@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "RxECS.h"
+
+namespace RxEngine
+{
+    // Draw sort keys, most significant first:
+    //   pipeline 10 | bundle 8 | mesh 20 | material 16 | depth 10
+    // Instances with equal keys above the depth bits go in the same indirect command, the depth
+    // bits only order instances inside it.
+    constexpr uint32_t draw_key_depth_bits = 10;
+    constexpr uint32_t draw_key_material_bits = 16;
+    constexpr uint32_t draw_key_mesh_bits = 20;
+    constexpr uint32_t draw_key_bundle_bits = 8;
+    constexpr uint32_t draw_key_pipeline_bits = 10;
+
+    constexpr uint32_t draw_key_material_shift = draw_key_depth_bits;
+    constexpr uint32_t draw_key_mesh_shift = draw_key_material_shift + draw_key_material_bits;
+    constexpr uint32_t draw_key_bundle_shift = draw_key_mesh_shift + draw_key_mesh_bits;
+    constexpr uint32_t draw_key_pipeline_shift = draw_key_bundle_shift + draw_key_bundle_bits;
+
+    static_assert(draw_key_pipeline_shift + draw_key_pipeline_bits == 64);
+
+    struct DrawSortItem
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // Hands out the small dense ids that are packed into sort keys. Not thread safe, keys are
+    // made while collecting and the result is read by the jobs that sort.
+    class DrawSortKeys
+    {
+    public:
+        uint64_t makeKey(
+            ecs::entity_t pipeline,
+            ecs::entity_t bundle,
+            uint32_t vertexOffset,
+            uint32_t indexOffset,
+            uint32_t material);
+
+        // Depth in [0, 1], nearest first
+        static uint64_t withDepth(uint64_t key, float depth);
+
+        static uint64_t batchOf(uint64_t key)
+        {
+            return key >> draw_key_material_shift;
+        }
+
+        static uint64_t commandOf(uint64_t key)
+        {
+            return key >> draw_key_mesh_shift;
+        }
+
+        void clear();
+
+    private:
+        std::unordered_map<uint64_t, uint32_t> pipelines_{};
+        std::unordered_map<uint64_t, uint32_t> bundles_{};
+        std::unordered_map<uint64_t, uint32_t> meshes_{};
+    };
+
+    // Stable LSD radix sort on key, 8 bits a pass. Bytes that are the same in every key are
+    // skipped, and large inputs are histogrammed and scattered in chunks across jobs.
+    void radixSortDrawItems(std::vector<DrawSortItem> & items, std::vector<DrawSortItem> & scratch);
+}
@@ -23,13 +23,25 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <Modules/Render.h>
 #include <Vulkan/ThreadResources.h>
+#include <Jobs/JobManager.hpp>
+#include <Vulkan/Buffer.hpp>
+#include <Modules/Scene/SceneModule.h>
 #include "Mesh.h"
 
 #include "EngineMain.hpp"
+#include "UploadService.h"
 #include "imgui.h"
 
+constexpr uint32_t instance_staging_count = 5;
+constexpr uint32_t initial_instance_capacity = 4096;
+constexpr uint32_t headers_per_secondary = 256;
+constexpr uint32_t max_secondaries = 8;
+// Bundles start at this fraction of their limit
+constexpr uint32_t bundle_initial_fraction = 32;
+
 namespace RxEngine
 {
     void meshPrimitiveGui(ecs::EntityHandle, const void * ptr)
@@ -132,11 +144,17 @@ namespace RxEngine
             return;
         }
 
+        if (!mesh_entity.has<MeshResident>()) {
+            return;
+        }
+
         auto mesh = mesh_entity.get<Mesh>();
+        auto sub_mesh = subMeshEntity.get<SubMesh>();
 
+        // Sub meshes draw their own range, levels of detail keep theirs past the base mesh
         rdc.vertexOffset = mesh->vertexOffset;
-        rdc.indexCount = mesh->indexCount;
-        rdc.indexOffset = mesh->indexOffset;
+        rdc.indexCount = sub_mesh->indexCount;
+        rdc.indexOffset = mesh->indexOffset + sub_mesh->indexOffset;
         rdc.boundBox = mesh->boundBox;
 
         const auto bundle_entity = mesh_entity.getRelatedEntity<InBundle>();
@@ -156,9 +174,223 @@ namespace RxEngine
         rdc.shadowPipeline = material_entity.getRelatedEntity<HasShadowPipeline>();
         rdc.transparentPipeline = material_entity.getRelatedEntity<HasTransparentPipeline>();
 
+        // Compact meshes can only be drawn by pipelines that decode them, a pipeline without a
+        // compact variant leaves the mesh out of that pass
+        if (bundle_entity.get<MeshBundle>()->compact) {
+            auto world = subMeshEntity.world;
+            auto variant = [world](ecs::entity_t pipeline) -> ecs::entity_t {
+                if (!pipeline) {
+                    return 0;
+                }
+                auto related = world->get<HasCompactVariant>(pipeline);
+                return related ? related->entity : 0;
+            };
+            rdc.opaquePipeline = variant(rdc.opaquePipeline);
+            rdc.shadowPipeline = variant(rdc.shadowPipeline);
+            rdc.transparentPipeline = variant(rdc.transparentPipeline);
+        }
+
         subMeshEntity.setDeferred(rdc);
     }
 
+    void createBundleBuffers(RxCore::Device * device,
+                             MeshBundle * bundle,
+                             uint32_t vertexCapacity,
+                             uint32_t indexCapacity)
+    {
+        bundle->vertexBuffer = device->createBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY, static_cast<VkDeviceSize>(vertexCapacity) * bundle->vertexSize
+        );
+        // Not createIndexBuffer, the indices are copied out when the bundle is reallocated
+        bundle->indexBuffer = device->createBuffer(
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY, static_cast<VkDeviceSize>(indexCapacity) * bundle->indexSize
+        );
+        bundle->address = bundle->vertexBuffer->getDeviceAddress();
+        if (bundle->positionStream) {
+            bundle->positionBuffer = device->createBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY,
+                static_cast<VkDeviceSize>(vertexCapacity) * position_stream_stride
+            );
+            bundle->positionAddress = bundle->positionBuffer->getDeviceAddress();
+        }
+        bundle->maxVertexCount = vertexCapacity;
+        bundle->maxIndexCount = indexCapacity;
+    }
+
+    uint32_t bundleCapacityFor(uint32_t used, uint32_t limit)
+    {
+        uint32_t capacity = std::max(limit / bundle_initial_fraction, 1u);
+        while (capacity < limit && capacity < used + used / 2) {
+            capacity = capacity > limit / 2 ? limit : capacity * 2;
+        }
+        return capacity;
+    }
+
+    void appendRegion(std::vector<VkBufferCopy> & regions,
+                      VkDeviceSize src,
+                      VkDeviceSize dst,
+                      VkDeviceSize size)
+    {
+        if (size == 0) {
+            return;
+        }
+        if (!regions.empty() &&
+            regions.back().srcOffset + regions.back().size == src &&
+            regions.back().dstOffset + regions.back().size == dst) {
+            regions.back().size += size;
+        } else {
+            regions.push_back({src, dst, size});
+        }
+    }
+
+    // Moves the bundle into new buffers, the copy is queued on the upload service. When packing,
+    // live ranges are laid out from the start in order and the entries take their new offsets.
+    void reallocateBundle(RxCore::Device * device,
+                          UploadService * uploads,
+                          MeshBundle * bundle,
+                          uint32_t vertexCapacity,
+                          uint32_t indexCapacity,
+                          bool pack)
+    {
+        std::shared_ptr<RxCore::Buffer> old_vertices = bundle->vertexBuffer;
+        std::shared_ptr<RxCore::Buffer> old_indices = bundle->indexBuffer;
+        std::shared_ptr<RxCore::Buffer> old_positions = bundle->positionBuffer;
+
+        createBundleBuffers(device, bundle, vertexCapacity, indexCapacity);
+
+        if (pack) {
+            std::ranges::sort(
+                bundle->entries, [](const MeshBundleEntry & a, const MeshBundleEntry & b) {
+                    return a.vertexOffset < b.vertexOffset;
+                }
+            );
+            bundle->vertexRanges.reset(vertexCapacity);
+            bundle->indexRanges.reset(indexCapacity);
+        } else {
+            bundle->vertexRanges.grow(vertexCapacity);
+            bundle->indexRanges.grow(indexCapacity);
+        }
+
+        std::vector<VkBufferCopy> vertex_regions;
+        std::vector<VkBufferCopy> index_regions;
+        std::vector<VkBufferCopy> position_regions;
+        const VkDeviceSize vs = bundle->vertexSize;
+        const VkDeviceSize is = bundle->indexSize;
+
+        for (auto & entry: bundle->entries) {
+            uint32_t vertex_offset = entry.vertexOffset;
+            uint32_t index_offset = entry.indexOffset;
+            if (pack) {
+                vertex_offset = entry.vertexCount ? bundle->vertexRanges.allocate(entry.vertexCount) : 0;
+                index_offset = entry.indexCount ? bundle->indexRanges.allocate(entry.indexCount) : 0;
+            }
+            appendRegion(
+                vertex_regions, entry.vertexOffset * vs, vertex_offset * vs, entry.vertexCount * vs
+            );
+            appendRegion(
+                index_regions, entry.indexOffset * is, index_offset * is, entry.indexCount * is
+            );
+            appendRegion(
+                position_regions, entry.vertexOffset * position_stream_stride,
+                vertex_offset * position_stream_stride, entry.vertexCount * position_stream_stride
+            );
+            entry.vertexOffset = vertex_offset;
+            entry.indexOffset = index_offset;
+        }
+
+        uploads->copyBuffer(old_vertices, bundle->vertexBuffer, std::move(vertex_regions));
+        uploads->copyBuffer(old_indices, bundle->indexBuffer, std::move(index_regions));
+        if (bundle->positionStream) {
+            uploads->copyBuffer(old_positions, bundle->positionBuffer, std::move(position_regions));
+        }
+    }
+
+    void uploadBundlePositions(UploadService * uploads,
+                               const MeshBundle * bundle,
+                               const MeshBundleEntry & range,
+                               const std::vector<DirectX::XMFLOAT3> & positions)
+    {
+        if (!bundle->positionStream) {
+            return;
+        }
+        static_assert(sizeof(DirectX::XMFLOAT3) == position_stream_stride);
+
+        uploads->uploadBuffer(
+            bundle->positionBuffer->handle(),
+            static_cast<VkDeviceSize>(range.vertexOffset) * position_stream_stride,
+            positions.data(), positions.size() * position_stream_stride
+        );
+    }
+
+    bool allocateBundleRanges(RxCore::Device * device,
+                              UploadService * uploads,
+                              MeshBundle * bundle,
+                              ecs::entity_t mesh,
+                              uint32_t vertexCount,
+                              uint32_t indexCount,
+                              MeshBundleEntry & entry)
+    {
+        if (vertexCount == 0 || indexCount == 0 ||
+            vertexCount > bundle->vertexLimit || indexCount > bundle->indexLimit) {
+            return false;
+        }
+
+        uint32_t vertex_offset = bundle->vertexRanges.allocate(vertexCount);
+        uint32_t index_offset = bundle->indexRanges.allocate(indexCount);
+
+        if (vertex_offset == RangeAllocator::invalid || index_offset == RangeAllocator::invalid) {
+            if (vertex_offset != RangeAllocator::invalid) {
+                bundle->vertexRanges.release(vertex_offset, vertexCount);
+            }
+            if (index_offset != RangeAllocator::invalid) {
+                bundle->indexRanges.release(index_offset, indexCount);
+            }
+
+            // Grow whichever side ran out, enough that the request fits at the end
+            const uint32_t vertex_capacity = vertex_offset == RangeAllocator::invalid
+                                                 ? bundleCapacityFor(
+                                                     bundle->maxVertexCount + vertexCount,
+                                                     bundle->vertexLimit)
+                                                 : bundle->maxVertexCount;
+            const uint32_t index_capacity = index_offset == RangeAllocator::invalid
+                                                ? bundleCapacityFor(
+                                                    bundle->maxIndexCount + indexCount,
+                                                    bundle->indexLimit)
+                                                : bundle->maxIndexCount;
+
+            if (vertex_capacity == bundle->maxVertexCount && index_capacity == bundle->maxIndexCount) {
+                return false;
+            }
+            reallocateBundle(device, uploads, bundle, vertex_capacity, index_capacity, false);
+
+            vertex_offset = bundle->vertexRanges.allocate(vertexCount);
+            index_offset = bundle->indexRanges.allocate(indexCount);
+            if (vertex_offset == RangeAllocator::invalid || index_offset == RangeAllocator::invalid) {
+                if (vertex_offset != RangeAllocator::invalid) {
+                    bundle->vertexRanges.release(vertex_offset, vertexCount);
+                }
+                if (index_offset != RangeAllocator::invalid) {
+                    bundle->indexRanges.release(index_offset, indexCount);
+                }
+                return false;
+            }
+        }
+
+        entry = {mesh, vertex_offset, vertexCount, index_offset, indexCount};
+        bundle->entries.push_back(entry);
+        bundle->vertexCount = bundle->vertexRanges.getUsed();
+        bundle->indexCount = bundle->indexRanges.getUsed();
+
+        return true;
+    }
+
     void MeshModule::startup()
     {
         world_->set<ComponentGui>(
@@ -179,6 +411,75 @@ namespace RxEngine
               .withQuery<SubMesh>()
               .without<RenderDetailCache>()
               .each(cacheMeshRenderDetails);
+
+        world_->createSystem("Mesh:MeshResidency")
+              .inGroup("Pipeline:PostFrame")
+              .withQuery<Mesh>()
+              .without<MeshResident>()
+              .withRead<Mesh>()
+              .each(
+                  [this](ecs::EntityHandle e) {
+                      if (engine_->getUploadService()->isComplete(e.get<Mesh>()->uploadTicket)) {
+                          e.addDeferred<MeshResident>();
+                      }
+                  }
+              );
+
+        stagingBuffers_.resize(instance_staging_count);
+        stagingSizes_.resize(instance_staging_count);
+
+        world_->addSingleton<InstanceTable>();
+        growInstanceTable(initial_instance_capacity);
+
+        auto slotQueue = world_->createEntityQueue("MeshInstanceSlots");
+        slotQueue.triggerOnAdd<WorldTransform>();
+        slotQueue.triggerOnUpdate<WorldTransform>();
+
+        world_->createSystem("Mesh:UpdateInstanceSlots")
+              .inGroup("Pipeline:PreRender")
+              .withEntityQueue(slotQueue)
+              .withRead<WorldTransform>()
+              .withWrite<InstanceSlot>()
+              .withWrite<InstanceTable>()
+              .eachEntity(
+                  [this](ecs::EntityHandle e) {
+                      return updateInstanceSlot(e);
+                  }
+              );
+
+        world_->createSystem("Mesh:UploadInstanceTable")
+              .inGroup("Pipeline:Render")
+              .withStreamWrite<Render::ComputeCommand>()
+              .withRead<InstanceTable>()
+              .execute(
+                  [this](ecs::World *) {
+                      uploadInstanceTable();
+                  }
+              );
+
+        bundleQuery_ = world_->createQuery<MeshBundle>().id;
+
+        world_->createSystem("Mesh:ReleaseBundleRanges")
+              .inGroup("Pipeline:PostFrame")
+              .withInterval(2.0f)
+              .withWrite<MeshBundle>()
+              .withWrite<Mesh>()
+              .withWrite<RenderDetailCache>()
+              .execute(
+                  [this](ecs::World *) {
+                      releaseBundleRanges();
+                  }
+              );
+
+        world_->createSystem("Mesh:ReleaseInstanceSlots")
+              .inGroup("Pipeline:PostFrame")
+              .withInterval(2.0f)
+              .withWrite<InstanceTable>()
+              .execute(
+                  [this](ecs::World *) {
+                      releaseInstanceSlots();
+                  }
+              );
     }
 
     void MeshModule::shutdown()
@@ -188,13 +489,339 @@ namespace RxEngine
         world_->remove<ComponentGui>(world_->getComponentId<SubMesh>());
 
         world_->lookup("Mesh:CacheSubmeshData").destroy();
+        world_->lookup("Mesh:MeshResidency").destroy();
+        world_->lookup("Mesh:ReleaseBundleRanges").destroy();
+        world_->lookup("Mesh:UpdateInstanceSlots").destroy();
+        world_->lookup("Mesh:UploadInstanceTable").destroy();
+        world_->lookup("Mesh:ReleaseInstanceSlots").destroy();
+        world_->lookup("MeshInstanceSlots").destroy();
+
+        world_->removeSingleton<InstanceTable>();
+        retiredTables_.clear();
+        stagingBuffers_.clear();
     }
 
-    void MeshModule::drawInstances(std::shared_ptr<RxCore::Buffer> instanceBuffer,
-                                         ecs::World * world,
-                                         const GraphicsPipeline * pipeline,
-                                         const PipelineLayout * const layout,
-                                         IndirectDrawSet & ids)
+    bool MeshModule::updateInstanceSlot(ecs::EntityHandle e)
+    {
+        auto wt = e.get<WorldTransform>();
+        if (!wt) {
+            return true;
+        }
+
+        uint32_t slot;
+        auto is = e.get<InstanceSlot>();
+        if (is) {
+            slot = is->slot;
+        } else {
+            slot = allocateInstanceSlot(e.id);
+            e.setDeferred<InstanceSlot>({slot});
+        }
+
+        slotTransforms_[slot] = wt->transform;
+        if (!slotDirty_[slot]) {
+            slotDirty_[slot] = 1;
+            dirtySlots_.push_back(slot);
+        }
+        return true;
+    }
+
+    uint32_t MeshModule::allocateInstanceSlot(ecs::entity_t owner)
+    {
+        uint32_t slot;
+        if (!freeSlots_.empty()) {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(slotOwners_.size());
+            if (slot >= world_->getSingleton<InstanceTable>()->capacity) {
+                growInstanceTable(slot * 2);
+            }
+            slotOwners_.push_back(0);
+            slotTransforms_.emplace_back();
+            slotDirty_.push_back(0);
+        }
+        slotOwners_[slot] = owner;
+        return slot;
+    }
+
+    void MeshModule::growInstanceTable(uint32_t capacity)
+    {
+        auto table = world_->getSingletonUpdate<InstanceTable>();
+        if (table->buffer) {
+            retiredTables_.emplace_back(frameNo_, table->buffer);
+        }
+
+        table->buffer = engine_->getDevice()->createBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY, capacity * sizeof(DirectX::XMFLOAT4X4)
+        );
+        table->address = table->buffer->getDeviceAddress();
+        table->capacity = capacity;
+
+        // The new table starts empty, so everything allocated so far goes up again
+        for (uint32_t slot = 0; slot < slotOwners_.size(); slot++) {
+            if (slotOwners_[slot] && !slotDirty_[slot]) {
+                slotDirty_[slot] = 1;
+                dirtySlots_.push_back(slot);
+            }
+        }
+    }
+
+    void MeshModule::uploadInstanceTable()
+    {
+        OPTICK_EVENT("Upload Instance Table")
+
+        frameNo_++;
+        while (!retiredTables_.empty() &&
+            retiredTables_.front().first + instance_staging_count < frameNo_) {
+            retiredTables_.pop_front();
+        }
+
+        auto table = world_->getSingleton<InstanceTable>();
+        if (dirtySlots_.empty()) {
+            return;
+        }
+
+        std::sort(dirtySlots_.begin(), dirtySlots_.end());
+
+        stagingIx_ = (stagingIx_ + 1) % instance_staging_count;
+        const size_t size = dirtySlots_.size() * sizeof(DirectX::XMFLOAT4X4);
+        if (stagingSizes_[stagingIx_] < size) {
+            stagingBuffers_[stagingIx_] = engine_->getDevice()->createBuffer(
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, size * 2
+            );
+            stagingBuffers_[stagingIx_]->map();
+            stagingSizes_[stagingIx_] = size * 2;
+        }
+
+        std::vector<DirectX::XMFLOAT4X4> staged;
+        std::vector<VkBufferCopy> regions;
+        staged.reserve(dirtySlots_.size());
+
+        // Runs of adjacent slots are copied as one region
+        for (auto slot: dirtySlots_) {
+            const VkDeviceSize src = staged.size() * sizeof(DirectX::XMFLOAT4X4);
+            const VkDeviceSize dst = slot * sizeof(DirectX::XMFLOAT4X4);
+
+            if (!regions.empty() && regions.back().dstOffset + regions.back().size == dst) {
+                regions.back().size += sizeof(DirectX::XMFLOAT4X4);
+            } else {
+                regions.push_back({src, dst, sizeof(DirectX::XMFLOAT4X4)});
+            }
+            staged.push_back(slotTransforms_[slot]);
+            slotDirty_[slot] = 0;
+        }
+        dirtySlots_.clear();
+
+        stagingBuffers_[stagingIx_]->update(staged.data(), size);
+
+        world_->getSingletonUpdate<InstanceTable>()->uploadCount = static_cast<uint32_t>(staged.size());
+        world_->getStream<Render::ComputeCommand>()
+              ->add<Render::ComputeCommand>(
+                  {
+                      Render::ComputeStage::InstanceTable,
+                      [regions, src = stagingBuffers_[stagingIx_]->handle(),
+                          dst = table->buffer->handle()](VkCommandBuffer cb) {
+                          // The table is overwritten in place, so earlier frames still on the GPU
+                          // must be done reading it. Only an execution dependency is needed for that.
+                          vkCmdPipelineBarrier(
+                              cb,
+                              VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              0, 0, nullptr, 0, nullptr, 0, nullptr
+                          );
+                          vkCmdCopyBuffer(
+                              cb, src, dst, static_cast<uint32_t>(regions.size()), regions.data()
+                          );
+
+                          VkMemoryBarrier mb{};
+                          mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                          mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                          mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+                          vkCmdPipelineBarrier(
+                              cb,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                              0, 1, &mb, 0, nullptr, 0, nullptr
+                          );
+                      }
+                  }
+              );
+    }
+
+    void MeshModule::releaseInstanceSlots()
+    {
+        OPTICK_EVENT()
+
+        for (uint32_t slot = 0; slot < slotOwners_.size(); slot++) {
+            if (slotOwners_[slot] && !world_->isAlive(slotOwners_[slot])) {
+                slotOwners_[slot] = 0;
+                freeSlots_.push_back(slot);
+            }
+        }
+        world_->getSingletonUpdate<InstanceTable>()->slotCount =
+            static_cast<uint32_t>(slotOwners_.size() - freeSlots_.size());
+    }
+
+    void MeshModule::releaseBundleRanges()
+    {
+        OPTICK_EVENT()
+
+        // Moved entries with the header vertices of their bundle
+        std::vector<std::pair<MeshBundleEntry, uint32_t>> moved;
+
+        auto res = world_->getResults(bundleQuery_);
+        res.each<MeshBundle>(
+            [&](ecs::EntityHandle, MeshBundle * mb) {
+                const auto dead = std::ranges::remove_if(
+                    mb->entries, [this, mb](const MeshBundleEntry & entry) {
+                        if (world_->isAlive(entry.mesh)) {
+                            return false;
+                        }
+                        mb->vertexRanges.release(entry.vertexOffset, entry.vertexCount);
+                        mb->indexRanges.release(entry.indexOffset, entry.indexCount);
+                        return true;
+                    }
+                );
+                if (dead.empty()) {
+                    return;
+                }
+                mb->entries.erase(dead.begin(), dead.end());
+                mb->vertexCount = mb->vertexRanges.getUsed();
+                mb->indexCount = mb->indexRanges.getUsed();
+
+                // Compact into right sized buffers once freed space is scattered enough that
+                // new meshes would grow the bundle, or the bundle is mostly empty
+                const uint32_t vertex_capacity = bundleCapacityFor(mb->vertexCount, mb->vertexLimit);
+                const uint32_t index_capacity = bundleCapacityFor(mb->indexCount, mb->indexLimit);
+                const bool fragmented =
+                    mb->vertexRanges.getLargestFree() < (mb->maxVertexCount - mb->vertexCount) / 2 ||
+                    mb->indexRanges.getLargestFree() < (mb->maxIndexCount - mb->indexCount) / 2;
+                const bool oversized =
+                    vertex_capacity * 2 < mb->maxVertexCount || index_capacity * 2 < mb->maxIndexCount;
+
+                if (!fragmented && !oversized) {
+                    return;
+                }
+                reallocateBundle(
+                    engine_->getDevice(), engine_->getUploadService(), mb,
+                    std::min(std::max(vertex_capacity, mb->vertexCount), mb->vertexLimit),
+                    std::min(std::max(index_capacity, mb->indexCount), mb->indexLimit),
+                    true
+                );
+                for (auto & entry: mb->entries) {
+                    moved.emplace_back(entry, mb->headerVertices);
+                }
+            }
+        );
+
+        // Meshes and the render details cached from them take their new offsets
+        for (auto & [entry, header]: moved) {
+            const uint32_t vertex_offset = entry.vertexOffset + header;
+
+            auto patch = [&](ecs::entity_t mesh_entity) {
+                world_->update<Mesh>(
+                    mesh_entity, [&](Mesh * mesh) {
+                        mesh->vertexOffset = vertex_offset;
+                        mesh->indexOffset = entry.indexOffset;
+                    }
+                );
+                auto mesh = world_->get<Mesh>(mesh_entity);
+                if (!mesh) {
+                    return;
+                }
+                for (auto sub_mesh: mesh->subMeshes) {
+                    auto sm = world_->get<SubMesh>(sub_mesh);
+                    if (!sm || !world_->has<RenderDetailCache>(sub_mesh)) {
+                        continue;
+                    }
+                    world_->update<RenderDetailCache>(
+                        sub_mesh, [&](RenderDetailCache * rdc) {
+                            rdc->vertexOffset = vertex_offset;
+                            rdc->indexOffset = entry.indexOffset + sm->indexOffset;
+                        }
+                    );
+                }
+            };
+
+            patch(entry.mesh);
+
+            // Generated levels of detail live in the range of the mesh they were made from
+            auto lods = world_->get<MeshLods>(entry.mesh);
+            if (!lods) {
+                continue;
+            }
+            for (uint32_t l = 0; l < lods->count; l++) {
+                auto lod_of = world_->get<LodOf>(lods->meshes[l]);
+                if (lod_of && lod_of->entity == entry.mesh) {
+                    patch(lods->meshes[l]);
+                }
+            }
+        }
+    }
+
+    void MeshModule::drawInstances(const IndirectDrawBuffers & buffers,
+                                   ecs::World * world,
+                                   const GraphicsPipeline * pipeline,
+                                   const PipelineLayout * const layout,
+                                   IndirectDrawSet & ids,
+                                   bool late)
+    {
+        const auto header_count = static_cast<uint32_t>(ids.headers.size());
+        const uint32_t part_count = std::clamp<uint32_t>(
+            header_count / headers_per_secondary, 1, max_secondaries
+        );
+
+        std::vector<Render::OpaqueRenderCommand> commands(part_count);
+        if (part_count == 1) {
+            commands[0] = recordInstances(
+                buffers, world, pipeline, layout, ids, 0, header_count
+            );
+        } else {
+            // Each header range is recorded into its own secondary on a job, they are added to
+            // the stream in range order so they still execute in sort order
+            std::vector<std::shared_ptr<RxCore::Job<uint32_t>>> jobs(part_count);
+            const uint32_t part_size = (header_count + part_count - 1) / part_count;
+
+            for (uint32_t p = 0; p < part_count; p++) {
+                jobs[p] = RxCore::CreateJob<uint32_t>(
+                    [&, p]() -> uint32_t {
+                        OPTICK_EVENT("Record Instances")
+                        const uint32_t begin = p * part_size;
+                        commands[p] = recordInstances(
+                            buffers, world, pipeline, layout, ids,
+                            begin, std::min(begin + part_size, header_count)
+                        );
+                        return 0;
+                    }
+                );
+                jobs[p]->schedule();
+            }
+            {
+                OPTICK_EVENT("Wait for Recording", Optick::Category::Wait)
+                for (auto & job: jobs) {
+                    job->waitComplete();
+                }
+            }
+        }
+
+        auto stream = world->getStream<Render::OpaqueRenderCommand>();
+        for (auto & command: commands) {
+            command.late = late;
+            stream->add<Render::OpaqueRenderCommand>(command);
+        }
+    }
+
+    Render::OpaqueRenderCommand MeshModule::recordInstances(
+        const IndirectDrawBuffers & buffers,
+        ecs::World * world,
+        const GraphicsPipeline * pipeline,
+        const PipelineLayout * const layout,
+        const IndirectDrawSet & ids,
+        uint32_t headerBegin,
+        uint32_t headerEnd)
     {
         auto cmds = world->getSingleton<CurrentMainDescriptorSet>();
         auto ds0 = world->get<DescriptorSet>(cmds->descriptorSet);
@@ -204,8 +831,9 @@ namespace RxEngine
         bool flipY = true;
         uint32_t triangles = 0;
         uint32_t drawCalls = 0;
+        uint32_t apiDrawCalls = 0;
 
-        buf->begin(pipeline->renderPass, pipeline->subPass);
+        const bool inherited = Render::beginSecondary(world, buf, pipeline->renderPass, pipeline->subPass);
         {
             buf->useLayout(layout->layout);
             OPTICK_GPU_CONTEXT(buf->Handle())
@@ -228,27 +856,147 @@ namespace RxEngine
                 1.0f
             );
 
-            auto da = instanceBuffer->getDeviceAddress();
+            auto da = buffers.instanceAddress;
+            auto ta = world->getSingleton<InstanceTable>()->address;
+            buf->pushConstant(VK_SHADER_STAGE_VERTEX_BIT, 8, sizeof(da), &da);
+            buf->pushConstant(VK_SHADER_STAGE_VERTEX_BIT, 16, sizeof(ta), &ta);
+            MeshModule::renderIndirectDraws(
+                world, ids, buf, buffers, triangles, drawCalls, apiDrawCalls,
+                headerBegin, headerEnd
+            );
+        }
+        Render::endSecondary(buf, inherited);
+
+        return {buf, triangles, drawCalls, apiDrawCalls};
+    }
+
+    Render::ShadowRenderCommand MeshModule::drawShadowInstances(
+        const IndirectDrawBuffers & buffers,
+        ecs::World * world,
+        const GraphicsPipeline * pipeline,
+        const PipelineLayout * const layout,
+        const IndirectDrawSet & ids,
+        uint32_t cascadeIndex,
+        uint32_t shadowMapSize)
+    {
+        auto cmds = world->getSingleton<CurrentMainDescriptorSet>();
+        auto ds0 = world->get<DescriptorSet>(cmds->descriptorSet);
+
+        auto buf = RxCore::threadResources.getCommandBuffer();
+
+        uint32_t triangles = 0;
+        uint32_t drawCalls = 0;
+        uint32_t apiDrawCalls = 0;
+
+        const bool inherited = Render::beginSecondary(world, buf, pipeline->renderPass, pipeline->subPass);
+        {
+            buf->useLayout(layout->layout);
+            OPTICK_GPU_CONTEXT(buf->Handle())
+            OPTICK_GPU_EVENT("Draw Shadow Instances")
+            buf->BindDescriptorSet(0, ds0->ds);
+
+            buf->setScissor(
+                {
+                    {0,             0},
+                    {shadowMapSize, shadowMapSize}
+                }
+            );
+            buf->setViewport(
+                .0f, .0f,
+                static_cast<float>(shadowMapSize), static_cast<float>(shadowMapSize),
+                0.0f, 1.0f
+            );
+
+            auto da = buffers.instanceAddress;
+            auto ta = world->getSingleton<InstanceTable>()->address;
             buf->pushConstant(VK_SHADER_STAGE_VERTEX_BIT, 8, sizeof(da), &da);
-            MeshModule::renderIndirectDraws(world, ids, buf, triangles, drawCalls);
+            buf->pushConstant(VK_SHADER_STAGE_VERTEX_BIT, 16, sizeof(ta), &ta);
+            buf->pushConstant(VK_SHADER_STAGE_VERTEX_BIT, 24, sizeof(cascadeIndex), &cascadeIndex);
+            MeshModule::renderIndirectDraws(
+                world, ids, buf, buffers, triangles, drawCalls, apiDrawCalls
+            );
         }
-        buf->end();
+        Render::endSecondary(buf, inherited);
 
-        world->getStream<Render::OpaqueRenderCommand>()
-             ->add<Render::OpaqueRenderCommand>({buf, triangles, drawCalls});
+        return {buf, triangles, drawCalls, apiDrawCalls, static_cast<uint8_t>(cascadeIndex)};
+    }
+
+    IndirectDrawBuffers MeshModule::createInstanceBuffer(EngineMain * engine,
+                                                         IndirectDrawSet & ids,
+                                                         InstanceBuffers & buffers)
+    {
+        auto ring = engine->getUploadRing();
+        const auto instances = ring->upload(
+            ids.instances.data(), ids.instances.size() * sizeof(IndirectDrawInstance), 16);
+        const auto commands = instances
+                                  ? ring->upload(
+                                      ids.commands.data(),
+                                      ids.commands.size() * sizeof(IndirectDrawCommand), 16)
+                                  : UploadAllocation{};
+        if (instances && commands) {
+            return {instances.address, commands.buffer, commands.offset, VK_NULL_HANDLE, 0};
+        }
+
+        // The ring is full this frame, use the caller's own rotating buffers instead
+        buffers.ix = (buffers.ix + 1) % buffers.count;
+        if (buffers.sizes[buffers.ix] < ids.instances.size()) {
+            auto n = ids.instances.size() * 2;
+            auto b = engine->createStorageBuffer(n * sizeof(IndirectDrawInstance));
+
+            buffers.buffers[buffers.ix] = b;
+            b->map();
+            buffers.sizes[buffers.ix] = static_cast<uint32_t>(n);
+        }
+
+        buffers.buffers[buffers.ix]->update(
+            ids.instances.data(),
+            ids.instances.size() * sizeof(IndirectDrawInstance));
+
+        if (buffers.indirectSizes[buffers.ix] < ids.commands.size()) {
+            auto n = ids.commands.size() * 2;
+            auto b = engine->createIndirectBuffer(n * sizeof(IndirectDrawCommand));
+
+            buffers.indirectBuffers[buffers.ix] = b;
+            b->map();
+            buffers.indirectSizes[buffers.ix] = static_cast<uint32_t>(n);
+        }
+
+        buffers.indirectBuffers[buffers.ix]->update(
+            ids.commands.data(),
+            ids.commands.size() * sizeof(IndirectDrawCommand));
+
+        return {
+            buffers.buffers[buffers.ix]->getDeviceAddress(),
+            buffers.indirectBuffers[buffers.ix]->handle(), 0,
+            VK_NULL_HANDLE, 0
+        };
     }
 
     void MeshModule::renderIndirectDraws(ecs::World * world,
-                                         IndirectDrawSet ids,
+                                         const IndirectDrawSet & ids,
                                          const std::shared_ptr<RxCore::SecondaryCommandBuffer> & buf,
-                                         uint32_t & triangles, uint32_t & drawCalls
-                                         )
+                                         const IndirectDrawBuffers & buffers,
+                                         uint32_t & triangles, uint32_t & drawCalls,
+                                         uint32_t & apiDrawCalls,
+                                         uint32_t headerBegin,
+                                         uint32_t headerEnd)
     {
         OPTICK_EVENT()
         ecs::entity_t current_pipeline{};
         ecs::entity_t prevBundle = 0;
 
-        for (auto & h: ids.headers) {
+        auto features = world->getSingleton<RenderFeatures>();
+        const bool use_count =
+            buffers.countBuffer != VK_NULL_HANDLE && features && features->indirectCount();
+        const bool multi_draw = features && features->multiDrawIndirect;
+        // CPU built commands can be drawn directly instead, GPU built ones are only made when the
+        // feature is there
+        const bool indirect =
+            (features && features->drawIndirectFirstInstance) || ids.commands.empty();
+
+        headerEnd = std::min(headerEnd, static_cast<uint32_t>(ids.headers.size()));
+        for (uint32_t hi = headerBegin; hi < headerEnd; hi++) {
+            auto & h = ids.headers[hi];
             OPTICK_EVENT("IDS Header")
             if (h.commandCount == 0) {
                 continue;
@@ -269,23 +1017,69 @@ namespace RxEngine
                         VK_SHADER_STAGE_VERTEX_BIT, 0,
                         sizeof(bund->address), &bund->address
                     );
+                    buf->pushConstant(
+                        VK_SHADER_STAGE_VERTEX_BIT, 32,
+                        sizeof(bund->positionAddress), &bund->positionAddress
+                    );
                     {
                         OPTICK_EVENT("Bind IB")
-                        buf->bindIndexBuffer(bund->indexBuffer);
+                        vkCmdBindIndexBuffer(
+                            buf->Handle(), bund->indexBuffer->handle(), 0,
+                            bund->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32
+                        );
                     }
                     prevBundle = h.bundle;
                 }
             }
             {
-                OPTICK_EVENT("Draw Indexed")
-                for (uint32_t i = 0; i < h.commandCount; i++) {
-                    auto & c = ids.commands[i + h.commandStart];
-                    drawCalls++;
-                    triangles += c.indexCount * c.instanceCount / 3;
-                    buf->DrawIndexed(
-                        c.indexCount, c.instanceCount, c.indexOffset, c.vertexOffset,
-                        c.instanceOffset
+                OPTICK_EVENT("Draw Indexed Indirect")
+                // Commands produced on the GPU don't have their instance counts available here,
+                // only CPU built sets contribute to the triangle count
+                if (!ids.commands.empty()) {
+                    for (uint32_t i = 0; i < h.commandCount; i++) {
+                        auto & c = ids.commands[i + h.commandStart];
+                        triangles += c.indexCount * c.instanceCount / 3;
+                    }
+                }
+                drawCalls += h.commandCount;
+
+                if (!indirect) {
+                    for (uint32_t i = 0; i < h.commandCount; i++) {
+                        auto & c = ids.commands[i + h.commandStart];
+                        buf->DrawIndexed(
+                            c.indexCount, c.instanceCount, c.indexOffset, c.vertexOffset,
+                            c.instanceOffset
+                        );
+                    }
+                    apiDrawCalls += h.commandCount;
+                } else if (use_count) {
+                    vkCmdDrawIndexedIndirectCount(
+                        buf->Handle(), buffers.indirectBuffer,
+                        buffers.indirectOffset + h.commandStart * sizeof(IndirectDrawCommand),
+                        buffers.countBuffer, buffers.countOffset + hi * sizeof(uint32_t),
+                        h.commandCount, sizeof(IndirectDrawCommand)
+                    );
+                    apiDrawCalls++;
+                } else if (multi_draw) {
+                    vkCmdDrawIndexedIndirect(
+                        buf->Handle(), buffers.indirectBuffer,
+                        buffers.indirectOffset + h.commandStart * sizeof(IndirectDrawCommand),
+                        h.commandCount,
+                        sizeof(IndirectDrawCommand)
                     );
+                    apiDrawCalls++;
+                } else {
+                    // Without multiDrawIndirect each call can only draw a single command
+                    for (uint32_t i = 0; i < h.commandCount; i++) {
+                        vkCmdDrawIndexedIndirect(
+                            buf->Handle(), buffers.indirectBuffer,
+                            buffers.indirectOffset +
+                            (h.commandStart + i) * sizeof(IndirectDrawCommand),
+                            1,
+                            sizeof(IndirectDrawCommand)
+                        );
+                    }
+                    apiDrawCalls += h.commandCount;
                 }
             }
         }
@@ -24,31 +24,74 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include <array>
+#include <deque>
+#include <limits>
 #include "Modules/Module.h"
+#include "Modules/Render.h"
 #include "DirectXCollision.h"
 #include "Modules/Renderer/Renderer.hpp"
+#include "RangeAllocator.h"
 #include "Vulkan/DescriptorSet.hpp"
 #include "Vulkan/IndexBuffer.hpp"
 
 namespace RxEngine
 {
+    class UploadService;
+
+    // Position stream entries are three floats with no padding
+    constexpr uint32_t position_stream_stride = 3 * sizeof(float);
+
+    struct MeshBundleEntry
+    {
+        ecs::entity_t mesh;
+        uint32_t vertexOffset;
+        uint32_t vertexCount;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+    };
+
+    // Vertex and index buffers shared by many meshes. Buffers start at a fraction of their limit
+    // and are replaced by larger copies as they fill, space of destroyed meshes is reused.
     struct MeshBundle
     {
         std::shared_ptr<RxCore::Buffer> vertexBuffer;
-        std::shared_ptr<RxCore::IndexBuffer> indexBuffer;
+        std::shared_ptr<RxCore::Buffer> indexBuffer;
         //std::shared_ptr<RxCore::DescriptorSet> descriptorSet;
 
         uint32_t vertexSize{};
+        // sizeof(uint16_t) or sizeof(uint32_t)
+        uint32_t indexSize{sizeof(uint32_t)};
+
+        // Vertices are quantized and drawn with the compact variant of a material's pipelines.
+        // Each mesh is preceded by headerVertices slots holding its dequantization bounds.
+        bool compact{};
+        uint32_t headerVertices{};
 
+        // In use
         uint32_t vertexCount{};
         uint32_t indexCount{};
 
+        // Current buffer capacity
         uint32_t maxIndexCount{};
         uint32_t maxVertexCount{};
 
+        // Capacity the buffers may grow to
+        uint32_t vertexLimit{};
+        uint32_t indexLimit{};
+
+        RangeAllocator vertexRanges{};
+        RangeAllocator indexRanges{};
+
         //bool useDescriptor{};
 
-        std::vector<ecs::entity_t> entries;
+        // Positions alone, indexed the same as the vertex buffer, for passes that need nothing
+        // else. Read by the shadow shaders through the push constant at offset 32.
+        bool positionStream{};
+        std::shared_ptr<RxCore::Buffer> positionBuffer;
+        uint64_t positionAddress{};
+
+        std::vector<MeshBundleEntry> entries;
         uint64_t address;
     };
 
@@ -62,6 +105,51 @@ namespace RxEngine
         //DirectX::BoundingSphere boundSphere;
 
         std::vector<ecs::entity_t> subMeshes;
+        // UploadService ticket for the vertex and index data
+        uint64_t uploadTicket{};
+    };
+
+    constexpr uint32_t max_mesh_lods = 4;
+
+    // Lower detail versions of a mesh, set on the full detail mesh. meshes[i] is drawn as level
+    // i + 1 once the mesh's bounding sphere covers less than coverage[i] of the screen height.
+    // Levels are ordered by decreasing coverage and have the same submeshes as the full mesh.
+    struct MeshLods
+    {
+        uint32_t count{};
+        std::array<ecs::entity_t, max_mesh_lods - 1> meshes{};
+        std::array<float, max_mesh_lods - 1> coverage{};
+    };
+
+    // "RXCL" cluster files written by the importer next to a mesh
+    constexpr uint32_t mesh_cluster_magic = 0x4c435852;
+    constexpr uint32_t mesh_cluster_version = 1;
+
+    // A run of at most 124 triangles of one submesh. firstIndex is relative to the mesh like a
+    // submesh's. The sphere and normal cone are in mesh space, coneCutoff is the sine of the
+    // cone's half angle and 1 when the cluster can't be back face culled as a whole.
+    struct MeshCluster
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t subMeshIndex;
+        float radius;
+        DirectX::XMFLOAT3 center;
+        float coneCutoff;
+        DirectX::XMFLOAT3 coneAxis;
+        uint32_t pad;
+    };
+
+    static_assert(sizeof(MeshCluster) == 48);
+
+    struct MeshClusters
+    {
+        std::vector<MeshCluster> clusters;
+    };
+
+    // Added once a mesh's data has been copied into its bundle, submeshes aren't drawn before
+    struct MeshResident
+    {
     };
 
     struct SubMesh
@@ -79,6 +167,11 @@ namespace RxEngine
     {
     };
 
+    // A level of detail generated into the bundle range of the mesh it relates to
+    struct LodOf : ecs::Relation
+    {
+    };
+
     struct UsesMaterial : ecs::Relation
     {
     };
@@ -102,9 +195,56 @@ namespace RxEngine
         uint32_t count;
         std::vector<std::shared_ptr<RxCore::Buffer>> buffers;
         std::vector<uint32_t> sizes;
+        std::vector<std::shared_ptr<RxCore::Buffer>> indirectBuffers;
+        std::vector<uint32_t> indirectSizes;
         uint32_t ix;
     };
 
+    // Where an instance list and its indirect commands were written for a draw, either
+    // sub-allocations of the upload ring or buffers owned by the caller
+    struct IndirectDrawBuffers
+    {
+        uint64_t instanceAddress;
+        VkBuffer indirectBuffer;
+        VkDeviceSize indirectOffset;
+        VkBuffer countBuffer;
+        VkDeviceSize countOffset;
+    };
+
+    struct InstanceSlot
+    {
+        uint32_t slot;
+    };
+
+    // Device local transforms for every placed entity, indexed by InstanceSlot. Slots are stable
+    // for the life of the entity and only transforms that changed are copied in each frame.
+    struct InstanceTable
+    {
+        std::shared_ptr<RxCore::Buffer> buffer;
+        uint64_t address{};
+        uint32_t capacity{};
+        uint32_t slotCount{};
+        uint32_t uploadCount{};
+    };
+
+    void createBundleBuffers(RxCore::Device * device,
+                             MeshBundle * bundle,
+                             uint32_t vertexCapacity,
+                             uint32_t indexCapacity);
+    // Capacity a bundle starts at, or resizes to when holding the given number of elements
+    uint32_t bundleCapacityFor(uint32_t used, uint32_t limit);
+    void uploadBundlePositions(UploadService * uploads,
+                               const MeshBundle * bundle,
+                               const MeshBundleEntry & range,
+                               const std::vector<DirectX::XMFLOAT3> & positions);
+    bool allocateBundleRanges(RxCore::Device * device,
+                              UploadService * uploads,
+                              MeshBundle * bundle,
+                              ecs::entity_t mesh,
+                              uint32_t vertexCount,
+                              uint32_t indexCount,
+                              MeshBundleEntry & entry);
+
     class MeshModule final : public Module
     {
     public:
@@ -116,13 +256,64 @@ namespace RxEngine
         void shutdown() override;
 
         static void renderIndirectDraws(ecs::World * world,
-                                        IndirectDrawSet ids,
+                                        const IndirectDrawSet & ids,
                                         const std::shared_ptr<RxCore::SecondaryCommandBuffer> & buf,
-                                        uint32_t & triangles, uint32_t & drawCalls);
-        static void drawInstances(std::shared_ptr<RxCore::Buffer> instanceBuffer,
+                                        const IndirectDrawBuffers & buffers,
+                                        uint32_t & triangles, uint32_t & drawCalls,
+                                        uint32_t & apiDrawCalls,
+                                        uint32_t headerBegin = 0,
+                                        uint32_t headerEnd = std::numeric_limits<uint32_t>::max());
+        static void drawInstances(const IndirectDrawBuffers & buffers,
                                   ecs::World * world,
                                   const GraphicsPipeline * pipeline,
                                   const PipelineLayout * const layout,
-                                  IndirectDrawSet & ids);
+                                  IndirectDrawSet & ids,
+                                  bool late = false);
+        // Writes the set's instances and commands to the upload ring, or to the next of the
+        // caller's rotating buffers when the ring is full this frame
+        static IndirectDrawBuffers createInstanceBuffer(EngineMain * engine,
+                                                        IndirectDrawSet & ids,
+                                                        InstanceBuffers & buffers);
+        static Render::ShadowRenderCommand drawShadowInstances(
+            const IndirectDrawBuffers & buffers,
+            ecs::World * world,
+            const GraphicsPipeline * pipeline,
+            const PipelineLayout * const layout,
+            const IndirectDrawSet & ids,
+            uint32_t cascadeIndex,
+            uint32_t shadowMapSize);
+
+    protected:
+        static Render::OpaqueRenderCommand recordInstances(
+            const IndirectDrawBuffers & buffers,
+            ecs::World * world,
+            const GraphicsPipeline * pipeline,
+            const PipelineLayout * const layout,
+            const IndirectDrawSet & ids,
+            uint32_t headerBegin,
+            uint32_t headerEnd);
+
+        bool updateInstanceSlot(ecs::EntityHandle e);
+        uint32_t allocateInstanceSlot(ecs::entity_t owner);
+        void growInstanceTable(uint32_t capacity);
+        void uploadInstanceTable();
+        void releaseInstanceSlots();
+        void releaseBundleRanges();
+
+    private:
+        ecs::queryid_t bundleQuery_{};
+
+        std::vector<ecs::entity_t> slotOwners_{};
+        std::vector<uint32_t> freeSlots_{};
+        std::vector<DirectX::XMFLOAT4X4> slotTransforms_{};
+        std::vector<uint8_t> slotDirty_{};
+        std::vector<uint32_t> dirtySlots_{};
+
+        std::vector<std::shared_ptr<RxCore::Buffer>> stagingBuffers_{};
+        std::vector<size_t> stagingSizes_{};
+        uint32_t stagingIx_{};
+
+        uint64_t frameNo_{};
+        std::deque<std::pair<uint64_t, std::shared_ptr<RxCore::Buffer>>> retiredTables_{};
     };
 }
@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include "RangeAllocator.h"
+
+namespace RxEngine
+{
+    RangeAllocator::RangeAllocator(uint32_t capacity)
+    {
+        reset(capacity);
+    }
+
+    uint32_t RangeAllocator::allocate(uint32_t count)
+    {
+        if (count == 0) {
+            return invalid;
+        }
+        for (auto it = free_.begin(); it != free_.end(); ++it) {
+            if (it->second < count) {
+                continue;
+            }
+            const uint32_t offset = it->first;
+            const uint32_t remaining = it->second - count;
+
+            free_.erase(it);
+            if (remaining > 0) {
+                free_.emplace(offset + count, remaining);
+            }
+            used_ += count;
+            return offset;
+        }
+        return invalid;
+    }
+
+    void RangeAllocator::release(uint32_t offset, uint32_t count)
+    {
+        if (count == 0) {
+            return;
+        }
+        assert(offset + count <= capacity_);
+        assert(used_ >= count);
+        used_ -= count;
+
+        auto next = free_.lower_bound(offset);
+        if (next != free_.begin()) {
+            auto prev = std::prev(next);
+            assert(prev->first + prev->second <= offset);
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                count += prev->second;
+                free_.erase(prev);
+            }
+        }
+        if (next != free_.end() && offset + count == next->first) {
+            count += next->second;
+            free_.erase(next);
+        }
+        free_.emplace(offset, count);
+    }
+
+    void RangeAllocator::grow(uint32_t capacity)
+    {
+        if (capacity <= capacity_) {
+            return;
+        }
+        const uint32_t old_capacity = capacity_;
+        const uint32_t added = capacity - capacity_;
+
+        // Released as used space so it merges with a free range at the old end
+        capacity_ = capacity;
+        used_ += added;
+        release(old_capacity, added);
+    }
+
+    void RangeAllocator::reset(uint32_t capacity)
+    {
+        free_.clear();
+        capacity_ = capacity;
+        used_ = 0;
+        if (capacity > 0) {
+            free_.emplace(0, capacity);
+        }
+    }
+
+    uint32_t RangeAllocator::getLargestFree() const
+    {
+        uint32_t largest = 0;
+        for (auto & [offset, count]: free_) {
+            largest = std::max(largest, count);
+        }
+        return largest;
+    }
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+
+namespace RxEngine
+{
+    // First fit allocator over [0, capacity) with adjacent free ranges merged on release. Works in
+    // elements rather than bytes, a mesh bundle keeps one for vertices and one for indices.
+    class RangeAllocator
+    {
+    public:
+        static constexpr uint32_t invalid = std::numeric_limits<uint32_t>::max();
+
+        explicit RangeAllocator(uint32_t capacity = 0);
+
+        uint32_t allocate(uint32_t count);
+        void release(uint32_t offset, uint32_t count);
+
+        // Adds the space between the old and new capacity as free
+        void grow(uint32_t capacity);
+        void reset(uint32_t capacity);
+
+        [[nodiscard]] uint32_t getCapacity() const
+        {
+            return capacity_;
+        }
+
+        [[nodiscard]] uint32_t getUsed() const
+        {
+            return used_;
+        }
+
+        [[nodiscard]] size_t getFreeRanges() const
+        {
+            return free_.size();
+        }
+
+        [[nodiscard]] uint32_t getLargestFree() const;
+
+    private:
+        // Offset to count
+        std::map<uint32_t, uint32_t> free_{};
+        uint32_t capacity_{};
+        uint32_t used_{};
+    };
+}
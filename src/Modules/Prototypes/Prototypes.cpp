@@ -108,6 +108,46 @@ namespace RxEngine
         }
     }
 
+    // Either a box given as {minx, miny, minz, maxx, maxy, maxz} or a triangle list given as a
+    // flat list of vertex positions and the indices into it
+    void loadOccluder(const sol::table & details, Occluder * o)
+    {
+        auto box = details.get<sol::optional<sol::table>>("box");
+        if (box.has_value()) {
+            const auto & b = box.value();
+            const float lo[3] = {b.get<float>(1), b.get<float>(2), b.get<float>(3)};
+            const float hi[3] = {b.get<float>(4), b.get<float>(5), b.get<float>(6)};
+
+            for (uint32_t i = 0; i < 8; i++) {
+                o->vertices.emplace_back(
+                    (i & 1) ? hi[0] : lo[0], (i & 2) ? hi[1] : lo[1], (i & 4) ? hi[2] : lo[2]
+                );
+            }
+            o->indices = {
+                0, 2, 1, 1, 2, 3, // -z
+                4, 5, 6, 5, 7, 6, // +z
+                0, 1, 4, 1, 5, 4, // -y
+                2, 6, 3, 3, 6, 7, // +y
+                0, 4, 2, 2, 4, 6, // -x
+                1, 3, 5, 3, 7, 5  // +x
+            };
+            return;
+        }
+
+        sol::table vertices = details.get<sol::table>("vertices");
+        sol::table indices = details.get<sol::table>("indices");
+
+        for (size_t i = 1; i + 2 <= vertices.size(); i += 3) {
+            o->vertices.emplace_back(vertices.get<float>(i), vertices.get<float>(i + 1), vertices.get<float>(i + 2));
+        }
+        for (size_t i = 1; i <= indices.size(); i++) {
+            const auto index = indices.get<uint32_t>(i);
+            assert(index < o->vertices.size());
+            o->indices.push_back(index);
+        }
+        o->indices.resize(o->indices.size() - o->indices.size() % 3);
+    }
+
     void loadVisible(ecs::World * world,
                      const std::string & visibleName,
                      const sol::table & details)
@@ -131,6 +171,13 @@ namespace RxEngine
                 vp->subMeshEntities.push_back(se);
             }
         });
+
+        auto occluder = details.get<sol::optional<sol::table>>("occluder");
+        if (occluder.has_value()) {
+            e.addAndUpdate<Occluder>([&](Occluder * o) {
+                loadOccluder(occluder.value(), o);
+            });
+        }
     }
 
     void loadVisibles(ecs::World * world, sol::table & visibles)
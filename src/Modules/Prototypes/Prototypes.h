@@ -11,6 +11,14 @@ namespace RxEngine
         std::vector<ecs::entity_t> subMeshEntities;
     };
 
+    // Simplified hull drawn into the CPU occlusion buffer for instances of a visible prototype,
+    // in mesh space and lying inside the meshes it stands in for
+    struct Occluder
+    {
+        std::vector<DirectX::XMFLOAT3> vertices;
+        std::vector<uint32_t> indices;
+    };
+
     struct Prototype
     {
         //ecs::entity_t visiblePrototype;
@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include <functional>
 #include <RxECS.h>
 #include "DirectXCollision.h"
 #include "SerialisationData.h"
@@ -72,6 +73,9 @@ namespace RxEngine
             std::shared_ptr<RxCore::SecondaryCommandBuffer> buf;
             uint32_t triangles;
             uint32_t drawCalls;
+            uint32_t apiDrawCalls;
+            // Drawn after the depth pyramid is built, with occlusion culling on
+            bool late{};
         };
 
         struct ShadowRenderCommand
@@ -79,9 +83,84 @@ namespace RxEngine
             std::shared_ptr<RxCore::SecondaryCommandBuffer> buf;
             uint32_t triangles;
             uint32_t drawCalls;
+            uint32_t apiDrawCalls;
             uint8_t cascadeIndex;
+            // Static casters, drawn into the shadow cache when the cascade is refreshed
+            bool cached;
         };
 
+        // Order compute commands are recorded in, whichever order their systems ran in. Uploads
+        // land first, then this frame's instance transforms, then the culling that reads both.
+        enum class ComputeStage : uint8_t
+        {
+            Upload,
+            InstanceTable,
+            Cull
+        };
+
+        // Work recorded straight into the primary command buffer ahead of any render pass,
+        // such as compute culling that produces indirect draw arguments for this frame
+        struct ComputeCommand
+        {
+            ComputeStage stage;
+            std::function<void(VkCommandBuffer)> record;
+        };
+
+        // Work recorded once this frame's depth pyramid is built and before the late opaque
+        // commands are drawn, given the pyramid's device address
+        struct OcclusionComputeCommand
+        {
+            std::function<void(VkCommandBuffer, uint64_t)> record;
+        };
+
+        // Counters of the pipeline statistics query the renderer keeps active over the frame.
+        // Only set when the device can inherit queries, as every secondary executed while it is
+        // active has to inherit it.
+        struct PipelineStatistics
+        {
+            VkQueryPipelineStatisticFlags flags;
+        };
+
+        // Begins a secondary for use inside the given subpass. RxCore's begin can't pass on the
+        // statistics query, so with one active the buffer is begun here instead. Returns whether
+        // it was, to be handed to endSecondary.
+        static bool beginSecondary(
+            ecs::World * world,
+            const std::shared_ptr<RxCore::SecondaryCommandBuffer> & buf,
+            VkRenderPass renderPass,
+            uint32_t subPass)
+        {
+            const auto statistics = world->getSingleton<PipelineStatistics>();
+            if (!statistics || statistics->flags == 0) {
+                buf->begin(renderPass, subPass);
+                return false;
+            }
+
+            VkCommandBufferInheritanceInfo cbii{};
+            cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            cbii.renderPass = renderPass;
+            cbii.subpass = subPass;
+            cbii.pipelineStatistics = statistics->flags;
+
+            VkCommandBufferBeginInfo cbbi{};
+            cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            cbbi.pInheritanceInfo = &cbii;
+
+            vkBeginCommandBuffer(buf->Handle(), &cbbi);
+            return true;
+        }
+
+        static void endSecondary(const std::shared_ptr<RxCore::SecondaryCommandBuffer> & buf, bool inherited)
+        {
+            if (inherited) {
+                vkEndCommandBuffer(buf->Handle());
+            } else {
+                buf->end();
+            }
+        }
+
 #if 0
         struct ShaderModule
         {
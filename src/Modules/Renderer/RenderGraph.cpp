@@ -0,0 +1,375 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "RenderGraph.h"
+
+#include <cassert>
+#include <sstream>
+
+namespace RxEngine
+{
+    namespace
+    {
+        std::string dotEscape(const std::string & s)
+        {
+            std::string escaped;
+            for (auto c: s) {
+                if (c == '"' || c == '\\') {
+                    escaped.push_back('\\');
+                }
+                escaped.push_back(c);
+            }
+            return escaped;
+        }
+    }
+
+    RenderGraph::PassBuilder & RenderGraph::PassBuilder::read(
+        RenderGraphResource resource,
+        VkPipelineStageFlags stages,
+        VkAccessFlags access,
+        VkImageLayout layout)
+    {
+        graph_->passes_[pass_].accesses.push_back({resource, stages, access, layout, layout, false, false});
+        return *this;
+    }
+
+    RenderGraph::PassBuilder & RenderGraph::PassBuilder::write(
+        RenderGraphResource resource,
+        VkPipelineStageFlags stages,
+        VkAccessFlags access,
+        VkImageLayout layout,
+        VkImageLayout exitLayout)
+    {
+        graph_->passes_[pass_].accesses.push_back(
+            {
+                resource, stages, access, layout,
+                exitLayout == VK_IMAGE_LAYOUT_UNDEFINED ? layout : exitLayout, true, false
+            }
+        );
+        return *this;
+    }
+
+    RenderGraph::PassBuilder & RenderGraph::PassBuilder::attachment(
+        RenderGraphResource resource,
+        VkPipelineStageFlags stages,
+        VkAccessFlags access,
+        VkImageLayout initialLayout,
+        VkImageLayout finalLayout,
+        bool write)
+    {
+        graph_->passes_[pass_].accesses.push_back(
+            {resource, stages, access, initialLayout, finalLayout, write, true}
+        );
+        return *this;
+    }
+
+    RenderGraph::PassBuilder & RenderGraph::PassBuilder::sideEffect()
+    {
+        graph_->passes_[pass_].sideEffect = true;
+        return *this;
+    }
+
+    void RenderGraph::reset()
+    {
+        resources_.clear();
+        passes_.clear();
+        schedule_.clear();
+    }
+
+    RenderGraphResource RenderGraph::importImage(
+        const std::string & name,
+        VkImage image,
+        VkImageAspectFlags aspect,
+        uint32_t layers,
+        VkImageLayout layout)
+    {
+        resources_.push_back({name, true, false, image, VK_NULL_HANDLE, aspect, layers, layout});
+        return static_cast<RenderGraphResource>(resources_.size() - 1);
+    }
+
+    RenderGraphResource RenderGraph::importBuffer(const std::string & name, VkBuffer buffer)
+    {
+        resources_.push_back({name, false, false, VK_NULL_HANDLE, buffer, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED});
+        return static_cast<RenderGraphResource>(resources_.size() - 1);
+    }
+
+    void RenderGraph::markOutput(RenderGraphResource resource)
+    {
+        resources_[resource].output = true;
+    }
+
+    RenderGraph::PassBuilder RenderGraph::addPass(
+        const std::string & name,
+        std::function<void(VkCommandBuffer)> execute)
+    {
+        passes_.push_back({name, std::move(execute), {}, {}, false, false});
+        return PassBuilder(this, static_cast<uint32_t>(passes_.size() - 1));
+    }
+
+    void RenderGraph::compile()
+    {
+        cullPasses();
+
+        schedule_.clear();
+        for (uint32_t p = 0; p < passes_.size(); p++) {
+            if (!passes_[p].culled) {
+                schedule_.push_back(p);
+            }
+        }
+
+        inferBarriers();
+    }
+
+    // Passes can only depend on those added before them, so walking back from the last pass
+    // finds everything the outputs need in one go
+    void RenderGraph::cullPasses()
+    {
+        std::vector<bool> needed(resources_.size());
+        for (uint32_t r = 0; r < resources_.size(); r++) {
+            needed[r] = resources_[r].output;
+        }
+
+        for (auto p = static_cast<int32_t>(passes_.size()) - 1; p >= 0; p--) {
+            auto & pass = passes_[p];
+
+            bool keep = pass.sideEffect;
+            for (auto & a: pass.accesses) {
+                keep = keep || (a.write && needed[a.resource]);
+            }
+            pass.culled = !keep;
+            if (!keep) {
+                continue;
+            }
+
+            // Writes aren't known to cover the whole resource, so whoever wrote it before is
+            // kept too
+            for (auto & a: pass.accesses) {
+                needed[a.resource] = true;
+            }
+        }
+    }
+
+    void RenderGraph::inferBarriers()
+    {
+        struct State
+        {
+            VkPipelineStageFlags writeStages;
+            VkAccessFlags writeAccess;
+            bool writeAttachment;
+            VkPipelineStageFlags readStages;
+            bool readAttachment;
+            // What the last write has been made visible to
+            VkPipelineStageFlags visibleStages;
+            VkAccessFlags visibleAccess;
+            VkImageLayout layout;
+        };
+
+        std::vector<State> states(resources_.size());
+        for (uint32_t r = 0; r < resources_.size(); r++) {
+            states[r] = {0, 0, false, 0, true, 0, 0, resources_[r].initialLayout};
+        }
+
+        for (auto p: schedule_) {
+            auto & pass = passes_[p];
+            pass.barriers.clear();
+
+            for (auto & a: pass.accesses) {
+                auto & state = states[a.resource];
+                const bool image = resources_[a.resource].image;
+
+                const bool layout_change = image && a.layout != VK_IMAGE_LAYOUT_UNDEFINED &&
+                    a.layout != state.layout;
+
+                VkPipelineStageFlags src_stages = 0;
+                VkAccessFlags src_access = 0;
+                bool src_attachment = true;
+
+                if (a.write) {
+                    if (state.writeStages) {
+                        src_stages |= state.writeStages;
+                        src_access |= state.writeAccess;
+                        src_attachment = src_attachment && state.writeAttachment;
+                    }
+                    if (state.readStages) {
+                        src_stages |= state.readStages;
+                        src_attachment = src_attachment && state.readAttachment;
+                    }
+                } else if (state.writeStages &&
+                    ((a.stages & ~state.visibleStages) || (a.access & ~state.visibleAccess))) {
+                    src_stages |= state.writeStages;
+                    src_access |= state.writeAccess;
+                    src_attachment = state.writeAttachment;
+                }
+
+                // Render passes carry the dependencies of their attachments with the outside
+                const bool covered = a.attachment || (src_stages && src_attachment);
+
+                if (layout_change) {
+                    src_stages |= state.writeStages | state.readStages;
+                    src_access |= state.writeAccess;
+                    if (!src_stages) {
+                        src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                    }
+                }
+
+                if (layout_change || (src_stages && !covered)) {
+                    pass.barriers.push_back(
+                        {
+                            a.resource, src_stages, a.stages, src_access, a.access,
+                            layout_change ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED,
+                            layout_change ? a.layout : VK_IMAGE_LAYOUT_UNDEFINED
+                        }
+                    );
+                }
+
+                if (a.write) {
+                    state.writeStages = a.stages;
+                    state.writeAccess = a.access;
+                    state.writeAttachment = a.attachment;
+                    state.readStages = 0;
+                    state.readAttachment = true;
+                    state.visibleStages = 0;
+                    state.visibleAccess = 0;
+                } else {
+                    state.readStages |= a.stages;
+                    state.readAttachment = state.readAttachment && a.attachment;
+                    state.visibleStages |= a.stages;
+                    state.visibleAccess |= a.access;
+                }
+                if (a.exitLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                    state.layout = a.exitLayout;
+                }
+            }
+        }
+    }
+
+    void RenderGraph::execute(VkCommandBuffer buf) const
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+
+        for (auto p: schedule_) {
+            auto & pass = passes_[p];
+
+            if (!pass.barriers.empty()) {
+                image_barriers.clear();
+                buffer_barriers.clear();
+
+                VkMemoryBarrier mb{};
+                mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                VkPipelineStageFlags src_stages = 0;
+                VkPipelineStageFlags dst_stages = 0;
+
+                for (auto & b: pass.barriers) {
+                    auto & resource = resources_[b.resource];
+                    src_stages |= b.srcStages;
+                    dst_stages |= b.dstStages;
+
+                    if (b.oldLayout != b.newLayout) {
+                        assert(resource.imageHandle);
+
+                        VkImageMemoryBarrier imb{};
+                        imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                        imb.srcAccessMask = b.srcAccess;
+                        imb.dstAccessMask = b.dstAccess;
+                        imb.oldLayout = b.oldLayout;
+                        imb.newLayout = b.newLayout;
+                        imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                        imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                        imb.image = resource.imageHandle;
+                        imb.subresourceRange = {resource.aspect, 0, 1, 0, resource.layers};
+                        image_barriers.push_back(imb);
+                    } else if (resource.bufferHandle) {
+                        VkBufferMemoryBarrier bmb{};
+                        bmb.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                        bmb.srcAccessMask = b.srcAccess;
+                        bmb.dstAccessMask = b.dstAccess;
+                        bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                        bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                        bmb.buffer = resource.bufferHandle;
+                        bmb.offset = 0;
+                        bmb.size = VK_WHOLE_SIZE;
+                        buffer_barriers.push_back(bmb);
+                    } else {
+                        mb.srcAccessMask |= b.srcAccess;
+                        mb.dstAccessMask |= b.dstAccess;
+                    }
+                }
+
+                const uint32_t memory_barriers = mb.srcAccessMask || mb.dstAccessMask ? 1 : 0;
+                vkCmdPipelineBarrier(
+                    buf, src_stages, dst_stages, 0,
+                    memory_barriers, &mb,
+                    static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+                    static_cast<uint32_t>(image_barriers.size()), image_barriers.data()
+                );
+            }
+
+            pass.execute(buf);
+        }
+    }
+
+    std::string RenderGraph::dot() const
+    {
+        std::ostringstream os;
+
+        os << "digraph RenderGraph {\n";
+        os << "    rankdir=LR;\n";
+
+        for (uint32_t r = 0; r < resources_.size(); r++) {
+            auto & resource = resources_[r];
+            os << "    r" << r << " [label=\"" << dotEscape(resource.name) << "\", shape="
+                << (resource.image ? "ellipse" : "cylinder");
+            if (resource.output) {
+                os << ", peripheries=2";
+            }
+            os << "];\n";
+        }
+
+        for (uint32_t p = 0; p < passes_.size(); p++) {
+            auto & pass = passes_[p];
+            os << "    p" << p << " [label=\"" << dotEscape(pass.name);
+            if (!pass.barriers.empty()) {
+                os << "\\n" << pass.barriers.size() << " barrier" << (pass.barriers.size() > 1 ? "s" : "");
+            }
+            os << "\", shape=box";
+            if (pass.culled) {
+                os << ", style=dashed, color=gray";
+            }
+            os << "];\n";
+
+            for (auto & a: pass.accesses) {
+                if (a.write) {
+                    os << "    p" << p << " -> r" << a.resource << ";\n";
+                } else {
+                    os << "    r" << a.resource << " -> p" << p << ";\n";
+                }
+            }
+        }
+
+        os << "}\n";
+        return os.str();
+    }
+}
@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace RxEngine
+{
+    using RenderGraphResource = uint32_t;
+
+    // How a pass uses a resource. Images are expected in layout when the pass starts, undefined
+    // when their contents don't matter, and left in exitLayout.
+    struct RenderGraphAccess
+    {
+        RenderGraphResource resource;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        VkImageLayout exitLayout;
+        bool write;
+        // Synchronised by the subpass dependencies of the render pass it is an attachment of
+        bool attachment;
+    };
+
+    struct RenderGraphBarrier
+    {
+        RenderGraphResource resource;
+        VkPipelineStageFlags srcStages;
+        VkPipelineStageFlags dstStages;
+        VkAccessFlags srcAccess;
+        VkAccessFlags dstAccess;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+    };
+
+    // The passes of a frame and the images and buffers they read and write, in the order they
+    // are added. Compiling culls the passes nothing needs and works out the barriers between the
+    // rest. Every resource is owned outside the graph and imported each frame. Nothing here
+    // touches the device until the graph is executed into a command buffer.
+    class RenderGraph
+    {
+    public:
+        class PassBuilder
+        {
+        public:
+            PassBuilder & read(
+                RenderGraphResource resource,
+                VkPipelineStageFlags stages,
+                VkAccessFlags access,
+                VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+            PassBuilder & write(
+                RenderGraphResource resource,
+                VkPipelineStageFlags stages,
+                VkAccessFlags access,
+                VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED,
+                VkImageLayout exitLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+            // A render pass attachment, the render pass moves it from initialLayout to finalLayout
+            PassBuilder & attachment(
+                RenderGraphResource resource,
+                VkPipelineStageFlags stages,
+                VkAccessFlags access,
+                VkImageLayout initialLayout,
+                VkImageLayout finalLayout,
+                bool write = true);
+
+            // Kept even when nothing reads what it writes
+            PassBuilder & sideEffect();
+
+        private:
+            friend class RenderGraph;
+
+            PassBuilder(RenderGraph * graph, uint32_t pass)
+                : graph_(graph)
+                , pass_(pass) {}
+
+            RenderGraph * graph_;
+            uint32_t pass_;
+        };
+
+        // Clears the graph for the next frame, keeping its storage
+        void reset();
+
+        RenderGraphResource importImage(
+            const std::string & name,
+            VkImage image,
+            VkImageAspectFlags aspect,
+            uint32_t layers,
+            VkImageLayout layout);
+
+        // Without a buffer its barriers are global memory barriers, for when the passes writing
+        // it don't say which buffers they use
+        RenderGraphResource importBuffer(const std::string & name, VkBuffer buffer);
+
+        // Passes writing an output are kept, along with everything they depend on
+        void markOutput(RenderGraphResource resource);
+
+        PassBuilder addPass(const std::string & name, std::function<void(VkCommandBuffer)> execute);
+
+        void compile();
+
+        void execute(VkCommandBuffer buf) const;
+
+        [[nodiscard]] const std::vector<uint32_t> & schedule() const
+        {
+            return schedule_;
+        }
+
+        [[nodiscard]] const std::vector<RenderGraphBarrier> & barriers(uint32_t pass) const
+        {
+            return passes_[pass].barriers;
+        }
+
+        [[nodiscard]] bool culled(uint32_t pass) const
+        {
+            return passes_[pass].culled;
+        }
+
+        [[nodiscard]] const std::string & passName(uint32_t pass) const
+        {
+            return passes_[pass].name;
+        }
+
+        [[nodiscard]] std::string dot() const;
+
+    private:
+        struct Resource
+        {
+            std::string name;
+            bool image;
+            bool output;
+            VkImage imageHandle;
+            VkBuffer bufferHandle;
+            VkImageAspectFlags aspect;
+            uint32_t layers;
+            VkImageLayout initialLayout;
+        };
+
+        struct Pass
+        {
+            std::string name;
+            std::function<void(VkCommandBuffer)> execute;
+            std::vector<RenderGraphAccess> accesses;
+            std::vector<RenderGraphBarrier> barriers;
+            bool sideEffect;
+            bool culled;
+        };
+
+        void cullPasses();
+        void inferBarriers();
+
+        std::vector<Resource> resources_;
+        std::vector<Pass> passes_;
+        std::vector<uint32_t> schedule_;
+    };
+}
@@ -23,6 +23,8 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <fstream>
 #include <memory>
 #include "Renderer.hpp"
 #include "Vulkan/Queue.hpp"
@@ -33,6 +35,7 @@
 #include "EngineMain.hpp"
 #include "Modules/Render.h"
 #include "Modules/SceneCamera/SceneCamera.h"
+#include "Modules/Lighting/Lighting.h"
 #include "Vulkan/ThreadResources.h"
 #include "Modules/SwapChain/SwapChain.h"
 
@@ -60,12 +63,16 @@ namespace RxEngine
 
     void Renderer::startup()
     {
+        occlusionCulling_ = engine_->getBoolConfigValue("render", "occlusionCulling", false);
+        dumpRenderGraph_ = engine_->getBoolConfigValue("render", "dumpRenderGraph", false);
+
         createRenderPass();
         createDepthRenderPass();
+        ensureShadowImages(SHADOW_MAP_SIZE, NUM_CASCADES);
 
         descriptorPool = engine_->getDevice()->CreateDescriptorPool(
             {
-                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 15000},
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 25000},
                 {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 600},
                 {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         600},
                 {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         800}
@@ -82,11 +89,33 @@ namespace RxEngine
             }
         );
 
+        // What the physical device supports. Each also has to have been enabled when RxCore
+        // created the device, so each can be turned off from the config.
+        const auto device_info = engine_->getDeviceInfo();
+        world_->setSingleton<RenderFeatures>(
+            {
+                device_info->drawIndirectCount() &&
+                engine_->getBoolConfigValue("render", "drawIndirectCount", true),
+                device_info->multiDrawIndirect() &&
+                engine_->getBoolConfigValue("render", "multiDrawIndirect", true),
+                device_info->drawIndirectFirstInstance() &&
+                engine_->getBoolConfigValue("render", "drawIndirectFirstInstance", true)
+            }
+        );
+
+        // Occlusion culling tests against last frame's pyramid, so there is nothing to test
+        // against until one has been built
+        if (occlusionCulling_) {
+            world_->setSingleton<HiZPyramid>({0, {}, false});
+        }
+
         world_->addSingleton<FrameStats>();
         {
             auto fs = world_->getSingletonUpdate<FrameStats>();
             fs->frameNo = 0;
             fs->index = 0;
+            fs->occlusionTested = 0;
+            fs->occlusionCulled = 0;
             fs->frames.resize(10);
         }
         //createPipelineLayout();
@@ -101,14 +130,41 @@ namespace RxEngine
 
         graphicsCommandPool_ = device_->CreateGraphicsCommandPool();
 
+        // Each frame writes its queries to its own slot, which is read back when the slot comes
+        // round again and the GPU is long done with it
         VkQueryPoolCreateInfo qpci{};
 
         qpci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
         qpci.queryType = VK_QUERY_TYPE_TIMESTAMP;
-        qpci.queryCount = 128;
+        qpci.queryCount = GPU_QUERY_FRAMES * gpu_queries_per_frame;
 
         vkCreateQueryPool(device_->getDevice(), &qpci, nullptr, &queryPool_);
         //        queryPool_ = device_->getDevice().createQueryPool(qpci);
+
+        // Nanoseconds per tick, from the physical device's limits
+        timestampPeriod_ = engine_->getTimestampPeriod();
+
+        // Needs the pipelineStatisticsQuery and inheritedQueries features enabled when the device
+        // is created. The query spans the whole frame, the draws all being in secondaries that
+        // inherit it.
+        if (engine_->getBoolConfigValue("render", "pipelineStatistics", false)) {
+            if (device_info->pipelineStatisticsQuery() && device_info->inheritedQueries()) {
+                VkQueryPoolCreateInfo spci{};
+
+                spci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+                spci.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+                spci.queryCount = GPU_QUERY_FRAMES;
+                spci.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+                    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+                    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+                vkCreateQueryPool(device_->getDevice(), &spci, nullptr, &statisticsPool_);
+                world_->setSingleton<Render::PipelineStatistics>({spci.pipelineStatistics});
+            } else {
+                spdlog::warn("Pipeline statistics need pipelineStatisticsQuery and inheritedQueries");
+            }
+        }
 #if 0
         for (uint32_t i = 0; i < 20; i++) {
             auto b = RxCore::iVulkan()->createBuffer(
@@ -131,11 +187,14 @@ namespace RxEngine
                   //.before<PresentImage>()
               .withStream<MainRenderImageInput>()
               .withWrite<MainRenderImageOutput>()
+              .withRead<ShadowCascadeData>()
+              .withWrite<HiZPyramid>()
               .execute<MainRenderImageInput>(
                   [this](ecs::World * world, const MainRenderImageInput * mri) {
                       render(
                           mri->imageView,
                           mri->extent,
+                          mri->swapChainGeneration,
                           {mri->imageAvailableSempahore},
                           {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT},
                           mri->finishRenderSemaphore
@@ -170,17 +229,56 @@ namespace RxEngine
               .executeIfNone(
                   [this](ecs::World * world) {
                       auto pl = world_->lookup("layout/general").get<PipelineLayout>();
-                      auto ds0x_ = descriptorPool->allocateDescriptorSet(pl->dsls[0], pl->counts);
                       //                  auto ds0_ = //RxCore::threadResources.getDescriptorSet(
                       //                    poolTemplate,
                       //                  pl->dsls[0], {1});
 
-                      auto e = world->newEntity();
-                      e.addAndUpdate<DescriptorSet>([&](DescriptorSet * x){
-                          x->ds = ds0x_;
-                      });
+                      for (auto & set: mainDescriptorSets_) {
+                          auto ds0x_ = descriptorPool->allocateDescriptorSet(pl->dsls[0], pl->counts);
 
-                      world->setSingleton<CurrentMainDescriptorSet>({e.id});
+                          auto e = world->newEntity();
+                          e.addAndUpdate<DescriptorSet>([&](DescriptorSet * x){
+                              x->ds = ds0x_;
+                          });
+                          set = e.id;
+                      }
+
+                      world->setSingleton<CurrentMainDescriptorSet>({mainDescriptorSets_[0]});
+                  }
+              );
+
+        // A set comes round again MAIN_DESCRIPTOR_SETS frames after it was last bound, the same
+        // window replaced buffers and images are kept for, so it can be written before this frame
+        // records with it
+        world_->createSystem("Renderer:SelectMainDescriptor")
+              .inGroup("Pipeline:PreFrame")
+              .withRead<FrameStats>()
+              .withWrite<CurrentMainDescriptorSet>()
+              .execute(
+                  [this](ecs::World * world) {
+                      if (mainDescriptorSets_[0] == 0) {
+                          return;
+                      }
+                      auto frame_no = world->getSingleton<FrameStats>()->frameNo;
+                      world->setSingleton<CurrentMainDescriptorSet>(
+                          {mainDescriptorSets_[frame_no % MAIN_DESCRIPTOR_SETS]});
+                  }
+              );
+
+        world_->createSystem("Renderer:SetShadowMapDescriptor")
+              .inGroup("Pipeline:PreFrame")
+              .withQuery<DescriptorSet>()
+              .without<ShadowMapDescriptor>()
+              .each<DescriptorSet>(
+                  [this](ecs::EntityHandle e, DescriptorSet * ds) {
+                      ds->ds->updateDescriptor(
+                          2,
+                          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                          wholeShadowMapView_,
+                          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                          shadowSampler_);
+
+                      e.addDeferred<ShadowMapDescriptor>();
                   }
               );
 
@@ -188,6 +286,94 @@ namespace RxEngine
     }
 
     void Renderer::createDepthRenderPass()
+    {
+        depthRenderPass_ = createDepthOnlyRenderPass(
+            VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            {
+                {
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_DEPENDENCY_BY_REGION_BIT
+                },
+                {
+                    0,
+                    VK_SUBPASS_EXTERNAL,
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_DEPENDENCY_BY_REGION_BIT
+                }
+            }
+        );
+
+        // Static casters are drawn into the cache and left ready to be copied from
+        staticDepthRenderPass_ = createDepthOnlyRenderPass(
+            VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            {
+                {
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    0
+                },
+                {
+                    0,
+                    VK_SUBPASS_EXTERNAL,
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT,
+                    0
+                }
+            }
+        );
+
+        // Dynamic casters are drawn over a copy of the cache
+        depthLoadRenderPass_ = createDepthOnlyRenderPass(
+            VK_ATTACHMENT_LOAD_OP_LOAD,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            {
+                {
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    0
+                },
+                {
+                    0,
+                    VK_SUBPASS_EXTERNAL,
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_DEPENDENCY_BY_REGION_BIT
+                }
+            }
+        );
+    }
+
+    VkRenderPass Renderer::createDepthOnlyRenderPass(
+        VkAttachmentLoadOp loadOp,
+        VkImageLayout initialLayout,
+        VkImageLayout finalLayout,
+        const std::vector<VkSubpassDependency> & spd) const
     {
         std::vector<VkAttachmentDescription> ad = {
             {
@@ -195,12 +381,12 @@ namespace RxEngine
                 device_->GetDepthFormat(true),
 
                 VK_SAMPLE_COUNT_1_BIT,
-                VK_ATTACHMENT_LOAD_OP_CLEAR,
+                loadOp,
                 VK_ATTACHMENT_STORE_OP_STORE,
                 VK_ATTACHMENT_LOAD_OP_DONT_CARE,
                 VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                initialLayout,
+                finalLayout
             }
         };
 
@@ -227,27 +413,6 @@ namespace RxEngine
             }
         };
 
-        std::vector<VkSubpassDependency> spd = {
-            {
-                VK_SUBPASS_EXTERNAL,
-                0,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                VK_DEPENDENCY_BY_REGION_BIT
-            },
-            {
-                0,
-                VK_SUBPASS_EXTERNAL,
-                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_DEPENDENCY_BY_REGION_BIT
-            }
-        };
-
         VkRenderPassCreateInfo rpci{};
         rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
         rpci.attachmentCount = static_cast<uint32_t>(ad.size());
@@ -256,14 +421,102 @@ namespace RxEngine
         rpci.pSubpasses = sp.data();
         rpci.dependencyCount = static_cast<uint32_t>(spd.size());
         rpci.pDependencies = spd.data();
-        //rpci.setAttachments(ad).setSubpasses(sp).setDependencies(spd);
 
-        vkCreateRenderPass(device_->getDevice(), &rpci, nullptr, &depthRenderPass_);
-        //auto rph = device_->getDevice().createRenderPass(rpci);
-        //depthRenderPass_ = rph;
+        VkRenderPass rp;
+        vkCreateRenderPass(device_->getDevice(), &rpci, nullptr, &rp);
+        return rp;
     }
 
     void Renderer::createRenderPass()
+    {
+        const VkSubpassDependency color_dependency{
+            VK_SUBPASS_EXTERNAL,
+            0,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            {},
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_DEPENDENCY_BY_REGION_BIT
+        };
+
+        if (!occlusionCulling_) {
+            renderPass_ = createMainRenderPass(
+                VK_ATTACHMENT_LOAD_OP_CLEAR,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                {color_dependency}
+            );
+            return;
+        }
+
+        // The opaque depth is kept to be copied into the depth pyramid
+        renderPass_ = createMainRenderPass(
+            VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ATTACHMENT_STORE_OP_STORE,
+            {
+                color_dependency,
+                {
+                    0,
+                    VK_SUBPASS_EXTERNAL,
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT,
+                    0
+                }
+            }
+        );
+
+        // Late opaque draws and the UI carry on over both attachments once the pyramid is built.
+        // Compatible with renderPass_, so its pipelines and frame buffers are used as they are.
+        lateRenderPass_ = createMainRenderPass(
+            VK_ATTACHMENT_LOAD_OP_LOAD,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            {
+                {
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_DEPENDENCY_BY_REGION_BIT
+                },
+                {
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                    0,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    0
+                }
+            }
+        );
+    }
+
+    VkRenderPass Renderer::createMainRenderPass(
+        VkAttachmentLoadOp loadOp,
+        VkImageLayout colorInitialLayout,
+        VkImageLayout colorFinalLayout,
+        VkImageLayout depthInitialLayout,
+        VkImageLayout depthFinalLayout,
+        VkAttachmentStoreOp depthStoreOp,
+        const std::vector<VkSubpassDependency> & spd) const
     {
         auto imageFormat = device_->getSwapChainFormat();
 
@@ -273,23 +526,23 @@ namespace RxEngine
                 //VK_FORMAT_R8G8B8A8_UNORM, // imageFormat,
                 imageFormat,
                 VK_SAMPLE_COUNT_1_BIT,
-                VK_ATTACHMENT_LOAD_OP_CLEAR,
+                loadOp,
                 VK_ATTACHMENT_STORE_OP_STORE,
                 VK_ATTACHMENT_LOAD_OP_DONT_CARE,
                 VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR // ! important
+                colorInitialLayout,
+                colorFinalLayout // ! important
             },
             {
                 {},
                 device_->GetDepthFormat(false),
                 VK_SAMPLE_COUNT_1_BIT,
-                VK_ATTACHMENT_LOAD_OP_CLEAR,
-                VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                loadOp,
+                depthStoreOp,
                 VK_ATTACHMENT_LOAD_OP_DONT_CARE,
                 VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                depthInitialLayout,
+                depthFinalLayout
             }
         };
 
@@ -318,18 +571,6 @@ namespace RxEngine
             }
         };
 
-        std::vector<VkSubpassDependency> spd = {
-            {
-                VK_SUBPASS_EXTERNAL,
-                0,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                {},
-                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                VK_DEPENDENCY_BY_REGION_BIT
-            }
-        };
         VkRenderPassCreateInfo rpci{};
         rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
         rpci.attachmentCount = static_cast<uint32_t>(ads.size());
@@ -339,7 +580,9 @@ namespace RxEngine
         rpci.dependencyCount = static_cast<uint32_t>(spd.size());
         rpci.pDependencies = spd.data();
 
-        vkCreateRenderPass(device_->getDevice(), &rpci, nullptr, &renderPass_);
+        VkRenderPass rp;
+        vkCreateRenderPass(device_->getDevice(), &rpci, nullptr, &rp);
+        return rp;
     }
 
     std::shared_ptr<const std::vector<RenderEntity>> Renderer::finishUpEntityJobs(
@@ -379,6 +622,7 @@ namespace RxEngine
         //const std::vector<IRenderable *> & subsystems,
         VkImageView imageView,
         VkExtent2D extent,
+        uint32_t swapChainGeneration,
         std::vector<VkSemaphore> waitSemaphores,
         std::vector<VkPipelineStageFlags> waitStages,
         VkSemaphore completeSemaphore)
@@ -388,7 +632,7 @@ namespace RxEngine
         const auto start_time = std::chrono::high_resolution_clock::now();
 
         ensureDepthBufferExists(extent);
-        ensureShadowImages(4096, NUM_CASCADES);
+        ensureShadowImages(SHADOW_MAP_SIZE, NUM_CASCADES);
 
         //   renderCamera->readyCameraFrame();
         //        lightingManager_->setup(renderCamera->getCamera());
@@ -490,101 +734,334 @@ namespace RxEngine
 
         uint32_t total_triangles = 0;
         uint32_t total_draws = 0;
+        uint32_t total_api_draws = 0;
+
+        bool pyramid_built = false;
+
+        const uint64_t frame_no = world_->getSingleton<FrameStats>()->frameNo + 1;
+        const uint32_t query_slot = static_cast<uint32_t>(frame_no % GPU_QUERY_FRAMES);
+        const uint32_t first_query = query_slot * gpu_queries_per_frame;
+
+        readGpuQueries(query_slot);
+
+        auto write_timestamp = [&](VkPipelineStageFlagBits stage, uint32_t query) {
+            vkCmdWriteTimestamp(buf->Handle(), stage, queryPool_, first_query + query);
+        };
+
+        auto frame_buffer = getRenderFrameBuffer(imageView, extent, swapChainGeneration);
+
+        VkClearValue clv{};
+        clv.depthStencil = {1.0f, ~0u};
+
+        std::vector<VkClearValue> depth_clear_values = {clv};
+
+        VkClearValue clv1{};
+        clv1.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        VkClearValue clv2{};
+        clv2.depthStencil = {1.0f, ~0u};
+
+        std::vector<VkClearValue> clear_values = {clv1, clv2};
+
+        auto execute_opaque = [&](bool late) {
+            world_->getStream<Render::OpaqueRenderCommand>()
+                  ->each<Render::OpaqueRenderCommand>(
+                      [&](ecs::World * w, const Render::OpaqueRenderCommand * b) {
+                          if (b->late != late) {
+                              return false;
+                          }
+                          total_draws += b->drawCalls;
+                          total_api_draws += b->apiDrawCalls;
+                          total_triangles += b->triangles;
+                          buf->executeSecondary(b->buf);
+                          return true;
+                      }
+                  );
+        };
+
+        auto execute_ui = [&]() {
+            world_->getStream<Render::GameUiRenderCommand>()
+                  ->each<Render::GameUiRenderCommand>(
+                      [&](ecs::World * w, const Render::GameUiRenderCommand * b) {
+                          total_draws += b->drawCalls;
+                          total_api_draws += b->drawCalls;
+                          total_triangles += b->triangles;
+                          buf->executeSecondary(b->buf);
+                          return true;
+                      }
+                  );
+            world_->getStream<Render::EngineUiRenderCommand>()
+                  ->each<Render::EngineUiRenderCommand>(
+                      [&](ecs::World * w, const Render::EngineUiRenderCommand * b) {
+                          total_draws += b->drawCalls;
+                          total_api_draws += b->drawCalls;
+                          total_triangles += b->triangles;
+                          buf->executeSecondary(b->buf);
+                          return true;
+                      }
+                  );
+        };
+
+        {
+            OPTICK_EVENT("Build Render Graph")
+            auto & graph = renderGraph_;
+            graph.reset();
+
+            // The compute commands, culling and uploads, don't say which buffers they write so
+            // their results are synchronised with global memory barriers
+            const auto compute_output = graph.importBuffer("Compute Output", VK_NULL_HANDLE);
+            const auto shadow_map = graph.importImage(
+                "Shadow Map", shadowMap_->handle_, VK_IMAGE_ASPECT_DEPTH_BIT, NUM_CASCADES,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+            );
+            // Only ever an attachment, so its handle is never needed for a barrier
+            const auto swap_chain = graph.importImage(
+                "Swap Chain", VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED
+            );
+            const auto depth = graph.importImage(
+                "Depth", depthBuffer_->handle_, VK_IMAGE_ASPECT_DEPTH_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED
+            );
+            graph.markOutput(swap_chain);
+
+            graph.addPass(
+                     "Compute", [&](VkCommandBuffer cb) {
+                         OPTICK_GPU_EVENT("Compute")
+                         // The producers run as separate systems, possibly as jobs, so the
+                         // stream's order says nothing. Each stage's trailing barrier covers the
+                         // stages recorded after it.
+                         for (auto stage: {
+                                  Render::ComputeStage::Upload,
+                                  Render::ComputeStage::InstanceTable,
+                                  Render::ComputeStage::Cull
+                              }) {
+                             world_->getStream<Render::ComputeCommand>()
+                                   ->each<Render::ComputeCommand>(
+                                       [&](ecs::World * w, const Render::ComputeCommand * c) {
+                                           if (c->stage != stage) {
+                                               return false;
+                                           }
+                                           c->record(cb);
+                                           return true;
+                                       }
+                                   );
+                         }
+                         write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassCompute + 1);
+                     }
+                 )
+                 .write(compute_output, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+            graph.addPass(
+                     "Shadows", [&](VkCommandBuffer cb) {
+                         OPTICK_GPU_EVENT("Shadow RenderPass")
+                         auto scd = world_->getSingleton<ShadowCascadeData>();
+                         const bool cached = scd && scd->cached;
+                         const uint32_t refresh_mask = scd ? scd->refreshMask : 0;
+
+                         // With caching, static casters go to the persistent cache only when their
+                         // cascade is refreshed, dynamic casters are drawn over a copy of it every frame
+                         auto execute_shadows = [&](uint32_t cascade, bool staticCasters) {
+                             OPTICK_EVENT("Execute Shadow Secondaries")
+                             world_->getStream<Render::ShadowRenderCommand>()
+                                   ->each<Render::ShadowRenderCommand>(
+                                       [&](ecs::World * w, const Render::ShadowRenderCommand * b) {
+                                           if (b->cascadeIndex != cascade) {
+                                               return false;
+                                           }
+                                           if (cached && b->cached != staticCasters) {
+                                               return false;
+                                           }
+                                           total_draws += b->drawCalls;
+                                           total_api_draws += b->apiDrawCalls;
+                                           total_triangles += b->triangles;
+                                           buf->executeSecondary(b->buf);
+                                           return true;
+                                       }
+                                   );
+                         };
+
+                         for (uint32_t i = 0; i < NUM_CASCADES; i++) {
+                             if (!cached) {
+                                 buf->beginRenderPass(
+                                     depthRenderPass_, cascadeFrameBuffers_[i],
+                                     VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, depth_clear_values
+                                 );
+                                 execute_shadows(i, true);
+                                 buf->executeSecondaries(static_cast<uint16_t>(1000 + i));
+                                 buf->EndRenderPass();
+                                 write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassCount + 1 + i);
+                                 continue;
+                             }
+
+                             if (refresh_mask & (1u << i)) {
+                                 buf->beginRenderPass(
+                                     staticDepthRenderPass_, staticCascadeFrameBuffers_[i],
+                                     VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, depth_clear_values
+                                 );
+                                 execute_shadows(i, true);
+                                 buf->EndRenderPass();
+                             }
+
+                             copyStaticCascade(cb, i);
+
+                             buf->beginRenderPass(
+                                 depthLoadRenderPass_, cascadeFrameBuffers_[i],
+                                 VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, depth_clear_values
+                             );
+                             execute_shadows(i, false);
+                             buf->executeSecondaries(static_cast<uint16_t>(1000 + i));
+                             buf->EndRenderPass();
+                             write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassCount + 1 + i);
+                         }
+                         write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassShadows + 1);
+                     }
+                 )
+                 .read(
+                     compute_output, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                     VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+                 )
+                 .attachment(
+                     shadow_map, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                 );
+
+            // With occlusion culling the opaque depth is kept to become the depth pyramid, what it
+            // rejected is tested again against it and the survivors drawn in a second pass
+            graph.addPass(
+                     "Opaque", [&](VkCommandBuffer) {
+                         OPTICK_GPU_EVENT("RenderPass")
+                         buf->beginRenderPass(renderPass_, frame_buffer, extent, clear_values);
+                         {
+                             OPTICK_EVENT("Execute Secondaries")
+
+                             execute_opaque(false);
+                             if (!occlusionCulling_) {
+                                 execute_ui();
+                             }
+                         }
+                         buf->EndRenderPass();
+                         write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassOpaque + 1);
+                         if (!occlusionCulling_) {
+                             write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassDepthPyramid + 1);
+                             write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassLate + 1);
+                         }
+                     }
+                 )
+                 .read(
+                     compute_output, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                     VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+                 )
+                 .read(
+                     shadow_map, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                 )
+                 .attachment(
+                     swap_chain, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                     VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                     occlusionCulling_
+                         ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                         : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+                 )
+                 .attachment(
+                     depth, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                     occlusionCulling_
+                         ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                         : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                 );
+
+            if (occlusionCulling_) {
+                const auto hiz = graph.importBuffer("Depth Pyramid", hiZBuffer_->handle());
+                const auto late_draws = graph.importBuffer("Late Draws", VK_NULL_HANDLE);
+                // Next frame's culling tests against it
+                graph.markOutput(hiz);
+
+                graph.addPass(
+                         "Depth Pyramid", [&](VkCommandBuffer cb) {
+                             OPTICK_GPU_EVENT("Depth Pyramid")
+                             pyramid_built = buildHiZPyramid(cb);
+
+                             if (pyramid_built) {
+                                 world_->getStream<Render::OcclusionComputeCommand>()
+                                       ->each<Render::OcclusionComputeCommand>(
+                                           [&](ecs::World * w, const Render::OcclusionComputeCommand * c) {
+                                               c->record(cb, hiZBuffer_->getDeviceAddress());
+                                               return true;
+                                           }
+                                       );
+                             }
+                             write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassDepthPyramid + 1);
+                         }
+                     )
+                     .read(
+                         depth, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                     )
+                     .write(
+                         hiz, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                     )
+                     .write(late_draws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+                graph.addPass(
+                         "Late Opaque", [&](VkCommandBuffer) {
+                             OPTICK_GPU_EVENT("Late RenderPass")
+                             buf->beginRenderPass(lateRenderPass_, frame_buffer, extent, clear_values);
+                             {
+                                 OPTICK_EVENT("Execute Late Secondaries")
+
+                                 execute_opaque(true);
+                                 execute_ui();
+                             }
+                             buf->EndRenderPass();
+                             write_timestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GpuPassLate + 1);
+                         }
+                     )
+                     .read(
+                         late_draws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+                     )
+                     .attachment(
+                         swap_chain, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                         VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+                     )
+                     .attachment(
+                         depth, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                     );
+            }
+
+            graph.compile();
+
+            if (dumpRenderGraph_) {
+                std::ofstream("rendergraph.dot") << graph.dot();
+                dumpRenderGraph_ = false;
+            }
+        }
 
-        std::shared_ptr<RxCore::FrameBuffer> frame_buffer;
-        frame_buffer = createRenderFrameBuffer(imageView, extent);
         {
             OPTICK_EVENT("Build Primary Buffer")
             buf->begin();
             OPTICK_GPU_CONTEXT(buf->Handle())
             {
-                vkCmdResetQueryPool(buf->Handle(), queryPool_, 0, 128);
+                vkCmdResetQueryPool(buf->Handle(), queryPool_, first_query, gpu_queries_per_frame);
                 //buf->Handle().resetQueryPool(queryPool_, 0, 128);
-                vkCmdWriteTimestamp(
-                    buf->Handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool_,
-                    0
-                );
+                if (statisticsPool_) {
+                    vkCmdResetQueryPool(buf->Handle(), statisticsPool_, query_slot, 1);
+                }
+                write_timestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
                 //                buf->Handle().writeTimestamp(VkPipelineStageFlagBits::eTopOfPipe, queryPool_, 0);
 
-                VkClearValue clv{};
-                clv.depthStencil = {1.0f, ~0u};
-
-                std::vector<VkClearValue> depth_clear_values = {clv};
-
-                {
-                    OPTICK_GPU_EVENT("Shadow RenderPass")
-                    for (uint32_t i = 0; i < NUM_CASCADES; i++) {
-                        buf->beginRenderPass(
-                            depthRenderPass_, cascadeFrameBuffers_[i],
-                            VkExtent2D{4096, 4096}, depth_clear_values
-                        );
-                        {
-                            OPTICK_EVENT("Execute Shadow Secondaries")
-                            world_->getStream<Render::ShadowRenderCommand>()
-                                  ->each<Render::ShadowRenderCommand>(
-                                      [&](ecs::World * w, const Render::ShadowRenderCommand * b) {
-                                          if(b->cascadeIndex != i){
-                                              return false;
-                                          }
-                                          total_draws += b->drawCalls;
-                                          total_triangles += b->triangles;
-                                          buf->executeSecondary(b->buf);
-                                          return true;
-                                      }
-                                  );
-
-                            buf->executeSecondaries(static_cast<uint16_t>(1000 + i));
-                        }
-                        buf->EndRenderPass();
-                    }
+                if (statisticsPool_) {
+                    vkCmdBeginQuery(buf->Handle(), statisticsPool_, query_slot, 0);
                 }
-                VkClearValue clv1{};
-                clv1.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-                VkClearValue clv2{};
-                clv2.depthStencil = {1.0f, ~0u};
 
-                std::vector<VkClearValue> clear_values = {clv1, clv2};
-                {
-                    OPTICK_GPU_EVENT("RenderPass")
-                    buf->beginRenderPass(renderPass_, frame_buffer, extent, clear_values);
-                    {
-                        OPTICK_EVENT("Execute Secondaries")
-
-                        world_->getStream<Render::OpaqueRenderCommand>()
-                              ->each<Render::OpaqueRenderCommand>(
-                                  [&](ecs::World * w, const Render::OpaqueRenderCommand * b) {
-                                      total_draws += b->drawCalls;
-                                      total_triangles += b->triangles;
-                                      buf->executeSecondary(b->buf);
-                                      return true;
-                                  }
-                              );
-
-                        world_->getStream<Render::GameUiRenderCommand>()
-                              ->each<Render::GameUiRenderCommand>(
-                                  [&](ecs::World * w, const Render::GameUiRenderCommand * b) {
-                                      total_draws += b->drawCalls;
-                                      total_triangles += b->triangles;
-                                      buf->executeSecondary(b->buf);
-                                      return true;
-                                  }
-                              );
-                        world_->getStream<Render::EngineUiRenderCommand>()
-                              ->each<Render::EngineUiRenderCommand>(
-                                  [&](ecs::World * w, const Render::EngineUiRenderCommand * b) {
-                                      total_draws += b->drawCalls;
-                                      total_triangles += b->triangles;
-                                      buf->executeSecondary(b->buf);
-                                      return true;
-                                  }
-                              );
-                    }
-                    buf->EndRenderPass();
+                renderGraph_.execute(buf->Handle());
+
+                if (statisticsPool_) {
+                    vkCmdEndQuery(buf->Handle(), statisticsPool_, query_slot);
                 }
-                vkCmdWriteTimestamp(
-                    buf->Handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool_,
-                    1
-                );
             }
             buf->end();
         }
@@ -595,6 +1072,25 @@ namespace RxEngine
                 {buf}, std::move(waitSemaphores), std::move(waitStages), {completeSemaphore}
             );
         }
+        gpuQueryFrames_[query_slot] = frame_no;
+
+        if (occlusionCulling_) {
+            auto scene_camera = world_->getSingleton<SceneCamera>();
+            HiZPyramid pyramid{0, {}, false};
+
+            if (pyramid_built && scene_camera) {
+                pyramid.address = hiZBuffer_->getDeviceAddress();
+                XMStoreFloat4x4(
+                    &pyramid.viewProjection,
+                    XMMatrixMultiply(
+                        XMLoadFloat4x4(&scene_camera->shaderData.view),
+                        XMLoadFloat4x4(&scene_camera->shaderData.projection)
+                    )
+                );
+                pyramid.valid = true;
+            }
+            world_->setSingleton<HiZPyramid>(pyramid);
+        }
 
         const auto end_time = std::chrono::high_resolution_clock::now();
         cpuTime = std::chrono::duration<double, std::milli>((end_time - start_time)).count();
@@ -603,7 +1099,26 @@ namespace RxEngine
         fs->index = (fs->index + 1) % 10;
         fs->frames[fs->index].cpuTime = static_cast<float>(cpuTime);
         fs->frames[fs->index].drawCalls = total_draws;
+        fs->frames[fs->index].apiDrawCalls = total_api_draws;
         fs->frames[fs->index].triangles = total_triangles;
+        fs->frames[fs->index].occlusionTested = fs->occlusionTested;
+        fs->frames[fs->index].occlusionCulled = fs->occlusionCulled;
+        fs->occlusionTested = 0;
+        fs->occlusionCulled = 0;
+        fs->frames[fs->index].gpuTime = gpuStats_.gpuTime;
+        fs->frames[fs->index].gpuPassTimes = gpuStats_.gpuPassTimes;
+        fs->frames[fs->index].pipelineStatistics = gpuStats_.pipelineStatistics;
+        fs->frames[fs->index].gpuCascadeTimes = gpuStats_.gpuCascadeTimes;
+        fs->frames[fs->index].vertexInvocations = gpuStats_.vertexInvocations;
+        fs->frames[fs->index].clippingPrimitives = gpuStats_.clippingPrimitives;
+        fs->frames[fs->index].fragmentInvocations = gpuStats_.fragmentInvocations;
+        fs->frames[fs->index].computeInvocations = gpuStats_.computeInvocations;
+
+        const auto upload_stats = engine_->getUploadRing()->getStats();
+        fs->frames[fs->index].uploadBytes = upload_stats.frameBytes;
+        fs->frames[fs->index].uploadInFlight = upload_stats.inFlightBytes;
+        fs->frames[fs->index].uploadPeak = upload_stats.peakInFlightBytes;
+        fs->frames[fs->index].uploadCapacity = upload_stats.capacity;
     }
 
 #if 0
@@ -637,10 +1152,24 @@ namespace RxEngine
     }
 #endif
 
-    std::shared_ptr<RxCore::FrameBuffer> Renderer::createRenderFrameBuffer(
+    // Frame buffers are kept per swap chain image view until the swap chain is replaced or the
+    // depth buffer they share changes
+    std::shared_ptr<RxCore::FrameBuffer> Renderer::getRenderFrameBuffer(
         const VkImageView & imageView,
-        const VkExtent2D & extent) const
+        const VkExtent2D & extent,
+        uint32_t swapChainGeneration)
     {
+        // A replacement swap chain can hand out the handles of the views it destroyed
+        if (swapChainGeneration != frameBufferGeneration_) {
+            frameBuffers_.clear();
+            frameBufferGeneration_ = swapChainGeneration;
+        }
+
+        auto it = frameBuffers_.find(imageView);
+        if (it != frameBuffers_.end()) {
+            return it->second;
+        }
+
         OPTICK_EVENT("Create Framebuffer")
         std::vector<VkImageView> attachments = {imageView, depthBufferView_->handle_};
 
@@ -658,6 +1187,7 @@ namespace RxEngine
         vkCreateFramebuffer(device_->getDevice(), &fbci, nullptr, &fb);
 
         auto frame_buffer = std::make_shared<RxCore::FrameBuffer>(device_, fb);
+        frameBuffers_.emplace(imageView, frame_buffer);
 
         return frame_buffer;
     }
@@ -689,11 +1219,17 @@ namespace RxEngine
     void Renderer::ensureDepthBufferExists(VkExtent2D & extent)
     {
         if (extent.height != bufferExtent_.height || extent.width != bufferExtent_.width) {
+            // Occlusion culling copies the depth out to build the pyramid from
+            VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            if (occlusionCulling_) {
+                usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            }
+
             depthBuffer_ = device_->createImage(
                 device_->GetDepthFormat(false),
                 {extent.width, extent.height, 1},
                 1, 1,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                usage
             );
 
             depthBufferView_ = device_->createImageView(
@@ -704,125 +1240,399 @@ namespace RxEngine
                 1
             );
             bufferExtent_ = extent;
+            frameBuffers_.clear();
+
+            if (occlusionCulling_) {
+                ensureHiZPyramid(extent);
+            }
+        }
+    }
+
+    void Renderer::ensureHiZPyramid(const VkExtent2D & extent)
+    {
+        // Level 0 is the largest power of two that fits in the depth buffer so each level
+        // halves exactly, and a screen position maps to the same texel at every level
+        auto previous_pow2 = [](uint32_t v) {
+            uint32_t p = 1;
+            while (p * 2 <= v) {
+                p *= 2;
+            }
+            return p;
+        };
+
+        hiZLevels_.clear();
+        uint32_t width = previous_pow2(extent.width);
+        uint32_t height = previous_pow2(extent.height);
+        uint32_t offset = 0;
+
+        while (hiZLevels_.size() < HIZ_MAX_LEVELS) {
+            hiZLevels_.push_back({width, height, offset});
+            offset += width * height;
+            if (width == 1 && height == 1) {
+                break;
+            }
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+        }
+
+        // The depth buffer is copied in after the levels
+        hiZDepthOffset_ = offset;
+
+        // The culling recorded for the frame in flight still points at the old pyramid
+        if (hiZBuffer_) {
+            retiredHiZBuffers_.emplace_back(world_->getSingleton<FrameStats>()->frameNo, hiZBuffer_);
+        }
+
+        hiZBuffer_ = device_->createBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            sizeof(HiZPyramidHeader) +
+            (static_cast<size_t>(offset) + static_cast<size_t>(extent.width) * extent.height) * sizeof(float)
+        );
+        hiZHeaderDirty_ = true;
+    }
+
+    bool Renderer::buildHiZPyramid(VkCommandBuffer buf)
+    {
+        auto frame_no = world_->getSingleton<FrameStats>()->frameNo;
+        while (!retiredHiZBuffers_.empty() &&
+            retiredHiZBuffers_.front().first + HIZ_RETIRE_FRAMES < frame_no) {
+            retiredHiZBuffers_.pop_front();
+        }
+
+        if (!hiZPipeline_.isAlive()) {
+            hiZPipeline_ = world_->lookup("compute/hiz_build");
+        }
+        auto pipeline = hiZPipeline_.get<ComputePipeline>();
+        if (!pipeline || !hiZBuffer_) {
+            return false;
+        }
+        const auto layout = hiZPipeline_.getRelated<UsesLayout, PipelineLayout>();
+
+        // Culling earlier in the frame reads the pyramid this is about to overwrite
+        vkCmdPipelineBarrier(
+            buf,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 0, nullptr
+        );
+
+        if (hiZHeaderDirty_) {
+            HiZPyramidHeader header{};
+            header.width = hiZLevels_[0].width;
+            header.height = hiZLevels_[0].height;
+            header.levels = static_cast<uint32_t>(hiZLevels_.size());
+            for (uint32_t i = 0; i < hiZLevels_.size(); i++) {
+                header.offsets[i] = hiZLevels_[i].offset;
+            }
+            vkCmdUpdateBuffer(buf, hiZBuffer_->handle(), 0, sizeof(HiZPyramidHeader), &header);
+            hiZHeaderDirty_ = false;
+        }
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = sizeof(HiZPyramidHeader) +
+            static_cast<VkDeviceSize>(hiZDepthOffset_) * sizeof(float);
+        region.imageSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+        region.imageExtent = {bufferExtent_.width, bufferExtent_.height, 1};
+
+        vkCmdCopyImageToBuffer(
+            buf,
+            depthBuffer_->handle_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            hiZBuffer_->handle(),
+            1, &region
+        );
+
+        VkMemoryBarrier mb{};
+        mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(
+            buf,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &mb, 0, nullptr, 0, nullptr
+        );
+
+        // The copy keeps the depth buffer's own texel encoding, the shader decodes it
+        uint32_t source = HiZSourceFloatDepth;
+        switch (device_->GetDepthFormat(false)) {
+            case VK_FORMAT_D16_UNORM:
+            case VK_FORMAT_D16_UNORM_S8_UINT:
+                source = HiZSourceUnorm16Depth;
+                break;
+            case VK_FORMAT_X8_D24_UNORM_PACK32:
+            case VK_FORMAT_D24_UNORM_S8_UINT:
+                source = HiZSourceUnorm24Depth;
+                break;
+            default:
+                break;
+        }
+
+        HiZBuildPushConstants pc{
+            hiZBuffer_->getDeviceAddress(),
+            hiZDepthOffset_, 0,
+            bufferExtent_.width, bufferExtent_.height,
+            0, 0,
+            source, 0
+        };
+
+        mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline->Handle());
+
+        for (uint32_t i = 0; i < hiZLevels_.size(); i++) {
+            if (i > 0) {
+                vkCmdPipelineBarrier(
+                    buf,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    0, 1, &mb, 0, nullptr, 0, nullptr
+                );
+                pc.srcOffset = hiZLevels_[i - 1].offset;
+                pc.srcWidth = hiZLevels_[i - 1].width;
+                pc.srcHeight = hiZLevels_[i - 1].height;
+                pc.source = HiZSourceLevel;
+            }
+            pc.dstOffset = hiZLevels_[i].offset;
+            pc.dstWidth = hiZLevels_[i].width;
+            pc.dstHeight = hiZLevels_[i].height;
+
+            vkCmdPushConstants(
+                buf, layout->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                sizeof(HiZBuildPushConstants), &pc
+            );
+            vkCmdDispatch(buf, (pc.dstWidth + 7) / 8, (pc.dstHeight + 7) / 8, 1);
+        }
+
+        // Read by the late culling now and the early culling next frame
+        vkCmdPipelineBarrier(
+            buf,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &mb, 0, nullptr, 0, nullptr
+        );
+
+        return true;
+    }
+
+    // Reads back what the frame that last used the slot wrote, without waiting. The slot is
+    // GPU_QUERY_FRAMES frames old by now so its results are there unless the GPU is that far
+    // behind, in which case the previous figures are kept.
+    void Renderer::readGpuQueries(uint32_t slot)
+    {
+        if (gpuQueryFrames_[slot] == 0) {
+            return;
+        }
+
+        // Each result is followed by its availability
+        std::array<uint64_t, gpu_queries_per_frame * 2> timestamps{};
+        const auto res = vkGetQueryPoolResults(
+            device_->getDevice(), queryPool_, slot * gpu_queries_per_frame, gpu_queries_per_frame,
+            sizeof(timestamps), timestamps.data(), 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+        );
+        if (res != VK_SUCCESS && res != VK_NOT_READY) {
+            return;
+        }
+
+        bool available = true;
+        for (uint32_t i = 0; i < gpu_queries_per_frame; i++) {
+            available = available && timestamps[i * 2 + 1] != 0;
+        }
+        if (available && timestampPeriod_ > 0.0f) {
+            const auto ms = [&](uint32_t from, uint32_t to) {
+                return static_cast<float>(
+                    static_cast<double>(timestamps[to * 2] - timestamps[from * 2]) * timestampPeriod_ / 1e6
+                );
+            };
+            for (uint32_t p = 0; p < GpuPassCount; p++) {
+                gpuStats_.gpuPassTimes[p] = ms(p, p + 1);
+            }
+            for (uint32_t c = 0; c < NUM_CASCADES; c++) {
+                const uint32_t from = c == 0 ? GpuPassCompute + 1 : GpuPassCount + c;
+                gpuStats_.gpuCascadeTimes[c] = ms(from, GpuPassCount + 1 + c);
+            }
+            gpuStats_.gpuTime = ms(0, GpuPassCount);
+            gpuTime = gpuStats_.gpuTime;
+        }
+
+        if (statisticsPool_) {
+            // The counters in the order of their bits, followed by availability
+            std::array<uint64_t, 5> statistics{};
+            const auto stats_res = vkGetQueryPoolResults(
+                device_->getDevice(), statisticsPool_, slot, 1, sizeof(statistics), statistics.data(),
+                sizeof(statistics), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+            );
+            if (stats_res == VK_SUCCESS && statistics[4] != 0) {
+                gpuStats_.pipelineStatistics = true;
+                gpuStats_.vertexInvocations = statistics[0];
+                gpuStats_.clippingPrimitives = statistics[1];
+                gpuStats_.fragmentInvocations = statistics[2];
+                gpuStats_.computeInvocations = statistics[3];
+            }
         }
     }
 
     void Renderer::shutdown()
     {
         world_->deleteSystem(world_->lookup("Renderer:Render").id);
+        world_->deleteSystem(world_->lookup("Renderer:SetShadowMapDescriptor").id);
+        world_->deleteSystem(world_->lookup("Renderer:SelectMainDescriptor").id);
 
         engine_->getDevice()->WaitIdle();
         vkDestroyQueryPool(device_->getDevice(), queryPool_, nullptr);
+        if (statisticsPool_) {
+            vkDestroyQueryPool(device_->getDevice(), statisticsPool_, nullptr);
+        }
         //device_->getDevice().destroyQueryPool(queryPool_);
-        // frameBuffers_.clear();
+        frameBuffers_.clear();
         depthBufferView_.reset();
         depthBuffer_.reset();
+        hiZBuffer_.reset();
+        retiredHiZBuffers_.clear();
         graphicsCommandPool_.reset();
         //lightingManager_.reset();
 
         cascadeViews_.clear();
         cascadeFrameBuffers_.clear();
+        staticCascadeViews_.clear();
+        staticCascadeFrameBuffers_.clear();
         shadowMap_.reset();
+        staticShadowMap_.reset();
         wholeShadowMapView_.reset();
 
         ds0_.reset();
 
         vkDestroyRenderPass(device_->getDevice(), renderPass_, nullptr);
         vkDestroyRenderPass(device_->getDevice(), depthRenderPass_, nullptr);
+        vkDestroyRenderPass(device_->getDevice(), staticDepthRenderPass_, nullptr);
+        vkDestroyRenderPass(device_->getDevice(), depthLoadRenderPass_, nullptr);
+        if (lateRenderPass_) {
+            vkDestroyRenderPass(device_->getDevice(), lateRenderPass_, nullptr);
+        }
     }
 
-    void Renderer::ensureShadowImages(uint32_t
-    shadowMapSize,
-    uint32_t numCascades
-    )
-{
-    if (
-    shadowMap_ && shadowMap_
-    ->extent_.width == shadowMapSize)
-{
-    return;
-}
-auto device = engine_->getDevice();
-shadowImagesChanged = true;
-shadowMap_ = device->createImage(
-    device->GetDepthFormat(false),
-    {shadowMapSize, shadowMapSize, 1},
-    1,
-    numCascades,
-    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
-);
-
-wholeShadowMapView_ = device->createImageView(
-    shadowMap_,
-    VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_DEPTH_BIT, 0, numCascades
-);
-
-cascadeViews_.
-resize(numCascades);
-cascadeFrameBuffers_.
-resize(numCascades);
-
-for (
-uint32_t i = 0;
-i<numCascades;
-++i) {
-cascadeViews_[i] = device->
-createImageView(
-    shadowMap_,
-    VK_IMAGE_VIEW_TYPE_2D_ARRAY,
-    VK_IMAGE_ASPECT_DEPTH_BIT, i,
-1);
-
-std::vector<VkImageView> attachments = {cascadeViews_[i]->handle_};
-
-VkFramebufferCreateInfo fbci{};
-fbci.
-sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-fbci.
-renderPass = depthRenderPass_;
-fbci.
-attachmentCount = static_cast<uint32_t>(attachments.size());
-fbci.
-pAttachments = attachments.data();
-fbci.
-width = shadowMapSize;
-fbci.
-height = shadowMapSize;
-fbci.
-layers = 1;
-
-VkFramebuffer fb;
-
-vkCreateFramebuffer(device_
-->
-getDevice(), & fbci,
-nullptr, &fb);
-
-cascadeFrameBuffers_[i] =
-std::make_shared<RxCore::FrameBuffer>(device_, fb
-);
-}
+    void Renderer::copyStaticCascade(VkCommandBuffer buf, uint32_t cascade) const
+    {
+        VkImageMemoryBarrier imb{};
+        imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imb.srcAccessMask = 0;
+        imb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imb.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imb.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imb.image = shadowMap_->handle_;
+        imb.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, cascade, 1};
+
+        vkCmdPipelineBarrier(
+            buf,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &imb
+        );
 
-if (!shadowSampler_) {
-VkSamplerCreateInfo sci{};
-sci.
-sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-sci.
-magFilter = VK_FILTER_LINEAR;
-sci.
-minFilter = VK_FILTER_LINEAR;
-sci.
-addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-sci.
-addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-sci.
-maxLod = 0.5f;
-sci.
-borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-
-shadowSampler_ = device->createSampler(sci);
-}
-}
+        VkImageCopy region{};
+        region.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1};
+        region.dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1};
+        region.extent = {shadowMap_->extent_.width, shadowMap_->extent_.height, 1};
+
+        vkCmdCopyImage(
+            buf,
+            staticShadowMap_->handle_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            shadowMap_->handle_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &region
+        );
+    }
+
+    void Renderer::ensureShadowImages(uint32_t shadowMapSize, uint32_t numCascades)
+    {
+        if (shadowMap_ && shadowMap_->extent_.width == shadowMapSize) {
+            return;
+        }
+        auto device = engine_->getDevice();
+        shadowImagesChanged = true;
+        // Must match the attachment format of depthRenderPass_
+        shadowMap_ = device->createImage(
+            device->GetDepthFormat(true),
+            {shadowMapSize, shadowMapSize, 1},
+            1,
+            numCascades,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT
+        );
+
+        staticShadowMap_ = device->createImage(
+            device->GetDepthFormat(true),
+            {shadowMapSize, shadowMapSize, 1},
+            1,
+            numCascades,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        );
+
+        wholeShadowMapView_ = device->createImageView(
+            shadowMap_,
+            VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_DEPTH_BIT, 0, numCascades
+        );
+
+        auto create_frame_buffer = [&](const std::shared_ptr<RxCore::ImageView> & view,
+                                       VkRenderPass rp) {
+            std::vector<VkImageView> attachments = {view->handle_};
+
+            VkFramebufferCreateInfo fbci{};
+            fbci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            fbci.renderPass = rp;
+            fbci.attachmentCount = static_cast<uint32_t>(attachments.size());
+            fbci.pAttachments = attachments.data();
+            fbci.width = shadowMapSize;
+            fbci.height = shadowMapSize;
+            fbci.layers = 1;
+
+            VkFramebuffer fb;
+
+            vkCreateFramebuffer(device_->getDevice(), &fbci, nullptr, &fb);
+
+            return std::make_shared<RxCore::FrameBuffer>(device_, fb);
+        };
+
+        cascadeViews_.resize(numCascades);
+        cascadeFrameBuffers_.resize(numCascades);
+        staticCascadeViews_.resize(numCascades);
+        staticCascadeFrameBuffers_.resize(numCascades);
+
+        for (uint32_t i = 0; i < numCascades; ++i) {
+            cascadeViews_[i] = device->createImageView(
+                shadowMap_,
+                VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                VK_IMAGE_ASPECT_DEPTH_BIT, i,
+                1);
+            cascadeFrameBuffers_[i] = create_frame_buffer(cascadeViews_[i], depthRenderPass_);
+
+            staticCascadeViews_[i] = device->createImageView(
+                staticShadowMap_,
+                VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                VK_IMAGE_ASPECT_DEPTH_BIT, i,
+                1);
+            staticCascadeFrameBuffers_[i] = create_frame_buffer(
+                staticCascadeViews_[i], staticDepthRenderPass_);
+        }
+
+        if (!shadowSampler_) {
+            VkSamplerCreateInfo sci{};
+            sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+            sci.magFilter = VK_FILTER_LINEAR;
+            sci.minFilter = VK_FILTER_LINEAR;
+            sci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            sci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            sci.maxLod = 0.5f;
+            sci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+            shadowSampler_ = device->createSampler(sci);
+        }
+    }
 
 void Renderer::setScissorAndViewport(
     VkExtent2D extent,
@@ -845,7 +1655,7 @@ void Renderer::setScissorAndViewport(
 void Renderer::cullEntitiesProj(
     const XMMATRIX & proj,
     const XMMATRIX & view,
-    const std::shared_ptr<const std::vector<RenderEntity>> & entities,
+    const CullSpheres & spheres,
     std::vector<uint32_t> & selectedEntities)
 {
     OPTICK_EVENT()
@@ -853,40 +1663,24 @@ void Renderer::cullEntitiesProj(
 
     frustum.Transform(viewFrustum, XMMatrixInverse(nullptr, view));
 
-    auto ec = static_cast<uint32_t>(entities->size());
-
-    selectedEntities.reserve(ec);
-    auto & E = *entities;
+    selectedEntities.reserve(spheres.size());
+    cullSpheres(spheres, makeCullPlanes(viewFrustum), selectedEntities);
 
-    for (uint32_t i = 0; i < ec; i++) {
-        if (viewFrustum.Intersects(E[i].boundsSphere)) {
-            //} frustum.isSphereVisible(E[i].boundsSphere)) {
-            selectedEntities.insert(selectedEntities.end(), i);
-        }
-    }
-    OPTICK_TAG("Before Cull", entities->size())
+    OPTICK_TAG("Before Cull", spheres.size())
     OPTICK_TAG("Select from Cull", selectedEntities.size())
 }
 
 void Renderer::cullEntitiesOrtho(
     const BoundingOrientedBox & cullBox,
-    const std::shared_ptr<const std::vector<RenderEntity>> & entities,
+    const CullSpheres & spheres,
     std::vector<uint32_t> & selectedEntities)
 {
     OPTICK_EVENT()
 
-    auto ec = static_cast<uint32_t>(entities->size());
+    selectedEntities.reserve(spheres.size());
+    cullSpheres(spheres, makeCullPlanes(cullBox), selectedEntities);
 
-    selectedEntities.reserve(ec);
-    auto & E = *entities;
-
-    for (uint32_t i = 0; i < ec; i++) {
-        if (cullBox.Intersects(E[i].boundsSphere)) {
-            //} frustum.isSphereVisible(E[i].boundsSphere)) {
-            selectedEntities.insert(selectedEntities.end(), i);
-        }
-    }
-    OPTICK_TAG("Before Cull", entities->size())
+    OPTICK_TAG("Before Cull", spheres.size())
     OPTICK_TAG("Select from Cull", selectedEntities.size())
 }
 
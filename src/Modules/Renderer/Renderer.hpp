@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <deque>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include "Vulkan/DescriptorSet.hpp"
@@ -7,11 +10,18 @@
 #include "RxECS.h"
 #include "Modules/Module.h"
 #include "Modules/Materials/Materials.h"
+#include "Geometry/Culling.h"
+#include "RenderGraph.h"
 #include <Jobs/JobManager.hpp>
 
 #include "Vulkan/DescriptorPool.hpp"
 
 #define NUM_CASCADES 4
+#define SHADOW_MAP_SIZE 4096
+#define HIZ_MAX_LEVELS 16
+#define HIZ_RETIRE_FRAMES 5
+#define GPU_QUERY_FRAMES 4
+#define MAIN_DESCRIPTOR_SETS 5
 
 namespace RxCore
 {
@@ -94,23 +104,23 @@ namespace RxEngine
         std::array<uint32_t, 3> pipelineIds;
     };
 #endif
+    // Laid out to match VkDrawIndexedIndirectCommand so the same records can be written
+    // by the GPU culling pass and consumed by vkCmdDrawIndexedIndirect
     struct IndirectDrawCommand
     {
         uint32_t indexCount;
-        uint32_t vertexOffset;
-        uint32_t indexOffset;
         uint32_t instanceCount;
+        uint32_t indexOffset;
+        int32_t vertexOffset;
         uint32_t instanceOffset;
     };
 
+    static_assert(sizeof(IndirectDrawCommand) == sizeof(VkDrawIndexedIndirectCommand));
+
     struct IndirectDrawInstance
     {
-        DirectX::XMFLOAT4X4 transform;
-        //DirectX::XMFLOAT4 params;
+        uint32_t transformSlot;
         uint32_t materialId;
-        uint32_t pad0;
-        uint32_t pad1;
-        uint32_t pad2;
     };
 
     struct IndirectDrawCommandHeader
@@ -129,11 +139,111 @@ namespace RxEngine
         std::vector<IndirectDrawCommandHeader> headers;
     };
 
+    // Spans of the frame timed on the GPU, each runs from the end of the one before it
+    enum EGpuPass : uint32_t
+    {
+        GpuPassCompute,
+        GpuPassShadows,
+        GpuPassOpaque,
+        GpuPassDepthPyramid,
+        GpuPassLate,
+        GpuPassCount
+    };
+
+    constexpr std::array<const char *, GpuPassCount> gpu_pass_names = {
+        "Compute", "Shadows", "Opaque", "Depth Pyramid", "Late Opaque"
+    };
+
+    // A frame's timestamps are the frame start, the end of each pass and then the end of each
+    // shadow cascade, the first of which runs from the end of compute
+    constexpr uint32_t gpu_queries_per_frame = GpuPassCount + 1 + NUM_CASCADES;
+
     struct FrameStatDetail
     {
         float cpuTime;
         uint32_t triangles;
         uint32_t drawCalls;
+        uint32_t apiDrawCalls;
+        uint64_t uploadBytes;
+        uint64_t uploadInFlight;
+        uint64_t uploadPeak;
+        uint64_t uploadCapacity;
+        uint32_t occlusionTested;
+        uint32_t occlusionCulled;
+        // GPU figures are read back GPU_QUERY_FRAMES frames late, times are in milliseconds
+        float gpuTime;
+        std::array<float, GpuPassCount> gpuPassTimes;
+        std::array<float, NUM_CASCADES> gpuCascadeTimes;
+        bool pipelineStatistics;
+        uint64_t vertexInvocations;
+        uint64_t clippingPrimitives;
+        uint64_t fragmentInvocations;
+        uint64_t computeInvocations;
+    };
+
+    struct RenderFeatures
+    {
+        bool drawIndirectCount;
+        bool multiDrawIndirect;
+        // Without it an indirect command's firstInstance must be 0, and every draw here indexes
+        // its instances from firstInstance
+        bool drawIndirectFirstInstance;
+
+        // Count draws cover every command of a header, so they also need multiDrawIndirect
+        [[nodiscard]] bool indirectCount() const
+        {
+            return drawIndirectCount && multiDrawIndirect && drawIndirectFirstInstance;
+        }
+    };
+
+    // The depth pyramid built from the last frame's opaque depth and the camera it was drawn
+    // with. Only set when occlusion culling is enabled, valid once a pyramid has been built.
+    struct HiZPyramid
+    {
+        uint64_t address;
+        DirectX::XMFLOAT4X4 viewProjection;
+        bool valid;
+    };
+
+    // Start of the pyramid buffer, matches the HiZPyramid block in hiz.glsl. Offsets are in
+    // floats from the end of the header.
+    struct HiZPyramidHeader
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        uint32_t pad0;
+        uint32_t offsets[HIZ_MAX_LEVELS];
+    };
+
+    // Where a pyramid build pass reads from, the level above or the copy of the depth buffer
+    // in whichever encoding the depth format copies out as
+    enum EHiZSource : uint32_t
+    {
+        HiZSourceLevel,
+        HiZSourceFloatDepth,
+        HiZSourceUnorm24Depth,
+        HiZSourceUnorm16Depth
+    };
+
+    struct HiZBuildPushConstants
+    {
+        uint64_t pyramid;
+        uint32_t srcOffset;
+        uint32_t dstOffset;
+        uint32_t srcWidth;
+        uint32_t srcHeight;
+        uint32_t dstWidth;
+        uint32_t dstHeight;
+        uint32_t source;
+        uint32_t pad0;
+    };
+
+    struct HiZLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t offset;
     };
 
     struct FrameStats
@@ -141,6 +251,9 @@ namespace RxEngine
         std::vector<FrameStatDetail> frames;
         uint64_t frameNo;
         uint32_t index;
+        // Added to by the render systems during the frame, filed with the frame's details
+        uint32_t occlusionTested;
+        uint32_t occlusionCulled;
     };
 #if 0
     struct IRenderProvider
@@ -248,6 +361,10 @@ namespace RxEngine
         std::shared_ptr<RxCore::DescriptorSet> ds{};
     };
 
+    struct ShadowMapDescriptor
+    {
+    };
+
     struct CurrentMainDescriptorSet
     {
         ecs::entity_t descriptorSet;
@@ -275,6 +392,7 @@ namespace RxEngine
         void render(
             VkImageView imageView,
             VkExtent2D extent,
+            uint32_t swapChainGeneration,
             std::vector<VkSemaphore> waitSemaphores,
             std::vector<VkPipelineStageFlags> waitStages,
             VkSemaphore completeSemaphore
@@ -287,7 +405,22 @@ namespace RxEngine
 
     protected:
         void createRenderPass();
+        VkRenderPass createMainRenderPass(VkAttachmentLoadOp loadOp,
+                                          VkImageLayout colorInitialLayout,
+                                          VkImageLayout colorFinalLayout,
+                                          VkImageLayout depthInitialLayout,
+                                          VkImageLayout depthFinalLayout,
+                                          VkAttachmentStoreOp depthStoreOp,
+                                          const std::vector<VkSubpassDependency> & spd) const;
         void createDepthRenderPass();
+        VkRenderPass createDepthOnlyRenderPass(VkAttachmentLoadOp loadOp,
+                                               VkImageLayout initialLayout,
+                                               VkImageLayout finalLayout,
+                                               const std::vector<VkSubpassDependency> & spd) const;
+        void copyStaticCascade(VkCommandBuffer buf, uint32_t cascade) const;
+        void ensureHiZPyramid(const VkExtent2D & extent);
+        bool buildHiZPyramid(VkCommandBuffer buf);
+        void readGpuQueries(uint32_t slot);
 
         std::shared_ptr<const std::vector<RenderEntity>> finishUpEntityJobs(
             const std::vector<std::shared_ptr<RxCore::Job<std::vector<RenderEntity>>>> &
@@ -306,6 +439,11 @@ namespace RxEngine
                                               uint32_t subpass);
     public:
         //void collectLights(const std::vector<IRenderable *> & subsystems, std::vector<LightData> & lights);
+        static void cullEntitiesOrtho(
+            const DirectX::BoundingOrientedBox & cullBox,
+            const CullSpheres & spheres,
+            std::vector<uint32_t> & selectedEntities);
+
     public:
     public:
         double gpuTime{};
@@ -317,17 +455,45 @@ namespace RxEngine
 
         VkExtent2D bufferExtent_;
         VkQueryPool queryPool_;
+        VkQueryPool statisticsPool_{};
+        float timestampPeriod_{};
+        // The frame number each query slot was last written in, 0 when never
+        std::array<uint64_t, GPU_QUERY_FRAMES> gpuQueryFrames_{};
+        FrameStatDetail gpuStats_{};
 
         std::shared_ptr<RxCore::Image> depthBuffer_;
         std::shared_ptr<RxCore::Image> shadowMap_;
         std::shared_ptr<RxCore::ImageView> wholeShadowMapView_;
         std::vector<std::shared_ptr<RxCore::ImageView>> cascadeViews_;
         std::vector<std::shared_ptr<RxCore::FrameBuffer>> cascadeFrameBuffers_;
+        std::shared_ptr<RxCore::Image> staticShadowMap_;
+        std::vector<std::shared_ptr<RxCore::ImageView>> staticCascadeViews_;
+        std::vector<std::shared_ptr<RxCore::FrameBuffer>> staticCascadeFrameBuffers_;
         std::shared_ptr<RxCore::ImageView> depthBufferView_;
         std::shared_ptr<RxCore::CommandPool> graphicsCommandPool_;
 
         VkRenderPass renderPass_;
         VkRenderPass depthRenderPass_;
+        VkRenderPass staticDepthRenderPass_;
+        VkRenderPass depthLoadRenderPass_;
+        VkRenderPass lateRenderPass_{};
+
+        RenderGraph renderGraph_{};
+        bool dumpRenderGraph_{};
+        std::unordered_map<VkImageView, std::shared_ptr<RxCore::FrameBuffer>> frameBuffers_{};
+        uint32_t frameBufferGeneration_{};
+
+        bool occlusionCulling_{};
+        std::shared_ptr<RxCore::Buffer> hiZBuffer_;
+        std::vector<HiZLevel> hiZLevels_;
+        uint32_t hiZDepthOffset_{};
+        bool hiZHeaderDirty_{};
+        ecs::EntityHandle hiZPipeline_{};
+        std::deque<std::pair<uint64_t, std::shared_ptr<RxCore::Buffer>>> retiredHiZBuffers_;
+
+        // One main set per frame in flight, CurrentMainDescriptorSet names the one for the frame
+        // being recorded so the others can be left alone while the GPU still reads them
+        std::array<ecs::entity_t, MAIN_DESCRIPTOR_SETS> mainDescriptorSets_{};
 
         VkDescriptorSetLayout ds0Layout;
         std::shared_ptr<RxCore::DescriptorSet> ds0_;
@@ -346,9 +512,10 @@ namespace RxEngine
         //RxCore::DescriptorPoolTemplate poolTemplate;
         //void ensureFrameBufferSize(const VkImageView & imageView, const VkExtent2D & extent);
 
-        std::shared_ptr<RxCore::FrameBuffer> createRenderFrameBuffer(
+        std::shared_ptr<RxCore::FrameBuffer> getRenderFrameBuffer(
             const VkImageView & imageView,
-            const VkExtent2D & extent) const;
+            const VkExtent2D & extent,
+            uint32_t swapChainGeneration);
 
         //void createPipelineLayout();
         //void updateDescriptorSet0(const std::shared_ptr<RenderCamera> & renderCamera);
@@ -363,12 +530,7 @@ namespace RxEngine
         static void cullEntitiesProj(
             const DirectX::XMMATRIX & proj,
             const DirectX::XMMATRIX & view,
-            const std::shared_ptr<const std::vector<RenderEntity>> & entities,
-            std::vector<uint32_t> & selectedEntities);
-
-        static void cullEntitiesOrtho(
-            const DirectX::BoundingOrientedBox & cullBox,
-            const std::shared_ptr<const std::vector<RenderEntity>> & entities,
+            const CullSpheres & spheres,
             std::vector<uint32_t> & selectedEntities);
 
         static float getSphereSize(
@@ -132,8 +132,9 @@ namespace RxEngine
         };
     }
 
-    RmlRenderInterface::RmlRenderInterface(RxCore::Device * device)
+    RmlRenderInterface::RmlRenderInterface(RxCore::Device * device, UploadRing * uploadRing)
         : device_(device)
+        , uploadRing_(uploadRing)
         , dirtyTextures(true)
         , transform_()
     {
@@ -385,11 +386,16 @@ namespace RxEngine
         if (vertices_.empty()) {
             return;
         }
-        auto [vb, ib] = CreateBuffers();
+        auto vertices = uploadRing_->upload(
+            vertices_.data(), vertices_.size() * sizeof(Rml::Vertex), 16);
+        auto indices = vertices
+                           ? uploadRing_->upload(
+                               indices_.data(), indices_.size() * sizeof(uint32_t), 16)
+                           : UploadAllocation{};
         uint32_t triangles = 0;
         uint32_t drawCalls = 0;
 
-        buf->begin(pipeline->renderPass, pipeline->subPass);
+        const bool inherited = Render::beginSecondary(world, buf, pipeline->renderPass, pipeline->subPass);
         OPTICK_GPU_CONTEXT(buf->Handle());
         {
             OPTICK_GPU_EVENT("Draw RlmUi");
@@ -398,8 +404,15 @@ namespace RxEngine
             buf->bindPipeline(pipeline->pipeline->Handle());
             buf->BindDescriptorSet(0, currentDescriptorSet);
 
-            buf->bindVertexBuffer(vb);
-            buf->bindIndexBuffer(ib);
+            if (vertices && indices) {
+                vkCmdBindVertexBuffers(buf->Handle(), 0, 1, &vertices.buffer, &vertices.offset);
+                vkCmdBindIndexBuffer(
+                    buf->Handle(), indices.buffer, indices.offset, VK_INDEX_TYPE_UINT32);
+            } else {
+                auto [vb, ib] = CreateBuffers();
+                buf->bindVertexBuffer(vb);
+                buf->bindIndexBuffer(ib);
+            }
             buf->setViewport(0, 0, static_cast<float>(wd->width), static_cast<float>(wd->height), 0,
                              1);
 
@@ -434,7 +447,7 @@ namespace RxEngine
                     0);
             }
         }
-        buf->end();
+        Render::endSecondary(buf, inherited);
         renders.clear();
         vertices_.clear();
         indices_.clear();
@@ -626,7 +639,8 @@ namespace RxEngine
     {
         rmlSystem = std::make_unique<RmlSystemInterface>(world_);
         rmlFile = std::make_unique<RmlFileInterface>();
-        rmlRender = std::make_unique<RmlRenderInterface>(engine_->getDevice());
+        rmlRender = std::make_unique<RmlRenderInterface>(
+            engine_->getDevice(), engine_->getUploadRing());
 
         Rml::SetSystemInterface(rmlSystem.get());
         Rml::SetFileInterface(rmlFile.get());
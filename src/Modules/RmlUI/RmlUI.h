@@ -29,6 +29,8 @@ namespace Rml
 
 namespace RxEngine
 {
+    class UploadRing;
+
 #if 0
     struct UiContext
     {
@@ -91,7 +93,7 @@ namespace RxEngine
     class RmlRenderInterface final : public Rml::RenderInterface
     {
     public:
-        RmlRenderInterface(RxCore::Device * device);
+        RmlRenderInterface(RxCore::Device * device, UploadRing * uploadRing);
         ~RmlRenderInterface() override;
         void RenderGeometry(
             Rml::Vertex * vertices,
@@ -127,6 +129,7 @@ namespace RxEngine
 
     private:
         RxCore::Device * device_;
+        UploadRing * uploadRing_;
         std::tuple<std::shared_ptr<RxCore::VertexBuffer>, std::shared_ptr<RxCore::IndexBuffer>>
         CreateBuffers() const;
 
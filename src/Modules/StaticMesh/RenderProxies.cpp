@@ -0,0 +1,282 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "RenderProxies.h"
+#include "Modules/Mesh/Mesh.h"
+#include "Modules/Materials/Materials.h"
+#include "Modules/Prototypes/Prototypes.h"
+#include "Modules/Scene/SceneModule.h"
+
+namespace RxEngine
+{
+    void RenderProxyTable::update(ecs::World * world, ecs::EntityHandle e)
+    {
+        auto is = e.get<InstanceSlot>();
+        auto wbs = e.get<WorldBoundingSphere>();
+        auto vpp = e.get<HasVisiblePrototype>();
+
+        if (!is || !wbs || !vpp) {
+            remove(e.id);
+            return;
+        }
+        auto vp = world->get<VisiblePrototype>(vpp->entity);
+        if (!vp) {
+            remove(e.id);
+            return;
+        }
+
+        const auto count = static_cast<uint32_t>(vp->subMeshEntities.size());
+
+        uint32_t first;
+        auto it = rows_.find(e.id);
+        if (it != rows_.end() && it->second.second == count) {
+            first = it->second.first;
+        } else {
+            remove(e.id);
+            first = size();
+            resize(first + count);
+            rows_[e.id] = {first, count};
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t row = first + i;
+            owners[row] = e.id;
+            bounds.set(row, wbs->boundSphere);
+            slots[row] = is->slot;
+
+            // Submeshes without render details yet stay in the table but are never drawn
+            auto rdc = world->get<RenderDetailCache>(vp->subMeshEntities[i]);
+            if (!rdc) {
+                opaquePipelines[row] = 0;
+                shadowPipelines[row] = 0;
+                lodSets[row] = no_lod_set;
+                continue;
+            }
+            auto mm = world->get<Material>(rdc->material);
+
+            opaquePipelines[row] = rdc->opaquePipeline;
+            shadowPipelines[row] = rdc->shadowPipeline;
+            bundles[row] = rdc->bundle;
+            vertexOffsets[row] = rdc->vertexOffset;
+            indexOffsets[row] = rdc->indexOffset;
+            indexCounts[row] = rdc->indexCount;
+            materials[row] = mm ? mm->sequence : 0;
+            sortKeys[row] = keys_.makeKey(
+                rdc->opaquePipeline, rdc->bundle, rdc->vertexOffset, rdc->indexOffset, materials[row]
+            );
+
+            // New rows start at full detail and culling moves them to the level for their size,
+            // updated rows keep their level
+            const uint32_t lod_set = lodSetFor(world, vp->subMeshEntities[i]);
+            if (lod_set != lodSets[row]) {
+                lodSets[row] = lod_set;
+                lodLevels[row] = 0;
+            } else if (lod_set != no_lod_set && lodLevels[row] != 0) {
+                setLevel(row, lodSetTable[lod_set].levels[lodLevels[row]]);
+            }
+        }
+    }
+
+    uint32_t RenderProxyTable::lodSetFor(ecs::World * world, ecs::entity_t subMesh)
+    {
+        auto it = lodSetIndex_.find(subMesh);
+        if (it != lodSetIndex_.end()) {
+            return it->second;
+        }
+
+        auto & index = lodSetIndex_[subMesh];
+        index = no_lod_set;
+
+        auto sm = world->get<SubMesh>(subMesh);
+        auto smo = world->get<SubMeshOf>(subMesh);
+        if (!sm || !smo) {
+            return index;
+        }
+        auto lods = world->get<MeshLods>(smo->entity);
+        if (!lods || lods->count == 0) {
+            return index;
+        }
+
+        RenderProxyLodSet set{};
+        auto add_level = [&](ecs::entity_t levelSubMesh, float coverage) {
+            auto rdc = world->get<RenderDetailCache>(levelSubMesh);
+            if (!rdc) {
+                return false;
+            }
+            auto mm = world->get<Material>(rdc->material);
+            const uint32_t material = mm ? mm->sequence : 0;
+            set.levels[set.count++] = {
+                rdc->opaquePipeline, rdc->shadowPipeline, rdc->bundle, rdc->vertexOffset,
+                rdc->indexOffset, rdc->indexCount, material, coverage,
+                keys_.makeKey(
+                    rdc->opaquePipeline, rdc->bundle, rdc->vertexOffset, rdc->indexOffset, material
+                )
+            };
+            return true;
+        };
+
+        add_level(subMesh, 0.0f);
+        // Levels that aren't resident yet, and any after them, are left out until the next rebuild
+        for (uint32_t l = 0; l < std::min(lods->count, max_mesh_lods - 1); l++) {
+            auto level_mesh = world->get<Mesh>(lods->meshes[l]);
+            if (!level_mesh || level_mesh->subMeshes.size() <= sm->subMeshIndex ||
+                !add_level(level_mesh->subMeshes[sm->subMeshIndex], lods->coverage[l])) {
+                break;
+            }
+        }
+        if (set.count < 2) {
+            return index;
+        }
+
+        index = static_cast<uint32_t>(lodSetTable.size());
+        lodSetTable.push_back(set);
+        return index;
+    }
+
+    void RenderProxyTable::setLevel(uint32_t row, const RenderProxyLod & level)
+    {
+        opaquePipelines[row] = level.opaquePipeline;
+        shadowPipelines[row] = level.shadowPipeline;
+        bundles[row] = level.bundle;
+        vertexOffsets[row] = level.vertexOffset;
+        indexOffsets[row] = level.indexOffset;
+        indexCounts[row] = level.indexCount;
+        materials[row] = level.material;
+        sortKeys[row] = level.sortKey;
+    }
+
+    void RenderProxyTable::selectLod(uint32_t row, float coverage, float hysteresis)
+    {
+        if (lodSets[row] == no_lod_set) {
+            return;
+        }
+        const auto & set = lodSetTable[lodSets[row]];
+
+        uint32_t level = lodLevels[row];
+        while (level + 1 < set.count && coverage < set.levels[level + 1].coverage * (1.0f - hysteresis)) {
+            level++;
+        }
+        while (level > 0 && coverage > set.levels[level].coverage * (1.0f + hysteresis)) {
+            level--;
+        }
+
+        if (level != lodLevels[row]) {
+            lodLevels[row] = static_cast<uint8_t>(level);
+            setLevel(row, set.levels[level]);
+        }
+    }
+
+    void RenderProxyTable::remove(ecs::entity_t owner)
+    {
+        auto it = rows_.find(owner);
+        if (it == rows_.end()) {
+            return;
+        }
+        auto [first, count] = it->second;
+        for (uint32_t row = first; row < first + count; row++) {
+            owners[row] = 0;
+            opaquePipelines[row] = 0;
+            shadowPipelines[row] = 0;
+            lodSets[row] = no_lod_set;
+        }
+        deadRows_ += count;
+        rows_.erase(it);
+    }
+
+    bool RenderProxyTable::sweep(ecs::World * world)
+    {
+        bool removed = false;
+        for (uint32_t row = 0; row < size(); row++) {
+            if (owners[row] && !world->isAlive(owners[row])) {
+                remove(owners[row]);
+                removed = true;
+            }
+        }
+
+        if (deadRows_ > 1024 && deadRows_ * 4 > size()) {
+            compact();
+        }
+        return removed;
+    }
+
+    void RenderProxyTable::clear()
+    {
+        resize(0);
+        rows_.clear();
+        deadRows_ = 0;
+        keys_.clear();
+        lodSetTable.clear();
+        lodSetIndex_.clear();
+    }
+
+    void RenderProxyTable::resize(size_t count)
+    {
+        owners.resize(count);
+        bounds.resize(count);
+        slots.resize(count);
+        opaquePipelines.resize(count);
+        shadowPipelines.resize(count);
+        bundles.resize(count);
+        vertexOffsets.resize(count);
+        indexOffsets.resize(count);
+        indexCounts.resize(count);
+        materials.resize(count);
+        sortKeys.resize(count);
+        lodSets.resize(count, no_lod_set);
+        lodLevels.resize(count);
+    }
+
+    void RenderProxyTable::compact()
+    {
+        uint32_t dst = 0;
+        for (uint32_t src = 0; src < size(); src++) {
+            if (!owners[src]) {
+                continue;
+            }
+            auto & range = rows_[owners[src]];
+            if (src == range.first) {
+                range.first = dst;
+            }
+            if (src != dst) {
+                owners[dst] = owners[src];
+                bounds.copy(dst, src);
+                slots[dst] = slots[src];
+                opaquePipelines[dst] = opaquePipelines[src];
+                shadowPipelines[dst] = shadowPipelines[src];
+                bundles[dst] = bundles[src];
+                vertexOffsets[dst] = vertexOffsets[src];
+                indexOffsets[dst] = indexOffsets[src];
+                indexCounts[dst] = indexCounts[src];
+                materials[dst] = materials[src];
+                sortKeys[dst] = sortKeys[src];
+                lodSets[dst] = lodSets[src];
+                lodLevels[dst] = lodLevels[src];
+            }
+            dst++;
+        }
+        resize(dst);
+        deadRows_ = 0;
+    }
+}
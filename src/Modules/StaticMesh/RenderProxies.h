@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "RxECS.h"
+#include "DirectXMath.h"
+#include "Geometry/Culling.h"
+#include "Modules/Mesh/DrawSort.h"
+#include "Modules/Mesh/Mesh.h"
+
+namespace RxEngine
+{
+    // Draw details of one level of detail of a submesh. coverage is the screen coverage below
+    // which the level is drawn, unused for the full detail level.
+    struct RenderProxyLod
+    {
+        ecs::entity_t opaquePipeline;
+        ecs::entity_t shadowPipeline;
+        ecs::entity_t bundle;
+        uint32_t vertexOffset;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        uint32_t material;
+        float coverage;
+        uint64_t sortKey;
+    };
+
+    // Levels of a submesh whose mesh has MeshLods, shared by every row drawing that submesh
+    struct RenderProxyLodSet
+    {
+        uint32_t count;
+        std::array<RenderProxyLod, max_mesh_lods> levels;
+    };
+
+    // Flattened copy of every placed static submesh, one row per entity and submesh. Rows for an
+    // entity are contiguous and are kept in step with the ECS by the StaticMesh module so the
+    // culling and batching passes only walk these arrays.
+    class RenderProxyTable
+    {
+    public:
+        void update(ecs::World * world, ecs::EntityHandle e);
+        void remove(ecs::entity_t owner);
+        // Removes the rows of owners that have been destroyed, true when there were any
+        bool sweep(ecs::World * world);
+        void clear();
+        // Moves the row to the level for the given screen coverage. A level only changes once
+        // coverage is past its threshold by the hysteresis fraction, so rows near a threshold
+        // don't flip every frame. Safe to call for different rows from different jobs.
+        void selectLod(uint32_t row, float coverage, float hysteresis);
+
+        [[nodiscard]] uint32_t size() const
+        {
+            return static_cast<uint32_t>(owners.size());
+        }
+
+        std::vector<ecs::entity_t> owners;
+        CullSpheres bounds;
+        std::vector<uint32_t> slots;
+        std::vector<ecs::entity_t> opaquePipelines;
+        std::vector<ecs::entity_t> shadowPipelines;
+        std::vector<ecs::entity_t> bundles;
+        std::vector<uint32_t> vertexOffsets;
+        std::vector<uint32_t> indexOffsets;
+        std::vector<uint32_t> indexCounts;
+        std::vector<uint32_t> materials;
+        // Opaque sort key with the depth bits left clear
+        std::vector<uint64_t> sortKeys;
+        // Index into lodSetTable, or no_lod_set. The columns above hold the level in lodLevels.
+        std::vector<uint32_t> lodSets;
+        std::vector<uint8_t> lodLevels;
+        std::vector<RenderProxyLodSet> lodSetTable;
+
+        static constexpr uint32_t no_lod_set = std::numeric_limits<uint32_t>::max();
+
+    protected:
+        void resize(size_t count);
+        void compact();
+
+    private:
+        uint32_t lodSetFor(ecs::World * world, ecs::entity_t subMesh);
+        void setLevel(uint32_t row, const RenderProxyLod & level);
+
+        std::unordered_map<ecs::entity_t, std::pair<uint32_t, uint32_t>> rows_{};
+        std::unordered_map<ecs::entity_t, uint32_t> lodSetIndex_{};
+        uint32_t deadRows_{};
+        DrawSortKeys keys_{};
+    };
+}
@@ -23,6 +23,10 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <DirectXPackedVector.h>
 #include <Vulkan/Buffer.hpp>
 #include <Modules/Scene/SceneModule.h>
 #include "StaticMesh.h"
@@ -39,10 +43,12 @@ namespace RxEngine
 {
     struct SceneCamera;
 
+    constexpr uint32_t cull_chunk_rows = 8192;
+
     void StaticMeshModule::startup()
     {
         //world_->addSingleton<StaticMeshActiveBundle>();
-        worldObjects_ = world_->createQuery<SceneNode, WorldTransform, HasVisiblePrototype>()
+        worldObjects_ = world_->createQuery<SceneNode, WorldTransform, HasVisiblePrototype, InstanceSlot>()
                               //.withJob()
                                   //.withRelation<HasVisiblePrototype, VisiblePrototype>()
                               .withInheritance(true).id;
@@ -50,19 +56,146 @@ namespace RxEngine
         instanceBuffers.count = 5;
         instanceBuffers.sizes.resize(5);
         instanceBuffers.buffers.resize(5);
+        instanceBuffers.indirectSizes.resize(5);
+        instanceBuffers.indirectBuffers.resize(5);
+
+        shadowInstanceBuffers_.resize(NUM_CASCADES);
+        for (auto & sib: shadowInstanceBuffers_) {
+            sib.count = 5;
+            sib.sizes.resize(5);
+            sib.buffers.resize(5);
+            sib.indirectSizes.resize(5);
+            sib.indirectBuffers.resize(5);
+        }
+        minShadowCasterTexels_ = engine_->getUint32ConfigValue("shadows", "minCasterTexels", 2);
+
+        gpuCulling_ = engine_->getBoolConfigValue("render", "gpuCulling", false);
+        clusterCulling_ = engine_->getBoolConfigValue("render", "clusterCulling", true);
+        lodHysteresis_ =
+            static_cast<float>(engine_->getUint32ConfigValue("render", "lodHysteresisPercent", 10)) / 100.0f;
+        textureFeedback_ = engine_->getBoolConfigValue("render", "textureStreaming", false);
+        softwareOcclusion_ = engine_->getBoolConfigValue("render", "softwareOcclusion", false);
+        if (softwareOcclusion_) {
+            occlusionBuffer_.resize(
+                engine_->getUint32ConfigValue("render", "softwareOcclusionWidth", 320),
+                engine_->getUint32ConfigValue("render", "softwareOcclusionHeight", 180)
+            );
+        }
+        gpuCullFrames_.resize(5);
+
+        // The cull table holds bounds in mesh space and the shader reads each transform from the
+        // instance table, so it only changes with what is placed, not with where
+        auto cullQueue = world_->createEntityQueue("StaticMeshCullTable");
+        cullQueue.triggerOnAdd<WorldTransform>();
+        cullQueue.triggerOnAdd<RenderDetailCache>();
+        cullQueue.triggerOnUpdate<RenderDetailCache>();
+        cullQueue.triggerOnAdd<InstanceSlot>();
+        cullQueue.triggerOnAdd<HasVisiblePrototype>();
+        cullQueue.triggerOnUpdate<HasVisiblePrototype>();
+
+        world_->createSystem("StaticMesh:MarkCullTable")
+              .inGroup("Pipeline:PreRender")
+              .withEntityQueue(cullQueue)
+              .eachEntity(
+                  [this](ecs::EntityHandle e) {
+                      gpuCullTableDirty_ = true;
+                      if (e.has<HasVisiblePrototype>() || e.has<RenderDetailCache>()) {
+                          shadowCastersChanged_ = true;
+                      }
+                      return true;
+                  }
+              );
+
+        auto moveQueue = world_->createEntityQueue("StaticMeshMoved");
+        moveQueue.triggerOnUpdate<WorldTransform>();
+
+        world_->createSystem("StaticMesh:MarkMovedCasters")
+              .inGroup("Pipeline:PreRender")
+              .withEntityQueue(moveQueue)
+              .eachEntity(
+                  [this](ecs::EntityHandle e) {
+                      if (e.has<HasVisiblePrototype>()) {
+                          shadowCastersChanged_ = true;
+                      }
+                      return true;
+                  }
+              );
+
+        auto proxyQueue = world_->createEntityQueue("StaticMeshRenderProxies");
+        proxyQueue.triggerOnAdd<WorldTransform>();
+        proxyQueue.triggerOnUpdate<WorldTransform>();
+        proxyQueue.triggerOnAdd<InstanceSlot>();
+        proxyQueue.triggerOnAdd<RenderDetailCache>();
+        proxyQueue.triggerOnUpdate<RenderDetailCache>();
+        proxyQueue.triggerOnAdd<MeshLods>();
+        proxyQueue.triggerOnUpdate<MeshLods>();
+
+        world_->createSystem("StaticMesh:UpdateRenderProxies")
+              .inGroup("Pipeline:PreRender")
+              .withEntityQueue(proxyQueue)
+              .withRead<WorldBoundingSphere>()
+              .withRead<InstanceSlot>()
+              .withRead<RenderDetailCache>()
+              .eachEntity(
+                  [this](ecs::EntityHandle e) {
+                      // New render details or levels of detail can apply to any number of
+                      // placed instances
+                      if (e.has<RenderDetailCache>() || e.has<MeshLods>()) {
+                          renderProxiesDirty_ = true;
+                      } else if (!renderProxiesDirty_) {
+                          renderProxies_.update(world_, e);
+                      }
+                      return true;
+                  }
+              );
+
+        world_->createSystem("StaticMesh:SweepRenderProxies")
+              .inGroup("Pipeline:PreRender")
+              .withRead<WorldBoundingSphere>()
+              .withRead<InstanceSlot>()
+              .withRead<RenderDetailCache>()
+              .execute(
+                  [this](ecs::World *) {
+                      OPTICK_EVENT("Sweep Render Proxies")
+                      // Destroyed entities never reach the cull table queue, so the GPU cull
+                      // table and the cached static cascades learn of them here
+                      if (renderProxiesDirty_) {
+                          rebuildRenderProxies();
+                          gpuCullTableDirty_ = true;
+                          shadowCastersChanged_ = true;
+                      } else if (renderProxies_.sweep(world_)) {
+                          gpuCullTableDirty_ = true;
+                          shadowCastersChanged_ = true;
+                      }
+                  }
+              );
 
         world_->createSystem("StaticMesh:Render")
               .inGroup("Pipeline:Render")
               .withStreamWrite<Render::OpaqueRenderCommand>()
+              .withStreamWrite<Render::ComputeCommand>()
+              .withStreamWrite<Render::OcclusionComputeCommand>()
+              .withRead<HiZPyramid>()
+              .withRead<InstanceTable>()
               .withRead<CurrentMainDescriptorSet>()
               .withRead<DescriptorSet>()
               .withRead<PipelineLayout>()
               .withRead<VisiblePrototype>()
+              .withRead<Occluder>()
+              .withWrite<FrameStats>()
+              .withWrite<TextureFeedback>()
               .withJob()
               .execute(
                   [this](ecs::World *) {
                       OPTICK_EVENT("StaticMesh:Render")
-                      createOpaqueRenderCommands();
+                      // GPU culled commands can only be drawn indirectly, with their instances
+                      // starting at firstInstance
+                      auto features = world_->getSingleton<RenderFeatures>();
+                      if (gpuCulling_ && features && features->drawIndirectFirstInstance) {
+                          createGpuCulledRenderCommands();
+                      } else {
+                          createOpaqueRenderCommands();
+                      }
                   }
               );
 
@@ -73,11 +206,13 @@ namespace RxEngine
               .withRead<DescriptorSet>()
               .withRead<PipelineLayout>()
               .withRead<VisiblePrototype>()
-              .withRead<ShadowCascadeData>()
+              .withWrite<ShadowCascadeData>()
+              .withRead<WorldTransform>()
+              .withRead<WorldBoundingSphere>()
               .execute(
-                  [](ecs::World *) {
+                  [this](ecs::World *) {
                       OPTICK_EVENT("StaticMesh:ShadowRender")
-                      //createOpaqueRenderCommands();
+                      createShadowRenderCommands();
                   }
               );
 
@@ -85,9 +220,39 @@ namespace RxEngine
     }
 
     void StaticMeshModule::shutdown()
-    {}
+    {
+        world_->lookup("StaticMesh:MarkCullTable").destroy();
+        world_->lookup("StaticMeshCullTable").destroy();
+        world_->lookup("StaticMesh:MarkMovedCasters").destroy();
+        world_->lookup("StaticMeshMoved").destroy();
+        world_->lookup("StaticMesh:UpdateRenderProxies").destroy();
+        world_->lookup("StaticMesh:SweepRenderProxies").destroy();
+        world_->lookup("StaticMeshRenderProxies").destroy();
+
+        renderProxies_.clear();
+
+        shadowInstanceBuffers_.clear();
+        retiredGpuCullTables_.clear();
+        gpuCullTable_.reset();
+        gpuCullFrames_.clear();
+    }
 
-    ecs::entity_t createStaticMeshBundle(RxCore::Device * device, ecs::World * world)
+    ecs::entity_t StaticMeshActiveBundle::* activeBundleFor(StaticMeshFormat format)
+    {
+        switch (format) {
+            case StaticMeshFormat::Compact:
+                return &StaticMeshActiveBundle::compactBundle;
+            case StaticMeshFormat::CompactShort:
+                return &StaticMeshActiveBundle::compactShortBundle;
+            default:
+                return &StaticMeshActiveBundle::currentBundle;
+        }
+    }
+
+    ecs::entity_t createStaticMeshBundle(RxCore::Device * device,
+                                         ecs::World * world,
+                                         StaticMeshFormat format,
+                                         bool positionStream)
     {
         auto mbe = world->newEntity();
 
@@ -95,22 +260,26 @@ namespace RxEngine
             [=](MeshBundle * mb) {
                 mb->vertexCount = 0;
                 mb->indexCount = 0;
-                mb->vertexSize = sizeof(StaticMeshVertex);
+                mb->compact = format != StaticMeshFormat::Full;
+                mb->vertexSize = mb->compact
+                                     ? sizeof(StaticMeshCompactVertex)
+                                     : sizeof(StaticMeshVertex);
+                mb->indexSize = format == StaticMeshFormat::CompactShort
+                                    ? sizeof(uint16_t)
+                                    : sizeof(uint32_t);
+                mb->headerVertices = mb->compact ? compact_mesh_header_vertices : 0;
+                // Compact vertices are already no larger than a separate position would be
+                mb->positionStream = positionStream && !mb->compact;
                 //mb->useDescriptor = true;
-                mb->maxVertexCount = (256 * 1024 * 1024 / mb->vertexSize);
-                mb->maxIndexCount = mb->maxVertexCount;
+                mb->vertexLimit = (256 * 1024 * 1024 / mb->vertexSize);
+                mb->indexLimit = mb->vertexLimit;
 
-                mb->vertexBuffer = device->createBuffer(
-                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                    VMA_MEMORY_USAGE_GPU_ONLY, mb->maxVertexCount * mb->vertexSize
+                createBundleBuffers(
+                    device, mb, bundleCapacityFor(0, mb->vertexLimit),
+                    bundleCapacityFor(0, mb->indexLimit)
                 );
-
-                mb->indexBuffer = device->createIndexBuffer(
-                    VMA_MEMORY_USAGE_GPU_ONLY, static_cast<uint32_t>(mb->maxVertexCount * sizeof(uint32_t)),
-                    false
-                );
-                mb->address = mb->vertexBuffer->getDeviceAddress();
+                mb->vertexRanges.reset(mb->maxVertexCount);
+                mb->indexRanges.reset(mb->maxIndexCount);
             }
         );
 
@@ -134,11 +303,14 @@ namespace RxEngine
 
         //  RxCore::iVulkan()->VkDevice().getBufferAddress(bdai);
 
-        world->getSingletonUpdate<StaticMeshActiveBundle>()->currentBundle = mbe.id;
+        world->getSingletonUpdate<StaticMeshActiveBundle>()->*activeBundleFor(format) = mbe.id;
         return mbe.id;
     }
 
-    ecs::entity_t getActiveMeshBundle(RxCore::Device * device, ecs::World * world)
+    ecs::entity_t getActiveMeshBundle(RxCore::Device * device,
+                                      ecs::World * world,
+                                      StaticMeshFormat format,
+                                      bool positionStream)
     {
         auto smab = world->getSingleton<StaticMeshActiveBundle>();
         if (!smab) {
@@ -146,50 +318,184 @@ namespace RxEngine
             smab = world->getSingleton<StaticMeshActiveBundle>();
         }
 
-        if (world->isAlive(smab->currentBundle)) {
-            return smab->currentBundle;
+        if (world->isAlive(smab->*activeBundleFor(format))) {
+            return smab->*activeBundleFor(format);
+        }
+
+        return createStaticMeshBundle(device, world, format, positionStream);
+    }
+
+    template <typename V, typename I>
+    uint64_t copyToBuffers(UploadService * uploads,
+                           const std::vector<V> & meshVertices,
+                           const std::vector<I> & meshIndices,
+                           const MeshBundle * smb,
+                           const MeshBundleEntry & range)
+    {
+        assert(sizeof(V) == smb->vertexSize && sizeof(I) == smb->indexSize);
+
+        size_t v_size = meshVertices.size() * sizeof(V);
+        size_t i_size = meshIndices.size() * sizeof(I);
+
+        uploads->uploadBuffer(
+            smb->vertexBuffer->handle(), static_cast<VkDeviceSize>(range.vertexOffset) * smb->vertexSize,
+            meshVertices.data(), v_size
+        );
+        return uploads->uploadBuffer(
+            smb->indexBuffer->handle(), static_cast<VkDeviceSize>(range.indexOffset) * smb->indexSize,
+            meshIndices.data(), i_size
+        );
+    }
+
+    uint16_t quantizeUnorm16(float v)
+    {
+        return static_cast<uint16_t>(std::lround(std::clamp(v, 0.f, 1.f) * 65535.f));
+    }
+
+    int16_t quantizeSnorm16(float v)
+    {
+        return static_cast<int16_t>(std::lround(std::clamp(v, -1.f, 1.f) * 32767.f));
+    }
+
+    // Octahedral encoding, the normal is projected onto the octahedron |x|+|y|+|z| = 1 and the
+    // lower half folded over the upper
+    DirectX::XMFLOAT2 octEncode(float x, float y, float z)
+    {
+        const float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+        if (l1 == 0.f) {
+            return {0.f, 0.f};
+        }
+        float ox = x / l1;
+        float oy = y / l1;
+        if (z < 0.f) {
+            const float fx = (1.f - std::abs(oy)) * (ox >= 0.f ? 1.f : -1.f);
+            const float fy = (1.f - std::abs(ox)) * (oy >= 0.f ? 1.f : -1.f);
+            ox = fx;
+            oy = fy;
         }
+        return {ox, oy};
+    }
+
+    // Header vertices carry the bounds minimum and extent as floats, followed by the quantized
+    // vertices of the mesh
+    std::vector<StaticMeshCompactVertex> compactVertices(const RxAssets::MeshSaveData & msd)
+    {
+        const float min[3] = {msd.minpx, msd.minpy, msd.minpz};
+        float extent[3] = {msd.maxpx - msd.minpx, msd.maxpy - msd.minpy, msd.maxpz - msd.minpz};
+        for (auto & e: extent) {
+            e = e > 0.f ? e : 1.f;
+        }
+
+        std::vector<StaticMeshCompactVertex> vertices(
+            compact_mesh_header_vertices + msd.vertices.size()
+        );
+        const float header[8] = {min[0], min[1], min[2], 0.f, extent[0], extent[1], extent[2], 0.f};
+        static_assert(sizeof(header) == compact_mesh_header_vertices * sizeof(StaticMeshCompactVertex));
+        std::memcpy(vertices.data(), header, sizeof(header));
+
+        std::transform(
+            msd.vertices.begin(), msd.vertices.end(), vertices.begin() + compact_mesh_header_vertices,
+            [&](const RxAssets::MeshSaveVertex & m) {
+                const auto n = octEncode(m.nx, m.ny, m.nz);
+                return StaticMeshCompactVertex{
+                    quantizeUnorm16((m.x - min[0]) / extent[0]),
+                    quantizeUnorm16((m.y - min[1]) / extent[1]),
+                    quantizeUnorm16((m.z - min[2]) / extent[2]),
+                    0,
+                    quantizeSnorm16(n.x),
+                    quantizeSnorm16(n.y),
+                    DirectX::PackedVector::XMConvertFloatToHalf(m.uvx),
+                    DirectX::PackedVector::XMConvertFloatToHalf(m.uvy)
+                };
+            }
+        );
+        return vertices;
+    }
 
-        return createStaticMeshBundle(device, world);
+    std::string lodMeshName(const std::string & meshName, uint32_t level)
+    {
+        return meshName + "/lod" + std::to_string(level);
     }
 
-    void copyToBuffers(RxCore::Device * device,
-                       const std::vector<StaticMeshVertex> & meshVertices,
-                       const std::vector<uint32_t> & meshIndices,
-                       MeshBundle * smb)
+    std::vector<ecs::entity_t> createSubMeshes(ecs::World * world,
+                                               ecs::entity_t meshEntity,
+                                               const sol::table & subMeshes,
+                                               const std::vector<ecs::entity_t> & materials)
     {
-        size_t v_size = meshVertices.size() * sizeof(StaticMeshVertex);
-        size_t i_size = meshIndices.size() * sizeof(uint32_t);
+        std::vector<ecs::entity_t> entities;
+
+        uint32_t ix = 0;
+        for (auto &[k, v]: subMeshes) {
+            sol::table subMeshValue = v;
+
+            uint32_t first_index = subMeshValue.get<uint32_t>("first_index");
+            uint32_t index_count = subMeshValue.get<uint32_t>("index_count");
+            const uint32_t material = subMeshValue.get<uint32_t>("material");
+
+            entities.push_back(
+                world->newEntity()
+                //.set<ecs::InstanceOf>({{me.id}})
+                .set<SubMesh>({first_index, index_count, ix++})
+                .set<SubMeshOf>({{meshEntity}})
+                .set<UsesMaterial>({{materials[material]}}).id
+            );
+        }
+        return entities;
+    }
 
-        auto cb = device->transferCommandPool_->createTransferCommandBuffer();
-        cb->begin();
+    std::vector<MeshCluster> loadClusters(const std::string & clusterFile)
+    {
+        auto vfs = RxAssets::Vfs::getInstance();
 
-        const auto b1 = device->createStagingBuffer(v_size, meshVertices.data());
-        const auto b2 = device->createStagingBuffer(i_size, meshIndices.data());
+        auto size = vfs->getFilesize(clusterFile);
+        if (!size.has_value() || size.value() < 4 * sizeof(uint32_t)) {
+            spdlog::error("Unable to load mesh clusters {}", clusterFile);
+            return {};
+        }
 
-        cb->copyBuffer(b1, smb->vertexBuffer, 0, smb->vertexCount * smb->vertexSize, v_size);
-        cb->copyBuffer(b2, smb->indexBuffer, 0, smb->indexCount * sizeof(uint32_t), i_size);
+        std::vector<std::byte> data(size.value());
+        vfs->getFileContents(clusterFile, data.data());
 
-        smb->vertexCount += static_cast<uint32_t>(meshVertices.size());
-        smb->indexCount += static_cast<uint32_t>(meshIndices.size());
+        uint32_t header[4];
+        std::memcpy(header, data.data(), sizeof(header));
+        if (header[0] != mesh_cluster_magic || header[1] != mesh_cluster_version ||
+            data.size() < sizeof(header) + header[2] * sizeof(MeshCluster)) {
+            spdlog::error("Mesh clusters {} are not a supported cluster file", clusterFile);
+            return {};
+        }
 
-        cb->end();
-        cb->submitAndWait();
+        std::vector<MeshCluster> clusters(header[2]);
+        std::memcpy(
+            clusters.data(), data.data() + sizeof(header), clusters.size() * sizeof(MeshCluster)
+        );
+        return clusters;
     }
 
     void loadMesh(ecs::World * world,
                   RxCore::Device * device,
+                  UploadService * uploads,
                   std::string meshName,
-                  sol::table details)
+                  sol::table details,
+                  const StaticMeshLoadOptions & options)
     {
         //auto mbe = getActiveMeshBundle(world);
 
         std::string meshFile = details.get_or("mesh", std::string{""});
         auto vertices = details.get<uint32_t>("vertices");
         auto indices = details.get<uint32_t>("indices");
+        const bool compact = details.get_or("compact", options.compact);
 
-        std::vector<StaticMeshVertex> mesh_vertices(vertices);
+        const StaticMeshFormat format = !compact
+                                            ? StaticMeshFormat::Full
+                                            : vertices < 65536
+                                            ? StaticMeshFormat::CompactShort
+                                            : StaticMeshFormat::Compact;
+
+        std::vector<StaticMeshVertex> mesh_vertices;
+        std::vector<DirectX::XMFLOAT3> mesh_positions;
+        std::vector<StaticMeshCompactVertex> compact_vertices;
         std::vector<uint32_t> mesh_indices(indices);
+        std::vector<uint16_t> short_indices;
 
         RxAssets::MeshSaveData msd;
 
@@ -209,48 +515,91 @@ namespace RxEngine
         DirectX::BoundingSphere::CreateFromBoundingBox(bs, bb);
 
         std::copy(msd.indices.begin(), msd.indices.end(), mesh_indices.begin());
-        std::transform(
-            msd.vertices.begin(), msd.vertices.end(), mesh_vertices.begin(),
-            [](RxAssets::MeshSaveVertex & m) {
-                return StaticMeshVertex{
-                    {m.x, m.y, m.z}, 0.f, {m.nx, m.ny, m.nz}, 0.f, {m.uvx, m.uvy}, 0.f,
-                    0.f
-                };
+        if (format == StaticMeshFormat::Full) {
+            mesh_vertices.resize(vertices);
+            std::transform(
+                msd.vertices.begin(), msd.vertices.end(), mesh_vertices.begin(),
+                [](RxAssets::MeshSaveVertex & m) {
+                    return StaticMeshVertex{
+                        {m.x, m.y, m.z}, 0.f, {m.nx, m.ny, m.nz}, 0.f, {m.uvx, m.uvy}, 0.f,
+                        0.f
+                    };
+                }
+            );
+            if (options.positionStream) {
+                mesh_positions.resize(vertices);
+                std::transform(
+                    msd.vertices.begin(), msd.vertices.end(), mesh_positions.begin(),
+                    [](RxAssets::MeshSaveVertex & m) {
+                        return DirectX::XMFLOAT3{m.x, m.y, m.z};
+                    }
+                );
             }
-        );
-
-        auto mb = getActiveMeshBundle(device, world);
-        {
-            auto smb = world->get<MeshBundle>(mb);
+        } else {
+            compact_vertices = compactVertices(msd);
+        }
+        if (format == StaticMeshFormat::CompactShort) {
+            short_indices.resize(mesh_indices.size());
+            std::transform(
+                mesh_indices.begin(), mesh_indices.end(), short_indices.begin(),
+                [](uint32_t i) {
+                    return static_cast<uint16_t>(i);
+                }
+            );
+        }
 
-            if (mesh_vertices.size() + smb->vertexCount > smb->maxVertexCount || mesh_indices.size()
-                                                                                 +
-                                                                                 smb->indexCount > smb->maxIndexCount) {
-                mb = createStaticMeshBundle(device, world);
-                world->getSingletonUpdate<StaticMeshActiveBundle>()->currentBundle = mb;
+        const auto vertex_count = static_cast<uint32_t>(
+            format == StaticMeshFormat::Full ? mesh_vertices.size() : compact_vertices.size()
+        );
+        const uint32_t header_vertices =
+            format == StaticMeshFormat::Full ? 0 : compact_mesh_header_vertices;
+
+        auto static_mesh_entity = world->newEntity(meshName.c_str());
+
+        MeshBundleEntry range{};
+        auto allocate = [&](ecs::entity_t bundle) {
+            bool allocated = false;
+            world->update<MeshBundle>(
+                bundle, [&](MeshBundle * smb) {
+                    allocated = allocateBundleRanges(
+                        device, uploads, smb, static_mesh_entity.id, vertex_count,
+                        static_cast<uint32_t>(mesh_indices.size()), range
+                    );
+                }
+            );
+            return allocated;
+        };
+
+        auto mb = getActiveMeshBundle(device, world, format, options.positionStream);
+        if (!allocate(mb)) {
+            mb = createStaticMeshBundle(device, world, format, options.positionStream);
+            if (!allocate(mb)) {
+                spdlog::error("Mesh {} is too large for a mesh bundle", meshName);
+                static_mesh_entity.destroy();
+                return;
             }
         }
 
-        auto smb = world->get<MeshBundle>(mb);
-
-        auto static_mesh_entity = world->newEntity(meshName.c_str())
-                                       .set<Mesh>(
-                                           {
-                                               .vertexOffset = smb->vertexCount,
-                                               .indexOffset = smb->indexCount,
-                                               .indexCount = static_cast<uint32_t>(mesh_indices.size()),
-                                               .boundBox = bb
-                                           }
-                                       )
-                                       .set<InBundle>({{mb}});
-
-        world->update<MeshBundle>(
-            mb, [=](MeshBundle * smb2) {
-                copyToBuffers(device, mesh_vertices, mesh_indices, smb2);
-
-                smb2->entries.push_back(static_mesh_entity.id);
-            }
-        );
+        static_mesh_entity.set<Mesh>(
+                              {
+                                  .vertexOffset = range.vertexOffset + header_vertices,
+                                  .indexOffset = range.indexOffset,
+                                  .indexCount = static_cast<uint32_t>(mesh_indices.size()),
+                                  .boundBox = bb
+                              }
+                          )
+                          .set<InBundle>({{mb}});
+
+        const auto smb = world->get<MeshBundle>(mb);
+        uint64_t upload_ticket;
+        if (format == StaticMeshFormat::Full) {
+            uploadBundlePositions(uploads, smb, range, mesh_positions);
+            upload_ticket = copyToBuffers(uploads, mesh_vertices, mesh_indices, smb, range);
+        } else if (format == StaticMeshFormat::CompactShort) {
+            upload_ticket = copyToBuffers(uploads, compact_vertices, short_indices, smb, range);
+        } else {
+            upload_ticket = copyToBuffers(uploads, compact_vertices, mesh_indices, smb, range);
+        }
 
         //auto sm = mesh_prim_entity.addAndUpdate<StaticMesh>();
 
@@ -271,33 +620,100 @@ namespace RxEngine
         //auto smu = static_mesh_entity.get<Mesh>();
 
         static_mesh_entity.update<Mesh>([&](Mesh * smu){
+            smu->uploadTicket = upload_ticket;
+            smu->subMeshes = createSubMeshes(world, static_mesh_entity.id, smtab, mEntities);
+        });
 
-            uint32_t ix = 0;
-            for (auto &[k, v]: smtab) {
-                sol::table subMeshValue = v;
-
-                uint32_t first_index = subMeshValue.get<uint32_t>("first_index");
-                uint32_t index_count = subMeshValue.get<uint32_t>("index_count");
-                const uint32_t material = subMeshValue.get<uint32_t>("material");
-
-                //sm->subMeshes.push_back(
-                smu->subMeshes.push_back(
-                    world->newEntity()
-                    //.set<ecs::InstanceOf>({{me.id}})
-                    .set<SubMesh>({first_index, index_count, ix++})
-                    .set<SubMeshOf>({{static_mesh_entity.id}})
-                    .set<UsesMaterial>({{mEntities[material]}}).id
-                    );
+        const std::string cluster_file = details.get_or("clusters", std::string{});
+        if (!cluster_file.empty()) {
+            auto clusters = loadClusters(cluster_file);
+            if (!clusters.empty()) {
+                static_mesh_entity.set<MeshClusters>({std::move(clusters)});
             }
-        });
+        }
+
+        // Levels of detail generated by the importer are index ranges after the full mesh, they
+        // become meshes of their own sharing its bundle range
+        sol::optional<sol::table> lods = details["lods"];
+        if (!lods.has_value()) {
+            return;
+        }
+        for (auto &[k, v]: lods.value()) {
+            sol::table level = v;
+            sol::optional<sol::table> level_sub_meshes = level["submeshes"];
+            if (!level_sub_meshes.has_value()) {
+                continue;
+            }
+
+            auto lod_entity = world->newEntity(lodMeshName(meshName, k.as<uint32_t>()).c_str());
+            lod_entity.set<Mesh>(
+                          {
+                              .vertexOffset = range.vertexOffset + header_vertices,
+                              .indexOffset = range.indexOffset,
+                              .indexCount = static_cast<uint32_t>(mesh_indices.size()),
+                              .boundBox = bb,
+                              .uploadTicket = upload_ticket
+                          }
+                      )
+                      .set<InBundle>({{mb}})
+                      .set<LodOf>({{static_mesh_entity.id}});
+
+            lod_entity.update<Mesh>([&](Mesh * lm) {
+                lm->subMeshes = createSubMeshes(world, lod_entity.id, level_sub_meshes.value(), mEntities);
+            });
+        }
     }
 
-    void loadMeshes(ecs::World * world, RxCore::Device * device, sol::table & meshes)
+    void loadMeshes(ecs::World * world,
+                    RxCore::Device * device,
+                    UploadService * uploads,
+                    sol::table & meshes,
+                    const StaticMeshLoadOptions & options)
     {
         for (auto &[key, value]: meshes) {
             const std::string name = key.as<std::string>();
             const sol::table details = value;
-            loadMesh(world, device, name, details);
+            loadMesh(world, device, uploads, name, details, options);
+        }
+
+        // Levels can name meshes loaded after them, so they are linked once all are loaded
+        for (auto &[key, value]: meshes) {
+            const std::string name = key.as<std::string>();
+            const sol::table details = value;
+            sol::optional<sol::table> lods = details["lods"];
+            auto mesh_entity = world->lookup(name.c_str());
+            if (!lods.has_value() || !mesh_entity.isAlive()) {
+                continue;
+            }
+
+            std::vector<std::pair<float, ecs::entity_t>> levels;
+            for (auto &[k, v]: lods.value()) {
+                sol::table level = v;
+                const std::string level_name = level.get_or(
+                    "mesh", lodMeshName(name, k.as<uint32_t>())
+                );
+                auto level_entity = world->lookup(level_name.c_str());
+                if (!level_entity.isAlive() || !level_entity.has<Mesh>()) {
+                    spdlog::error("Mesh {} has a missing level of detail {}", name, level_name);
+                    continue;
+                }
+                levels.emplace_back(level.get<float>("coverage"), level_entity.id);
+            }
+            if (levels.size() > max_mesh_lods - 1) {
+                spdlog::warn("Mesh {} has more than {} levels of detail", name, max_mesh_lods);
+            }
+            std::ranges::sort(levels, std::greater{});
+
+            MeshLods ml{};
+            for (auto &[coverage, level_entity]: levels) {
+                if (ml.count == ml.meshes.size()) {
+                    break;
+                }
+                ml.meshes[ml.count] = level_entity;
+                ml.coverage[ml.count] = coverage;
+                ml.count++;
+            }
+            mesh_entity.set<MeshLods>(ml);
         }
     }
 
@@ -305,9 +721,137 @@ namespace RxEngine
     {
         sol::optional<sol::table> meshes = data["mesh"];
 
+        // Data is loaded before startup. The compact shaders find a mesh's bounds from
+        // gl_BaseVertex, which needs the shaderDrawParameters feature enabled on the device.
+        loadOptions_.compact = engine_->getBoolConfigValue("render", "compactMeshes", false);
+        loadOptions_.positionStream = engine_->getBoolConfigValue("render", "positionStream", true);
+
         if (meshes.has_value()) {
-            loadMeshes(world_, engine_->getDevice(), meshes.value());
+            loadMeshes(
+                world_, engine_->getDevice(), engine_->getUploadService(), meshes.value(),
+                loadOptions_
+            );
+        }
+    }
+
+    void StaticMeshModule::rebuildRenderProxies()
+    {
+        OPTICK_EVENT()
+
+        renderProxies_.clear();
+        auto res = world_->getResults(worldObjects_);
+        res.each<InstanceSlot>(
+            [&](ecs::EntityHandle e, const InstanceSlot *) {
+                renderProxies_.update(world_, e);
+            }
+        );
+        renderProxiesDirty_ = false;
+    }
+
+    // Adds the coverage each material was drawn at, gathered per cull chunk, to the frame's feedback
+    void StaticMeshModule::publishTextureFeedback(const std::vector<TextureFeedback> & chunkFeedback)
+    {
+        auto feedback = world_->getSingletonUpdate<TextureFeedback>();
+        if (!feedback) {
+            return;
+        }
+        for (auto & chunk: chunkFeedback) {
+            for (uint32_t m = 0; m < chunk.coverage.size(); m++) {
+                feedback->note(m, chunk.coverage[m]);
+            }
+        }
+    }
+
+    // The GPU culls what is drawn, the feedback comes from the rows inside the frustum
+    void StaticMeshModule::gatherTextureFeedback()
+    {
+        OPTICK_EVENT("Texture Feedback")
+
+        auto scene_camera = world_->getSingleton<SceneCamera>();
+        auto frustum = world_->get<CameraFrustum>(scene_camera->camera);
+
+        auto & proxies = renderProxies_;
+        const auto eye = DirectX::XMLoadFloat3(&frustum->frustum.Origin);
+        const float coverage_scale = std::abs(scene_camera->shaderData.projection._22);
+
+        std::vector<uint32_t> visible;
+        visible.reserve(proxies.size());
+        cullSpheres(proxies.bounds, makeCullPlanes(frustum->frustum), visible);
+
+        std::vector<TextureFeedback> feedback(1);
+        for (auto row: visible) {
+            const auto centre = DirectX::XMVectorSet(
+                proxies.bounds.x[row], proxies.bounds.y[row], proxies.bounds.z[row], 0.0f
+            );
+            const float distance = DirectX::XMVectorGetX(
+                DirectX::XMVector3Length(DirectX::XMVectorSubtract(centre, eye))
+            );
+            const float radius = proxies.bounds.radius[row];
+            feedback[0].note(
+                proxies.materials[row], distance > radius ? radius * coverage_scale / distance : 1.0f
+            );
         }
+
+        publishTextureFeedback(feedback);
+    }
+
+    // Draws the hulls of the occluders in view into the occlusion buffer, false when there were
+    // none to draw and nothing can be culled by it
+    bool StaticMeshModule::drawOccluders(
+        const DirectX::BoundingFrustum & frustum,
+        const DirectX::XMMATRIX & viewProjection)
+    {
+        OPTICK_EVENT("Draw Occluders")
+
+        occlusionBuffer_.clear();
+
+        auto res = world_->getResults(worldObjects_);
+        res.each<WorldTransform, WorldBoundingSphere, HasVisiblePrototype>(
+            [&](ecs::EntityHandle,
+                const WorldTransform * wt,
+                const WorldBoundingSphere * wbs,
+                const HasVisiblePrototype * vpp) {
+                auto occluder = world_->get<Occluder>(vpp->entity);
+                if (!occluder || occluder->indices.empty() || !frustum.Intersects(wbs->boundSphere)) {
+                    return;
+                }
+                occlusionBuffer_.addOccluder(
+                    occluder->vertices.data(), occluder->indices.data(),
+                    static_cast<uint32_t>(occluder->indices.size()),
+                    DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&wt->transform), viewProjection)
+                );
+            }
+        );
+
+        if (occlusionBuffer_.triangleCount() == 0) {
+            return false;
+        }
+
+        // Each band of tile rows is drawn by its own job
+        const uint32_t band_rows = OcclusionBuffer::tile_height * 4;
+        const uint32_t band_count = (occlusionBuffer_.height() + band_rows - 1) / band_rows;
+        std::vector<std::shared_ptr<RxCore::Job<uint32_t>>> jobs(band_count);
+
+        for (uint32_t b = 0; b < band_count; b++) {
+            jobs[b] = RxCore::CreateJob<uint32_t>(
+                [&, b]() -> uint32_t {
+                    OPTICK_EVENT("Rasterize Occluders")
+                    occlusionBuffer_.rasterize(
+                        b * band_rows, std::min((b + 1) * band_rows, occlusionBuffer_.height())
+                    );
+                    return 0;
+                }
+            );
+            jobs[b]->schedule();
+        }
+        {
+            OPTICK_EVENT("Wait for Occluders", Optick::Category::Wait)
+            for (auto & job: jobs) {
+                job->waitComplete();
+            }
+        }
+
+        return true;
     }
 
     void StaticMeshModule::createOpaqueRenderCommands()
@@ -330,168 +874,875 @@ namespace RxEngine
         auto scene_camera = world_->getSingleton<SceneCamera>();
         auto frustum = world_->get<CameraFrustum>(scene_camera->camera);
 
-        DirectX::XMVECTOR planes[6];
-        frustum->frustum.GetPlanes(
-            &planes[0], &planes[1], &planes[2], &planes[3], &planes[4],
-            &planes[5]
-        );
+        auto & proxies = renderProxies_;
+        const auto planes = makeCullPlanes(frustum->frustum);
+
+        const auto eye = DirectX::XMLoadFloat3(&frustum->frustum.Origin);
+        const float depth_scale = 1.0f / frustum->frustum.Far;
+        // Screen coverage of a sphere is its radius over distance scaled by the projection
+        const float coverage_scale = std::abs(scene_camera->shaderData.projection._22);
+        const float lod_hysteresis = lodHysteresis_;
 
-        std::vector<std::tuple<const RenderDetailCache *, ecs::entity_t, uint32_t>> instances;
-        std::atomic<size_t> ix = 0;
+        const auto view_projection = DirectX::XMMatrixMultiply(
+            DirectX::XMLoadFloat4x4(&scene_camera->shaderData.view),
+            DirectX::XMLoadFloat4x4(&scene_camera->shaderData.projection)
+        );
+        const bool occlusion = softwareOcclusion_ && drawOccluders(frustum->frustum, view_projection);
+
+        // Each chunk of rows is culled by its own job into its own list of sort items, the lists
+        // are joined and radix sorted
+        const uint32_t chunk_count = (proxies.size() + cull_chunk_rows - 1) / cull_chunk_rows;
+        std::vector<std::vector<DrawSortItem>> chunks(chunk_count);
+        std::vector<uint32_t> occlusion_tested(chunk_count);
+        std::vector<uint32_t> occlusion_culled(chunk_count);
+        std::vector<TextureFeedback> texture_feedback(chunk_count);
         {
-            OPTICK_EVENT("Collect instances")
-            auto res = world_->getResults(worldObjects_);
+            OPTICK_EVENT("Cull Proxies")
+            std::vector<std::shared_ptr<RxCore::Job<uint32_t>>> jobs(chunk_count);
+
+            for (uint32_t c = 0; c < chunk_count; c++) {
+                jobs[c] = RxCore::CreateJob<uint32_t>(
+                    [&, c]() -> uint32_t {
+                        OPTICK_EVENT("Cull Chunk")
+                        const uint32_t begin = c * cull_chunk_rows;
+                        const uint32_t end = std::min(begin + cull_chunk_rows, proxies.size());
+
+                        std::vector<uint32_t> visible;
+                        visible.reserve(end - begin);
+                        cullSpheres(proxies.bounds, planes, begin, end, visible);
+
+                        auto & items = chunks[c];
+                        items.reserve(visible.size());
+                        for (auto row: visible) {
+                            if (occlusion) {
+                                const float r = proxies.bounds.radius[row];
+                                const DirectX::BoundingBox box(
+                                    {proxies.bounds.x[row], proxies.bounds.y[row], proxies.bounds.z[row]}, {r, r, r}
+                                );
+                                occlusion_tested[c]++;
+                                if (occlusionBuffer_.boxOccluded(box, view_projection)) {
+                                    occlusion_culled[c]++;
+                                    continue;
+                                }
+                            }
+                            const auto centre = DirectX::XMVectorSet(
+                                proxies.bounds.x[row], proxies.bounds.y[row], proxies.bounds.z[row], 0.0f
+                            );
+                            const float distance = DirectX::XMVectorGetX(
+                                DirectX::XMVector3Length(DirectX::XMVectorSubtract(centre, eye))
+                            );
+                            const float radius = proxies.bounds.radius[row];
+                            if (proxies.lodSets[row] != RenderProxyTable::no_lod_set) {
+                                const float coverage = distance > radius
+                                                           ? radius * coverage_scale / distance
+                                                           : std::numeric_limits<float>::max();
+                                proxies.selectLod(row, coverage, lod_hysteresis);
+                            }
+                            if (textureFeedback_) {
+                                texture_feedback[c].note(
+                                    proxies.materials[row],
+                                    distance > radius ? radius * coverage_scale / distance : 1.0f
+                                );
+                            }
+                            // Dead rows and submeshes still waiting on render details have no pipeline
+                            if (!proxies.opaquePipelines[row]) {
+                                continue;
+                            }
+                            items.push_back(
+                                {DrawSortKeys::withDepth(proxies.sortKeys[row], distance * depth_scale), row}
+                            );
+                        }
+                        return static_cast<uint32_t>(items.size());
+                    }
+                );
+                jobs[c]->schedule();
+            }
             {
-                OPTICK_EVENT("Resize")
-                if (instances.size() < res.count() * 2) {
-                    instances.resize(res.count() * 2);
-                    mats.resize(res.count() * 2);
+                OPTICK_EVENT("Wait for Chunks", Optick::Category::Wait)
+                for (auto & job: jobs) {
+                    job->waitComplete();
                 }
             }
+        }
+
+        if (occlusion) {
+            auto fs = world_->getSingletonUpdate<FrameStats>();
+            for (uint32_t c = 0; c < chunk_count; c++) {
+                fs->occlusionTested += occlusion_tested[c];
+                fs->occlusionCulled += occlusion_culled[c];
+            }
+        }
+
+        if (textureFeedback_) {
+            publishTextureFeedback(texture_feedback);
+        }
+
+        std::vector<DrawSortItem> instances;
+        {
+            OPTICK_EVENT("Sort Instances")
+            size_t total = 0;
+            for (auto & chunk: chunks) {
+                total += chunk.size();
+            }
+            instances.reserve(total);
+            for (auto & chunk: chunks) {
+                instances.insert(instances.end(), chunk.begin(), chunk.end());
+            }
+            radixSortDrawItems(instances, sortScratch_);
+        }
+
+        IndirectDrawSet ids;
+
+        {
+            OPTICK_EVENT("Build Draw Commands")
+            ecs::entity_t prevPL = 0;
+            ecs::entity_t prevBundle = 0;
+            uint32_t prevVertexOffset = std::numeric_limits<uint32_t>::max();
+            uint32_t prevIndexOffset = std::numeric_limits<uint32_t>::max();
+
+            uint32_t headerIndex = 0;
+            uint32_t commandIndex = 0;
+            ids.instances.reserve(instances.size());
+
+            for (auto & item: instances) {
+                const auto row = item.index;
+                const auto rpipeline = proxies.opaquePipelines[row];
+                const auto bundle = proxies.bundles[row];
+                const auto vertex_offset = proxies.vertexOffsets[row];
+                const auto index_offset = proxies.indexOffsets[row];
+
+                if (prevPL != rpipeline || bundle != prevBundle) {
+                    headerIndex = static_cast<uint32_t>(ids.headers.size());
+                    ids.headers
+                       .push_back(
+                           IndirectDrawCommandHeader{
+                               rpipeline,
+                               bundle,
+                               static_cast<uint32_t>(ids.commands.size()),
+                               0
+                           }
+                       );
+
+                    prevPL = rpipeline;
+                    prevBundle = bundle;
+                    prevVertexOffset = std::numeric_limits<uint32_t>::max();
+                }
+
+                if (vertex_offset != prevVertexOffset || index_offset != prevIndexOffset) {
+                    commandIndex = static_cast<uint32_t>(ids.commands.size());
+                    ids.commands.push_back(
+                        {
+                            proxies.indexCounts[row], 0, index_offset,
+                            static_cast<int32_t>(vertex_offset),
+                            static_cast<uint32_t>(ids.instances.size())
+                        }
+                    );
+                    ids.headers[headerIndex].commandCount++;
+                    prevVertexOffset = vertex_offset;
+                    prevIndexOffset = index_offset;
+                }
+
+                ids.instances.push_back({proxies.slots[row], proxies.materials[row]});
+                ids.commands[commandIndex].instanceCount++;
+            }
+        }
+
+        if (ids.instances.empty()) {
+            return;
+        }
+
+        const auto buffers = MeshModule::createInstanceBuffer(engine_, ids, instanceBuffers);
+        MeshModule::drawInstances(buffers, world_, pipeline, layout, ids);
+    }
+
+    void StaticMeshModule::createShadowRenderCommands()
+    {
+        OPTICK_CATEGORY("Render Static Shadows", ::Optick::Category::Rendering)
+
+        if (!shadowPipeline_.isAlive()) {
+            shadowPipeline_ = world_->lookup("pipeline/staticmesh_shadow");
+        }
+        auto pipeline = shadowPipeline_.get<GraphicsPipeline>();
+
+        if (!pipeline) {
+            return;
+        }
+        const auto layout = shadowPipeline_.getRelated<UsesLayout, PipelineLayout>();
+
+        auto scd = world_->getSingleton<ShadowCascadeData>();
+        if (!scd || scd->cascades.empty()) {
+            return;
+        }
+
+        const auto cascade_count = std::min(
+            static_cast<uint32_t>(scd->cascades.size()),
+            static_cast<uint32_t>(shadowInstanceBuffers_.size())
+        );
+
+        // The cache holds static casters, so anything placed, moved or destroyed invalidates
+        // every cascade
+        if (scd->cached && shadowCastersChanged_) {
+            world_->getSingletonUpdate<ShadowCascadeData>()->refreshMask = (1u << cascade_count) - 1;
+            scd = world_->getSingleton<ShadowCascadeData>();
+        }
+        shadowCastersChanged_ = false;
+
+        const uint32_t refresh_mask = scd->refreshMask;
+        if (refresh_mask == 0) {
+            return;
+        }
+
+        ShadowCasterSet casters;
+        {
+            OPTICK_EVENT("Collect casters")
+            // The keys are only compared within this caster set
+            shadowSortKeys_.clear();
+            auto res = world_->getResults(worldObjects_);
 
-            res.each<WorldTransform, WorldBoundingSphere, HasVisiblePrototype>(
+            casters.spheres.reserve(res.count());
+            casters.subMeshRanges.reserve(res.count());
+            casters.slots.reserve(res.count());
+
+            res.each<WorldBoundingSphere, HasVisiblePrototype, InstanceSlot>(
                 [&](ecs::EntityHandle e,
-                    const WorldTransform * wt,
                     const WorldBoundingSphere * wbs,
-                    const HasVisiblePrototype * vpp) {
+                    const HasVisiblePrototype * vpp,
+                    const InstanceSlot * is) {
                     auto vp = world_->get<VisiblePrototype>(vpp->entity);
-                    //OPTICK_EVENT("Process Entity")
                     if (!vp) {
                         return;
                     }
-                    DirectX::BoundingSphere bs = wbs->boundSphere;
-                    //auto tx = XMLoadFloat4x4(&wt->transform);
-                    //vp->boundingSphere.Transform(bs, tx);
-
-                    for (auto & plane: planes) {
-                        DirectX::XMVECTOR c = DirectX::XMLoadFloat3(&bs.Center);
-                        c = DirectX::XMVectorSetW(c, 1.f);
-
-                        DirectX::XMVECTOR Dist = DirectX::XMVector4Dot(c, plane);
-                        if (DirectX::XMVectorGetX(Dist) > bs.Radius) {
-                            return;
-                        }
-                    }
+                    auto start = static_cast<uint32_t>(casters.subMeshes.size());
                     for (auto & sm: vp->subMeshEntities) {
                         auto rdc = world_->get<RenderDetailCache>(sm);
-                        if (!rdc || !rdc->opaquePipeline) {
-                            return;
-                        }
-                        {
-                            size_t ix2 = ix++;
-                            mats[ix2] = wt->transform;
-
-                            instances[ix2] = {
-                                rdc, rdc->opaquePipeline,
-                                static_cast<uint32_t>(ix2)
-                            };
+                        if (!rdc || !rdc->shadowPipeline) {
+                            continue;
                         }
+                        auto mm = world_->get<Material>(rdc->material);
+                        casters.subMeshes.push_back(
+                            {
+                                rdc, mm->sequence,
+                                shadowSortKeys_.makeKey(
+                                    rdc->shadowPipeline, rdc->bundle, rdc->vertexOffset, rdc->indexOffset, 0
+                                )
+                            }
+                        );
                     }
+                    auto count = static_cast<uint32_t>(casters.subMeshes.size()) - start;
+                    if (count == 0) {
+                        return;
+                    }
+                    casters.spheres.push_back(wbs->boundSphere);
+                    casters.subMeshRanges.emplace_back(start, count);
+                    casters.slots.push_back(is->slot);
                 }
             );
         }
-        {
-            OPTICK_EVENT("Sort Instances")
-            std::sort(
-                instances.begin(),
-                instances.begin() + ix,
-                [](const auto & a, const auto & b) {
-                    auto &[ar, apipeline, am] = a;
-                    auto &[br, bpipeline, bm] = b;
-                    if (apipeline < bpipeline) {
-                        return true;
-                    }
-                    if (apipeline > bpipeline) {
-                        return false;
-                    }
-                    if (ar->bundle < br->bundle) {
-                        return true;
-                    }
-                    if (ar->bundle > br->bundle) {
-                        return false;
-                    }
-                    return ar->vertexOffset < br->vertexOffset;
+
+        if (casters.spheres.size() == 0) {
+            return;
+        }
+
+        std::vector<Render::ShadowRenderCommand> commands(cascade_count);
+        std::vector<std::shared_ptr<RxCore::Job<uint32_t>>> jobs(cascade_count);
+
+        for (uint32_t i = 0; i < cascade_count; i++) {
+            if (!(refresh_mask & (1u << i))) {
+                continue;
+            }
+            jobs[i] = RxCore::CreateJob<uint32_t>(
+                [&, i]() -> uint32_t {
+                    OPTICK_EVENT("Shadow Cascade")
+                    commands[i] = createShadowCascadeCommand(
+                        i, scd->cascades[i], casters, pipeline, layout
+                    );
+                    return 0;
                 }
             );
+            jobs[i]->schedule();
         }
-        IndirectDrawSet ids;
+        {
+            OPTICK_EVENT("Wait for Cascades", Optick::Category::Wait)
+            for (auto & job: jobs) {
+                if (job) {
+                    job->waitComplete();
+                }
+            }
+        }
+
+        auto stream = world_->getStream<Render::ShadowRenderCommand>();
+        for (auto & command: commands) {
+            if (command.buf) {
+                command.cached = true;
+                stream->add<Render::ShadowRenderCommand>(command);
+            }
+        }
+    }
 
+    Render::ShadowRenderCommand StaticMeshModule::createShadowCascadeCommand(
+        uint32_t cascadeIndex,
+        const ShadowCascade & cascade,
+        const ShadowCasterSet & casters,
+        const GraphicsPipeline * pipeline,
+        const PipelineLayout * layout)
+    {
+        std::vector<uint32_t> selected;
+        Renderer::cullEntitiesOrtho(cascade.boBox, casters.spheres, selected);
+
+        // Orthographic, so the footprint of a caster only depends on the cascade extent
+        const float texels_per_unit =
+            static_cast<float>(SHADOW_MAP_SIZE) / (cascade.boBox.Extents.x * 2.0f);
+        const float min_diameter = static_cast<float>(minShadowCasterTexels_) / texels_per_unit;
+
+        std::vector<std::pair<const ShadowCasterSubMesh *, uint32_t>> instances;
+        std::vector<DrawSortItem> items;
+        {
+            OPTICK_EVENT("Select casters")
+            instances.reserve(selected.size());
+            items.reserve(selected.size());
+            for (auto ci: selected) {
+                if (casters.spheres.radius[ci] * 2.0f < min_diameter) {
+                    continue;
+                }
+                auto &[start, count] = casters.subMeshRanges[ci];
+                for (uint32_t k = 0; k < count; k++) {
+                    auto sm = &casters.subMeshes[start + k];
+                    items.push_back({sm->sortKey, static_cast<uint32_t>(instances.size())});
+                    instances.emplace_back(sm, ci);
+                }
+            }
+        }
+        {
+            OPTICK_EVENT("Sort Instances")
+            std::vector<DrawSortItem> scratch;
+            radixSortDrawItems(items, scratch);
+        }
+
+        IndirectDrawSet ids;
         {
             OPTICK_EVENT("Build Draw Commands")
             ecs::entity_t prevPL = 0;
             ecs::entity_t prevBundle = 0;
-            //uint32_t prevMix = RX_INVALID_ID;
             uint32_t prevVertexOffset = std::numeric_limits<uint32_t>::max();
+            uint32_t prevIndexOffset = std::numeric_limits<uint32_t>::max();
 
             uint32_t headerIndex = 0;
             uint32_t commandIndex = 0;
 
-            for (size_t i = 0; i < ix; i++) {
-                auto & instance = instances[i];
-                auto &[rdc, rpipeline, m] = instance;
-
-                if (prevPL != rpipeline || rdc->bundle != prevBundle) {
+            for (auto & item: items) {
+                auto &[sm, ci] = instances[item.index];
+                auto rdc = sm->rdc;
 
+                if (prevPL != rdc->shadowPipeline || rdc->bundle != prevBundle) {
                     headerIndex = static_cast<uint32_t>(ids.headers.size());
-                    ids.headers
-                       .push_back(
-                           IndirectDrawCommandHeader{
-                               rpipeline,
-                               rdc->bundle,
-                               static_cast<uint32_t>(ids.commands.size()),
-                               0
-                           }
-                       );
+                    ids.headers.push_back(
+                        IndirectDrawCommandHeader{
+                            rdc->shadowPipeline,
+                            rdc->bundle,
+                            static_cast<uint32_t>(ids.commands.size()),
+                            0
+                        }
+                    );
 
-                    prevPL = rpipeline;
+                    prevPL = rdc->shadowPipeline;
                     prevBundle = rdc->bundle;
+                    prevVertexOffset = std::numeric_limits<uint32_t>::max();
                 }
 
-                if (rdc->vertexOffset != prevVertexOffset) {
+                if (rdc->vertexOffset != prevVertexOffset || rdc->indexOffset != prevIndexOffset) {
                     commandIndex = static_cast<uint32_t>(ids.commands.size());
                     ids.commands.push_back(
                         {
-                            rdc->indexCount,
-                            rdc->vertexOffset,
-                            rdc->indexOffset, 0, static_cast<uint32_t>(ids.instances.size())
+                            rdc->indexCount, 0, rdc->indexOffset,
+                            static_cast<int32_t>(rdc->vertexOffset),
+                            static_cast<uint32_t>(ids.instances.size())
                         }
                     );
                     ids.headers[headerIndex].commandCount++;
                     prevVertexOffset = rdc->vertexOffset;
+                    prevIndexOffset = rdc->indexOffset;
                 }
 
-                auto mm = world_->get<Material>(rdc->material);
-
-                ids.instances.push_back({mats[m], mm->sequence, 0, 0, 0});
+                ids.instances.push_back({casters.slots[ci], sm->materialId});
                 ids.commands[commandIndex].instanceCount++;
             }
         }
 
         if (ids.instances.empty()) {
-            return;
+            return {};
         }
 
-        createInstanceBuffer(ids);
-        MeshModule::drawInstances(
-            instanceBuffers.buffers[instanceBuffers.ix], world_, pipeline,
-            layout, ids
+        const auto buffers = MeshModule::createInstanceBuffer(
+            engine_, ids, shadowInstanceBuffers_[cascadeIndex]
+        );
+
+        return MeshModule::drawShadowInstances(
+            buffers, world_, pipeline, layout, ids, cascadeIndex, SHADOW_MAP_SIZE
         );
     }
 
-    void StaticMeshModule::createInstanceBuffer(IndirectDrawSet & ids)
+    void StaticMeshModule::buildGpuCullTable()
     {
-        instanceBuffers.ix = (instanceBuffers.ix + 1) % instanceBuffers.count;
-        if (instanceBuffers.sizes[instanceBuffers.ix] < ids.instances.size()) {
-            auto n = ids.instances.size() * 2;
-            auto b = engine_->createStorageBuffer(n * sizeof(IndirectDrawInstance));
+        OPTICK_EVENT("Build GPU Cull Table")
+
+        std::vector<GpuCullEntry> entries;
+
+        // Submeshes of meshes split into clusters are culled a cluster at a time, each cluster
+        // drawing its own part of the submesh's index range
+        auto add_clusters = [&](ecs::entity_t subMesh, const GpuCullEntry & entry) {
+            auto sm = world_->get<SubMesh>(subMesh);
+            auto smo = world_->get<SubMeshOf>(subMesh);
+            if (!sm || !smo) {
+                return false;
+            }
+            auto mc = world_->get<MeshClusters>(smo->entity);
+            if (!mc) {
+                return false;
+            }
 
-            instanceBuffers.buffers[instanceBuffers.ix] = b;
-            b->map();
-            instanceBuffers.sizes[instanceBuffers.ix] = static_cast<uint32_t>(n);
+            const uint32_t mesh_index_offset = entry.indexOffset - sm->indexOffset;
+
+            bool added = false;
+            for (auto & cluster: mc->clusters) {
+                if (cluster.subMeshIndex != sm->subMeshIndex) {
+                    continue;
+                }
+                GpuCullEntry ce = entry;
+                ce.indexOffset = mesh_index_offset + cluster.firstIndex;
+                ce.indexCount = cluster.indexCount;
+                ce.sphere = {cluster.center.x, cluster.center.y, cluster.center.z, cluster.radius};
+                ce.cone = {cluster.coneAxis.x, cluster.coneAxis.y, cluster.coneAxis.z, cluster.coneCutoff};
+                entries.push_back(ce);
+                added = true;
+            }
+            return added;
+        };
+
+        auto res = world_->getResults(worldObjects_);
+        res.each<InstanceSlot, LocalBoundingBox, HasVisiblePrototype>(
+            [&](ecs::EntityHandle,
+                const InstanceSlot * is,
+                const LocalBoundingBox * lbb,
+                const HasVisiblePrototype * vpp) {
+                auto vp = world_->get<VisiblePrototype>(vpp->entity);
+                if (!vp) {
+                    return;
+                }
+                DirectX::BoundingSphere bs;
+                DirectX::BoundingSphere::CreateFromBoundingBox(bs, lbb->boundBox);
+
+                for (auto & sm: vp->subMeshEntities) {
+                    auto rdc = world_->get<RenderDetailCache>(sm);
+                    if (!rdc || !rdc->opaquePipeline) {
+                        continue;
+                    }
+                    auto mm = world_->get<Material>(rdc->material);
+                    const GpuCullEntry entry{
+                        rdc->opaquePipeline, rdc->bundle, rdc->vertexOffset, rdc->indexOffset,
+                        rdc->indexCount, mm->sequence, is->slot,
+                        {bs.Center.x, bs.Center.y, bs.Center.z, bs.Radius},
+                        {0.f, 0.f, 1.f, 1.f}
+                    };
+                    if (!clusterCulling_ || !add_clusters(sm, entry)) {
+                        entries.push_back(entry);
+                    }
+                }
+            }
+        );
+
+        std::sort(
+            entries.begin(),
+            entries.end(),
+            [](const GpuCullEntry & a, const GpuCullEntry & b) {
+                if (a.pipeline != b.pipeline) {
+                    return a.pipeline < b.pipeline;
+                }
+                if (a.bundle != b.bundle) {
+                    return a.bundle < b.bundle;
+                }
+                if (a.vertexOffset != b.vertexOffset) {
+                    return a.vertexOffset < b.vertexOffset;
+                }
+                return a.indexOffset < b.indexOffset;
+            }
+        );
+
+        auto table = std::make_shared<GpuCullTable>();
+        std::vector<GpuCullInstance> cull_instances;
+        cull_instances.reserve(entries.size());
+
+        ecs::entity_t prevPL = 0;
+        ecs::entity_t prevBundle = 0;
+        uint32_t prevVertexOffset = std::numeric_limits<uint32_t>::max();
+        uint32_t prevIndexOffset = std::numeric_limits<uint32_t>::max();
+        uint32_t headerIndex = 0;
+
+        for (auto & entry: entries) {
+            if (prevPL != entry.pipeline || entry.bundle != prevBundle) {
+                headerIndex = static_cast<uint32_t>(table->headers.size());
+                table->headers.push_back(
+                    IndirectDrawCommandHeader{
+                        entry.pipeline,
+                        entry.bundle,
+                        static_cast<uint32_t>(table->commands.size()),
+                        0
+                    }
+                );
+                prevPL = entry.pipeline;
+                prevBundle = entry.bundle;
+                prevVertexOffset = std::numeric_limits<uint32_t>::max();
+                prevIndexOffset = std::numeric_limits<uint32_t>::max();
+            }
+
+            if (entry.vertexOffset != prevVertexOffset || entry.indexOffset != prevIndexOffset) {
+                // instanceCount is left at zero and the culling pass counts surviving instances
+                // into it, the range reserved starts at instanceOffset
+                table->commands.push_back(
+                    {
+                        entry.indexCount, 0, entry.indexOffset,
+                        static_cast<int32_t>(entry.vertexOffset),
+                        static_cast<uint32_t>(cull_instances.size())
+                    }
+                );
+                table->headers[headerIndex].commandCount++;
+                prevVertexOffset = entry.vertexOffset;
+                prevIndexOffset = entry.indexOffset;
+            }
+
+            cull_instances.push_back(
+                {
+                    entry.sphere,
+                    static_cast<uint32_t>(table->commands.size() - 1),
+                    entry.materialId,
+                    entry.transformSlot,
+                    0,
+                    entry.cone
+                }
+            );
+        }
+
+        table->instanceCount = static_cast<uint32_t>(cull_instances.size());
+
+        // For each command, the header it belongs to and where that header's commands start,
+        // used to compact non-empty commands when drawing with an indirect count
+        std::vector<uint32_t> command_headers;
+        command_headers.reserve(table->commands.size() * 2);
+        for (uint32_t hi = 0; hi < table->headers.size(); hi++) {
+            auto & h = table->headers[hi];
+            for (uint32_t i = 0; i < h.commandCount; i++) {
+                command_headers.push_back(hi);
+                command_headers.push_back(h.commandStart);
+            }
+        }
+
+        if (!cull_instances.empty()) {
+            table->cullInstances = engine_->createStorageBuffer(
+                cull_instances.size() * sizeof(GpuCullInstance)
+            );
+            table->cullInstances->map();
+            table->cullInstances->update(
+                cull_instances.data(),
+                cull_instances.size() * sizeof(GpuCullInstance)
+            );
+
+            table->commandHeaders = engine_->createStorageBuffer(
+                command_headers.size() * sizeof(uint32_t)
+            );
+            table->commandHeaders->map();
+            table->commandHeaders->update(
+                command_headers.data(),
+                command_headers.size() * sizeof(uint32_t)
+            );
+        }
+
+        if (gpuCullTable_) {
+            retiredGpuCullTables_.emplace_back(gpuCullFrameNo_, gpuCullTable_);
+        }
+        gpuCullTable_ = table;
+        gpuCullTableDirty_ = false;
+    }
+
+    GpuCullFrame & StaticMeshModule::nextGpuCullFrame(const GpuCullTable & table, bool occlusion)
+    {
+        auto device = engine_->getDevice();
+
+        gpuCullFrameIx_ = (gpuCullFrameIx_ + 1) % static_cast<uint32_t>(gpuCullFrames_.size());
+        auto & frame = gpuCullFrames_[gpuCullFrameIx_];
+
+        if (!frame.params) {
+            frame.params = engine_->createStorageBuffer(sizeof(GpuCullParams));
+            frame.params->map();
+        }
+
+        if (frame.commandCapacity < table.commands.size()) {
+            auto n = table.commands.size() * 2;
+            frame.commands = engine_->createIndirectBuffer(n * sizeof(IndirectDrawCommand));
+            frame.commands->map();
+            frame.compacted = device->createBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY, n * sizeof(IndirectDrawCommand)
+            );
+            if (occlusion) {
+                frame.lateCommands = engine_->createIndirectBuffer(n * sizeof(IndirectDrawCommand));
+                frame.lateCommands->map();
+            }
+            frame.commandCapacity = static_cast<uint32_t>(n);
         }
 
-        instanceBuffers.buffers[instanceBuffers.ix]->update(
-            ids.instances.data(),
-            ids.instances.size() * sizeof(IndirectDrawInstance));
+        if (frame.headerCapacity < table.headers.size()) {
+            auto n = table.headers.size() * 2;
+            frame.counts = engine_->createIndirectBuffer(n * sizeof(uint32_t));
+            frame.counts->map();
+            frame.headerCapacity = static_cast<uint32_t>(n);
+        }
+
+        if (frame.instanceCapacity < table.instanceCount) {
+            auto n = table.instanceCount * 2;
+            frame.instances = device->createBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY, n * sizeof(IndirectDrawInstance)
+            );
+            if (occlusion) {
+                frame.lateInstances = device->createBuffer(
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    VMA_MEMORY_USAGE_GPU_ONLY, n * sizeof(IndirectDrawInstance)
+                );
+                // A count followed by the cull instance index of each reject
+                frame.lateList = engine_->createStorageBuffer((n + 1) * sizeof(uint32_t));
+                frame.lateList->map();
+            }
+            frame.instanceCapacity = static_cast<uint32_t>(n);
+        }
+
+        return frame;
+    }
+
+    void StaticMeshModule::createGpuCulledRenderCommands()
+    {
+        OPTICK_CATEGORY("Render Static GPU Culled", ::Optick::Category::Rendering)
+
+        if (!pipeline_.isAlive()) {
+            pipeline_ = world_->lookup("pipeline/staticmesh_opaque");
+        }
+        if (!cullPipeline_.isAlive()) {
+            cullPipeline_ = world_->lookup("compute/staticmesh_cull");
+        }
+        if (!compactPipeline_.isAlive()) {
+            compactPipeline_ = world_->lookup("compute/staticmesh_compact");
+        }
+        if (!lateCullPipeline_.isAlive()) {
+            lateCullPipeline_ = world_->lookup("compute/staticmesh_cull_late");
+        }
+        auto pipeline = pipeline_.get<GraphicsPipeline>();
+        auto cull_pipeline = cullPipeline_.get<ComputePipeline>();
+
+        if (!pipeline || !cull_pipeline) {
+            return;
+        }
+
+        if (textureFeedback_) {
+            gatherTextureFeedback();
+        }
+
+        const auto layout = pipeline_.getRelated<UsesLayout, PipelineLayout>();
+        const auto cull_layout = cullPipeline_.getRelated<UsesLayout, PipelineLayout>();
+
+        auto features = world_->getSingleton<RenderFeatures>();
+        auto compact_pipeline = compactPipeline_.get<ComputePipeline>();
+        const bool use_count = features && features->indirectCount() && compact_pipeline;
+
+        // Occlusion culling is on when the renderer publishes a depth pyramid
+        auto pyramid = world_->getSingleton<HiZPyramid>();
+        auto late_cull_pipeline = lateCullPipeline_.get<ComputePipeline>();
+        const bool occlusion = pyramid && late_cull_pipeline;
+
+        gpuCullFrameNo_++;
+        while (!retiredGpuCullTables_.empty() &&
+            retiredGpuCullTables_.front().first + gpuCullFrames_.size() < gpuCullFrameNo_) {
+            retiredGpuCullTables_.pop_front();
+        }
+
+        if (gpuCullTableDirty_ || !gpuCullTable_) {
+            buildGpuCullTable();
+        }
+
+        auto table = gpuCullTable_;
+        if (table->instanceCount == 0) {
+            return;
+        }
+
+        auto & frame = nextGpuCullFrame(*table, occlusion);
+
+        auto scene_camera = world_->getSingleton<SceneCamera>();
+        auto frustum = world_->get<CameraFrustum>(scene_camera->camera);
+
+        GpuCullParams params{};
+        {
+            DirectX::XMVECTOR planes[6];
+            frustum->frustum.GetPlanes(
+                &planes[0], &planes[1], &planes[2], &planes[3], &planes[4],
+                &planes[5]
+            );
+            for (uint32_t i = 0; i < 6; i++) {
+                DirectX::XMStoreFloat4(&params.planes[i], planes[i]);
+            }
+            params.cameraPosition = {
+                scene_camera->shaderData.viewPos.x, scene_camera->shaderData.viewPos.y,
+                scene_camera->shaderData.viewPos.z, 1.0f
+            };
+            params.instanceCount = table->instanceCount;
+
+            DirectX::XMStoreFloat4x4(
+                &params.viewProjection,
+                DirectX::XMMatrixMultiply(
+                    DirectX::XMLoadFloat4x4(&scene_camera->shaderData.view),
+                    DirectX::XMLoadFloat4x4(&scene_camera->shaderData.projection)
+                )
+            );
+            if (occlusion) {
+                params.occlusion = pyramid->valid ? 1 : 0;
+                params.occlusionViewProjection = pyramid->viewProjection;
+                params.lateList = frame.lateList->getDeviceAddress();
+            }
+            params.transforms = world_->getSingleton<InstanceTable>()->address;
+        }
+
+        frame.params->update(&params, sizeof(GpuCullParams));
+        frame.commands->update(
+            table->commands.data(),
+            table->commands.size() * sizeof(IndirectDrawCommand)
+        );
+
+        GpuCullPushConstants pc{
+            table->cullInstances->getDeviceAddress(),
+            frame.instances->getDeviceAddress(),
+            frame.commands->getDeviceAddress(),
+            frame.params->getDeviceAddress(),
+            occlusion ? pyramid->address : 0
+        };
+
+        GpuCompactPushConstants cpc{};
+        VkPipeline compact = VK_NULL_HANDLE;
+
+        if (use_count) {
+            std::vector<uint32_t> zero_counts(table->headers.size(), 0);
+            frame.counts->update(zero_counts.data(), zero_counts.size() * sizeof(uint32_t));
+
+            cpc = {
+                frame.commands->getDeviceAddress(),
+                frame.compacted->getDeviceAddress(),
+                frame.counts->getDeviceAddress(),
+                table->commandHeaders->getDeviceAddress(),
+                static_cast<uint32_t>(table->commands.size())
+            };
+            compact = compact_pipeline->pipeline->Handle();
+        }
+
+        world_->getStream<Render::ComputeCommand>()
+              ->add<Render::ComputeCommand>(
+                  {
+                      Render::ComputeStage::Cull,
+                      [pc, cpc, compact,
+                          cull = cull_pipeline->pipeline->Handle(),
+                          cullLayout = cull_layout->layout,
+                          count = table->instanceCount](VkCommandBuffer cb) {
+                          vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, cull);
+                          vkCmdPushConstants(
+                              cb, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                              sizeof(GpuCullPushConstants), &pc
+                          );
+                          vkCmdDispatch(cb, (count + 63) / 64, 1, 1);
+
+                          if (compact == VK_NULL_HANDLE) {
+                              return;
+                          }
+
+                          VkMemoryBarrier mb{};
+                          mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                          mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                          mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+                          vkCmdPipelineBarrier(
+                              cb,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              0, 1, &mb, 0, nullptr, 0, nullptr
+                          );
+
+                          vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, compact);
+                          vkCmdPushConstants(
+                              cb, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                              sizeof(GpuCompactPushConstants), &cpc
+                          );
+                          vkCmdDispatch(cb, (cpc.commandCount + 63) / 64, 1, 1);
+                      }
+                  }
+              );
+
+        IndirectDrawSet ids;
+        ids.headers = table->headers;
+
+        if (use_count) {
+            MeshModule::drawInstances(
+                {
+                    frame.instances->getDeviceAddress(), frame.compacted->handle(), 0,
+                    frame.counts->handle(), 0
+                },
+                world_, pipeline, layout, ids
+            );
+        } else {
+            MeshModule::drawInstances(
+                {frame.instances->getDeviceAddress(), frame.commands->handle(), 0, VK_NULL_HANDLE, 0},
+                world_, pipeline, layout, ids
+            );
+        }
+
+        if (!occlusion) {
+            return;
+        }
+
+        // Whatever the old pyramid rejected is tested again against this frame's, once the
+        // renderer has built it from what was drawn above. The survivors draw in the late pass.
+        const uint32_t zero = 0;
+        frame.lateList->update(&zero, sizeof(uint32_t));
+        frame.lateCommands->update(
+            table->commands.data(),
+            table->commands.size() * sizeof(IndirectDrawCommand)
+        );
+
+        GpuCullPushConstants late_pc{
+            table->cullInstances->getDeviceAddress(),
+            frame.lateInstances->getDeviceAddress(),
+            frame.lateCommands->getDeviceAddress(),
+            frame.params->getDeviceAddress(),
+            0
+        };
+
+        world_->getStream<Render::OcclusionComputeCommand>()
+              ->add<Render::OcclusionComputeCommand>(
+                  {
+                      [late_pc,
+                          cull = late_cull_pipeline->pipeline->Handle(),
+                          cullLayout = cull_layout->layout,
+                          count = table->instanceCount](VkCommandBuffer cb, uint64_t hiZ) {
+                          auto pc = late_pc;
+                          pc.hiZ = hiZ;
+
+                          vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, cull);
+                          vkCmdPushConstants(
+                              cb, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                              sizeof(GpuCullPushConstants), &pc
+                          );
+                          vkCmdDispatch(cb, (count + 63) / 64, 1, 1);
+                      }
+                  }
+              );
+
+        // Rejects are expected to be few, so these are drawn without compaction
+        MeshModule::drawInstances(
+            {frame.lateInstances->getDeviceAddress(), frame.lateCommands->handle(), 0, VK_NULL_HANDLE, 0},
+            world_, pipeline, layout, ids, true
+        );
     }
 }
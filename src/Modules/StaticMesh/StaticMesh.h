@@ -24,10 +24,14 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include <deque>
 #include <Modules/Mesh/Mesh.h>
 #include "Modules/Module.h"
 #include "DirectXCollision.h"
+#include "Geometry/OcclusionBuffer.h"
 #include "Modules/Renderer/Renderer.hpp"
+#include "Modules/Lighting/Lighting.h"
+#include "RenderProxies.h"
 #include "Vulkan/DescriptorSet.hpp"
 #include "Vulkan/IndexBuffer.hpp"
 
@@ -98,6 +102,17 @@ namespace RxEngine
     struct StaticMeshActiveBundle
     {
         ecs::entity_t currentBundle = 0;
+        ecs::entity_t compactBundle = 0;
+        ecs::entity_t compactShortBundle = 0;
+    };
+
+    enum class StaticMeshFormat
+    {
+        Full,
+        // Quantized vertices with 32 bit indices
+        Compact,
+        // Quantized vertices with 16 bit indices, for meshes with fewer than 65536 vertices
+        CompactShort
     };
 
 //    struct StaticMeshBundle
@@ -115,6 +130,34 @@ namespace RxEngine
         float pad3;
         float pad4;
     };
+
+    // Position as unorm16 within the mesh bounds, normal octahedral encoded as snorm16 and uv
+    // as half floats. Matches the uvec4 decoded by the staticmesh compact vertex shaders.
+    struct StaticMeshCompactVertex
+    {
+        uint16_t px;
+        uint16_t py;
+        uint16_t pz;
+        uint16_t pad;
+        int16_t nx;
+        int16_t ny;
+        uint16_t uvx;
+        uint16_t uvy;
+    };
+
+    static_assert(sizeof(StaticMeshCompactVertex) == 16);
+
+    struct StaticMeshLoadOptions
+    {
+        // Default format from [render] compactMeshes (off), mesh data can override it with compact
+        bool compact;
+        // Full format bundles carry a position stream for the shadow passes
+        bool positionStream;
+    };
+
+    // Each compact mesh starts with the minimum and extent of its bounds as two vec4s, read
+    // by the shader from just before gl_BaseVertex
+    constexpr uint32_t compact_mesh_header_vertices = 2;
 #if 0
     struct RenderDetailCache {
         ecs::entity_t bundle;
@@ -141,6 +184,112 @@ namespace RxEngine
         //DirectX::XMFLOAT4X4 mat;
     };
 
+    // One draw range of one placed object going into the cull table, a whole submesh or one
+    // of its clusters. The sphere and cone are in mesh space, the cull shader moves them with
+    // the object's transform from the instance table.
+    struct GpuCullEntry
+    {
+        ecs::entity_t pipeline;
+        ecs::entity_t bundle;
+        uint32_t vertexOffset;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        uint32_t materialId;
+        uint32_t transformSlot;
+        DirectX::XMFLOAT4 sphere;
+        DirectX::XMFLOAT4 cone;
+    };
+
+    struct GpuCullInstance
+    {
+        DirectX::XMFLOAT4 sphere;
+        uint32_t commandIndex;
+        uint32_t materialId;
+        uint32_t transformSlot;
+        uint32_t pad0;
+        // Normal cone axis and the sine of its half angle, 1 when it can't be back face culled
+        DirectX::XMFLOAT4 cone;
+    };
+
+    struct GpuCullParams
+    {
+        DirectX::XMFLOAT4 planes[6];
+        DirectX::XMFLOAT4 cameraPosition;
+        uint32_t instanceCount;
+        // Test against the depth pyramid, which was drawn with occlusionViewProjection
+        uint32_t occlusion;
+        uint32_t pad0;
+        uint32_t pad1;
+        DirectX::XMFLOAT4X4 viewProjection;
+        DirectX::XMFLOAT4X4 occlusionViewProjection;
+        uint64_t lateList;
+        // The instance table, read for the transform of each cull instance
+        uint64_t transforms;
+    };
+
+    struct GpuCullPushConstants
+    {
+        uint64_t cullInstances;
+        uint64_t instances;
+        uint64_t commands;
+        uint64_t params;
+        uint64_t hiZ;
+    };
+
+    struct GpuCompactPushConstants
+    {
+        uint64_t commands;
+        uint64_t compacted;
+        uint64_t counts;
+        uint64_t commandHeaders;
+        uint32_t commandCount;
+    };
+
+    // Persistent input to the compute culling pass. Only rebuilt when placed objects change,
+    // the command templates are copied into each frame's indirect buffer with zero instances
+    // and the shader fills them in.
+    struct GpuCullTable
+    {
+        std::shared_ptr<RxCore::Buffer> cullInstances;
+        std::shared_ptr<RxCore::Buffer> commandHeaders;
+        std::vector<IndirectDrawCommand> commands;
+        std::vector<IndirectDrawCommandHeader> headers;
+        uint32_t instanceCount;
+    };
+
+    struct GpuCullFrame
+    {
+        std::shared_ptr<RxCore::Buffer> params;
+        std::shared_ptr<RxCore::Buffer> commands;
+        std::shared_ptr<RxCore::Buffer> instances;
+        std::shared_ptr<RxCore::Buffer> compacted;
+        std::shared_ptr<RxCore::Buffer> counts;
+        // Commands, instances and the list of pyramid rejects for the late occlusion pass
+        std::shared_ptr<RxCore::Buffer> lateCommands;
+        std::shared_ptr<RxCore::Buffer> lateInstances;
+        std::shared_ptr<RxCore::Buffer> lateList;
+        uint32_t commandCapacity;
+        uint32_t instanceCapacity;
+        uint32_t headerCapacity;
+    };
+
+    struct ShadowCasterSubMesh
+    {
+        const RenderDetailCache * rdc;
+        uint32_t materialId;
+        uint64_t sortKey;
+    };
+
+    // Gathered once per frame and shared read only by the per cascade jobs. subMeshRanges holds
+    // the (start, count) into subMeshes for each entry in entities.
+    struct ShadowCasterSet
+    {
+        CullSpheres spheres;
+        std::vector<std::pair<uint32_t, uint32_t>> subMeshRanges;
+        std::vector<ShadowCasterSubMesh> subMeshes;
+        std::vector<uint32_t> slots;
+    };
+
 #if 0
     struct LodEntry
     {
@@ -170,14 +319,54 @@ namespace RxEngine
         //void processStartupData(sol::state * lua, RxCore::Device * device) override;
 
     protected:
+        void rebuildRenderProxies();
         void createOpaqueRenderCommands();
-        void createInstanceBuffer(IndirectDrawSet & ids);
+        bool drawOccluders(const DirectX::BoundingFrustum & frustum, const DirectX::XMMATRIX & viewProjection);
+        void publishTextureFeedback(const std::vector<TextureFeedback> & chunkFeedback);
+        void gatherTextureFeedback();
+
+        void createShadowRenderCommands();
+        Render::ShadowRenderCommand createShadowCascadeCommand(
+            uint32_t cascadeIndex,
+            const ShadowCascade & cascade,
+            const ShadowCasterSet & casters,
+            const GraphicsPipeline * pipeline,
+            const PipelineLayout * layout);
+
+        void createGpuCulledRenderCommands();
+        void buildGpuCullTable();
+        GpuCullFrame & nextGpuCullFrame(const GpuCullTable & table, bool occlusion);
 
     private:
         ecs::EntityHandle pipeline_{};
+        ecs::EntityHandle cullPipeline_{};
+        ecs::EntityHandle compactPipeline_{};
+        ecs::EntityHandle lateCullPipeline_{};
+        ecs::EntityHandle shadowPipeline_{};
         ecs::queryid_t worldObjects_{};
 
-        std::vector<DirectX::XMFLOAT4X4> mats{};
+        RenderProxyTable renderProxies_{};
+        std::vector<DrawSortItem> sortScratch_{};
+        DrawSortKeys shadowSortKeys_{};
+        bool renderProxiesDirty_{true};
         InstanceBuffers instanceBuffers{};
+        std::vector<InstanceBuffers> shadowInstanceBuffers_{};
+        uint32_t minShadowCasterTexels_{};
+        bool shadowCastersChanged_{true};
+
+        bool gpuCulling_{};
+        bool clusterCulling_{};
+        float lodHysteresis_{};
+        bool softwareOcclusion_{};
+        // Coverage per material is published for texture streaming
+        bool textureFeedback_{};
+        OcclusionBuffer occlusionBuffer_{};
+        StaticMeshLoadOptions loadOptions_{};
+        bool gpuCullTableDirty_{true};
+        std::shared_ptr<GpuCullTable> gpuCullTable_{};
+        std::vector<GpuCullFrame> gpuCullFrames_{};
+        uint32_t gpuCullFrameIx_{};
+        uint64_t gpuCullFrameNo_{};
+        std::deque<std::pair<uint64_t, std::shared_ptr<GpuCullTable>>> retiredGpuCullTables_{};
     };
 }
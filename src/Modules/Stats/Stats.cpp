@@ -4,6 +4,7 @@
 #include "imgui.h"
 #include "EngineMain.hpp"
 #include "Modules/ImGui/ImGuiRender.hpp"
+#include "Modules/Renderer/Renderer.hpp"
 
 namespace RxEngine
 {
@@ -40,10 +41,19 @@ namespace RxEngine
         }
         ImVec2 window_pos = ImVec2(io.DisplaySize.x - 2, 2 * DISTANCE);
 
+        auto fs = world_->getSingleton<FrameStats>();
+        const FrameStatDetail * frame = fs ? &fs->frames[fs->index] : nullptr;
+
         fpsHistory_.push_back(delta_ * 1000.f);
         while (fpsHistory_.size() > 250) {
             fpsHistory_.pop_front();
         }
+        if (frame) {
+            gpuHistory_.push_back(frame->gpuTime);
+            while (gpuHistory_.size() > 250) {
+                gpuHistory_.pop_front();
+            }
+        }
 
         std::vector<float> fpss;
         std::vector<float> gpus;
@@ -89,8 +99,22 @@ namespace RxEngine
                 16.f,
                 ImVec2(0, 50));
             ImGui::Text("Frame Time %6.2f ms", delta_ * 1000.f);
-            ImGui::Text("Render CPU Time: %5.2f ms", 0.f);
-            ImGui::Text("Render GPU Time: %5.2f ms", 0.f);
+            ImGui::Text("Render CPU Time: %5.2f ms", frame ? frame->cpuTime : 0.f);
+            ImGui::Text("Render GPU Time: %5.2f ms", frame ? frame->gpuTime : 0.f);
+            if (frame) {
+                for (uint32_t p = 0; p < GpuPassCount; p++) {
+                    ImGui::Text("  %-14s %5.2f ms", gpu_pass_names[p], frame->gpuPassTimes[p]);
+                }
+                for (uint32_t c = 0; c < NUM_CASCADES; c++) {
+                    ImGui::Text("    Cascade %u     %5.2f ms", c, frame->gpuCascadeTimes[c]);
+                }
+                if (frame->pipelineStatistics) {
+                    ImGui::Text("VS Invocations: %llu", frame->vertexInvocations);
+                    ImGui::Text("Clipped Primitives: %llu", frame->clippingPrimitives);
+                    ImGui::Text("FS Invocations: %llu", frame->fragmentInvocations);
+                    ImGui::Text("CS Invocations: %llu", frame->computeInvocations);
+                }
+            }
             for (const auto & heap: heaps_) {
                 std::ostringstream stringStream;
                 stringStream << (heap.usage / 1024 / 1024) << "MB/" << (heap.budget / 1204 / 1204)
@@ -52,7 +52,8 @@ namespace RxEngine
                       w->getStream<MainRenderImageInput>()->add<MainRenderImageInput>(
                           {
                               next_swap_image_view, next_image_available, next_image_index,
-                              current_extent, submitCompleteSemaphores_[next_image_index]
+                              current_extent, submitCompleteSemaphores_[next_image_index],
+                              swapChainGeneration_
                           }
                       );
                   }
@@ -88,6 +89,7 @@ namespace RxEngine
     {
         auto device = engine_->getDevice();
         device->WaitIdle();
+        swapChainGeneration_++;
 
         if (device->getSwapChainImageCount() != submitCompleteSemaphores_.size()) {
             destroySemaphores();
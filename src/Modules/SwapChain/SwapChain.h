@@ -24,6 +24,8 @@ namespace RxEngine
         uint32_t imageIndex;
         VkExtent2D extent;
         VkSemaphore finishRenderSemaphore;
+        // Changes whenever the swap chain is replaced, the image views of earlier ones are gone
+        uint32_t swapChainGeneration;
     };
 
     struct MainRenderImageOutput
@@ -48,6 +50,7 @@ namespace RxEngine
     private:
         //std::unique_ptr<RxCore::SwapChain> swapChain_;
         std::vector<VkSemaphore> submitCompleteSemaphores_;
+        uint32_t swapChainGeneration_{};
     };
 }
 
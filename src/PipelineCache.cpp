@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "PipelineCache.h"
+#include "Log.h"
+#include "optick/optick.h"
+
+namespace RxEngine
+{
+    namespace
+    {
+        // The part of a cache's header that says what wrote it, VkPipelineCacheHeaderVersionOne
+        struct CacheHeader
+        {
+            uint32_t headerSize;
+            uint32_t headerVersion;
+            uint32_t vendorID;
+            uint32_t deviceID;
+            uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        };
+
+        std::vector<char> getCacheData(VkDevice device, VkPipelineCache cache)
+        {
+            size_t size = 0;
+            vkGetPipelineCacheData(device, cache, &size, nullptr);
+
+            std::vector<char> data(size);
+            if (size > 0 && vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+                data.clear();
+            }
+            data.resize(size);
+
+            return data;
+        }
+    }
+
+    PipelineCache::PipelineCache(RxCore::Device * device, std::filesystem::path path)
+        : device_(device)
+        , path_(std::move(path))
+    {
+        load();
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        if (cache_ != VK_NULL_HANDLE) {
+            vkDestroyPipelineCache(device_->getDevice(), cache_, nullptr);
+        }
+    }
+
+    void PipelineCache::load()
+    {
+        OPTICK_EVENT()
+
+        VkPipelineCacheCreateInfo pcci{};
+        pcci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+        // An empty cache's data is just the header for this driver and device. Without one there
+        // is nothing to check a saved cache against, so it is not used.
+        std::vector<char> expected;
+        VkPipelineCache empty{VK_NULL_HANDLE};
+        if (vkCreatePipelineCache(device_->getDevice(), &pcci, nullptr, &empty) == VK_SUCCESS) {
+            expected = getCacheData(device_->getDevice(), empty);
+            vkDestroyPipelineCache(device_->getDevice(), empty, nullptr);
+        }
+
+        std::vector<char> saved;
+        if (!path_.empty()) {
+            std::ifstream fs(path_, std::ios::binary | std::ios::ate);
+            if (fs) {
+                saved.resize(static_cast<size_t>(fs.tellg()));
+                fs.seekg(0);
+                fs.read(saved.data(), static_cast<std::streamsize>(saved.size()));
+                if (!fs) {
+                    saved.clear();
+                }
+            }
+        }
+
+        if (saved.empty()) {
+            if (!path_.empty()) {
+                spdlog::info("No pipeline cache at {}, starting cold", path_.string());
+            }
+        } else if (expected.size() < sizeof(CacheHeader)) {
+            spdlog::warn("Unable to check the pipeline cache at {}, starting cold", path_.string());
+            saved.clear();
+        } else if (saved.size() < sizeof(CacheHeader) ||
+            std::memcmp(saved.data(), expected.data(), sizeof(CacheHeader)) != 0) {
+            spdlog::info("Pipeline cache at {} is from another device or driver, starting cold", path_.string());
+            saved.clear();
+        } else {
+            pcci.initialDataSize = saved.size();
+            pcci.pInitialData = saved.data();
+            warm_ = true;
+        }
+
+        if (vkCreatePipelineCache(device_->getDevice(), &pcci, nullptr, &cache_) != VK_SUCCESS && warm_) {
+            spdlog::warn("Pipeline cache at {} was rejected, starting cold", path_.string());
+            pcci.initialDataSize = 0;
+            pcci.pInitialData = nullptr;
+            warm_ = false;
+            if (vkCreatePipelineCache(device_->getDevice(), &pcci, nullptr, &cache_) != VK_SUCCESS) {
+                cache_ = VK_NULL_HANDLE;
+            }
+        }
+        // Pipelines are then created without a cache, which Vulkan allows
+        if (cache_ == VK_NULL_HANDLE) {
+            spdlog::warn("Unable to create a pipeline cache, pipelines are created uncached");
+        }
+
+        if (warm_) {
+            spdlog::info("Loaded {} byte pipeline cache from {}", saved.size(), path_.string());
+        }
+    }
+
+    VkResult PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo & createInfo,
+                                                   VkPipeline & pipeline)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto rv = vkCreateGraphicsPipelines(device_->getDevice(), cache_, 1, &createInfo, nullptr, &pipeline);
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        std::lock_guard lock(mutex_);
+        pipelinesCreated_++;
+        creationTime_ += std::chrono::duration<double, std::milli>(end - start).count();
+
+        return rv;
+    }
+
+    VkResult PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo & createInfo,
+                                                  VkPipeline & pipeline)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto rv = vkCreateComputePipelines(device_->getDevice(), cache_, 1, &createInfo, nullptr, &pipeline);
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        std::lock_guard lock(mutex_);
+        pipelinesCreated_++;
+        creationTime_ += std::chrono::duration<double, std::milli>(end - start).count();
+
+        return rv;
+    }
+
+    void PipelineCache::save()
+    {
+        OPTICK_EVENT()
+        std::lock_guard lock(mutex_);
+
+        if (pipelinesCreated_ == 0) {
+            return;
+        }
+
+        // The first time this covers every pipeline made at startup, which is what the cache
+        // is there to speed up
+        spdlog::info(
+            "Created {} pipelines in {:.1f} ms, pipeline cache started {}",
+            pipelinesCreated_, creationTime_, warm_ ? "warm" : "cold"
+        );
+        pipelinesCreated_ = 0;
+        creationTime_ = 0.0;
+
+        if (path_.empty() || cache_ == VK_NULL_HANDLE) {
+            return;
+        }
+
+        const auto data = getCacheData(device_->getDevice(), cache_);
+        if (data.empty()) {
+            return;
+        }
+
+        auto temp_path = path_;
+        temp_path += ".tmp";
+        {
+            std::ofstream fs(temp_path, std::ios::binary | std::ios::trunc);
+            fs.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!fs) {
+                spdlog::warn("Unable to write pipeline cache to {}", temp_path.string());
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temp_path, path_, ec);
+        if (ec) {
+            spdlog::warn("Unable to replace pipeline cache {}: {}", path_.string(), ec.message());
+        }
+    }
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <filesystem>
+#include <mutex>
+#include "Vulkan/Device.h"
+
+namespace RxEngine
+{
+    // The one VkPipelineCache every pipeline is created through, kept in the user data
+    // directory between runs. A saved cache is only used when the header the driver writes,
+    // vendor, device and pipelineCacheUUID, matches the header of an empty cache it hands out
+    // now, so a driver update or another GPU starts cold instead of feeding it stale data.
+    //
+    // Vulkan synchronizes access to a cache itself, pipelines can be created from any thread.
+    // With an empty path the cache only lasts as long as the process.
+    class PipelineCache
+    {
+    public:
+        PipelineCache(RxCore::Device * device, std::filesystem::path path);
+        ~PipelineCache();
+
+        VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo & createInfo, VkPipeline & pipeline);
+        VkResult createComputePipeline(const VkComputePipelineCreateInfo & createInfo, VkPipeline & pipeline);
+
+        // Writes the cache back when pipelines were created since it was last written. The file
+        // is replaced whole, a crash part way through leaves the previous one.
+        void save();
+
+        [[nodiscard]] VkPipelineCache handle() const
+        {
+            return cache_;
+        }
+
+    private:
+        void load();
+
+        RxCore::Device * device_;
+        std::filesystem::path path_;
+        VkPipelineCache cache_{VK_NULL_HANDLE};
+        // Started from a matching saved cache
+        bool warm_{};
+
+        // Since the cache was last written, logged each time it is
+        uint32_t pipelinesCreated_{};
+        double creationTime_{};
+
+        std::mutex mutex_;
+    };
+}
@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "UploadRing.h"
+#include <algorithm>
+#include <cassert>
+#include "Log.h"
+
+namespace RxEngine
+{
+    constexpr uint64_t upload_ring_frames = 5;
+
+    UploadRing::UploadRing(RxCore::Device * device, VkDeviceSize capacity)
+        : capacity_(capacity)
+    {
+        buffer_ = device->createBuffer(
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU, capacity
+        );
+        buffer_->map();
+        handle_ = buffer_->handle();
+        address_ = buffer_->getDeviceAddress();
+    }
+
+    void UploadRing::beginFrame()
+    {
+        std::lock_guard lock(mutex_);
+
+        frameEnds_.emplace_back(frameNo_, head_);
+        frameNo_++;
+
+        while (!frameEnds_.empty() && frameEnds_.front().first + upload_ring_frames <= frameNo_) {
+            tail_ = frameEnds_.front().second;
+            frameEnds_.pop_front();
+        }
+        frameStart_ = head_;
+    }
+
+    UploadAllocation UploadRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        if (size == 0 || size > capacity_) {
+            return {};
+        }
+        std::lock_guard lock(mutex_);
+
+        VkDeviceSize pos = (head_ + alignment - 1) / alignment * alignment;
+
+        // Allocations never straddle the end of the buffer
+        if (pos / capacity_ != (pos + size - 1) / capacity_) {
+            pos = (pos / capacity_ + 1) * capacity_;
+        }
+        if (pos + size - tail_ > capacity_) {
+            if (failedAllocations_++ == 0) {
+                spdlog::warn("Upload ring of {} bytes is full", capacity_);
+            }
+            return {};
+        }
+        head_ = pos + size;
+        peakInFlight_ = std::max(peakInFlight_, head_ - tail_);
+
+        const VkDeviceSize offset = pos % capacity_;
+        return {handle_, offset, size, address_ + offset};
+    }
+
+    UploadAllocation UploadRing::upload(const void * data, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        auto allocation = allocate(size, alignment);
+        if (allocation) {
+            buffer_->update(data, allocation.offset, size);
+        }
+        return allocation;
+    }
+
+    void UploadRing::write(const UploadAllocation & allocation,
+                           VkDeviceSize offset,
+                           const void * data,
+                           VkDeviceSize size) const
+    {
+        assert(offset + size <= allocation.size);
+        buffer_->update(data, allocation.offset + offset, size);
+    }
+
+    UploadRingStats UploadRing::getStats() const
+    {
+        std::lock_guard lock(mutex_);
+
+        return {
+            capacity_,
+            head_ - frameStart_,
+            head_ - tail_,
+            peakInFlight_,
+            failedAllocations_
+        };
+    }
+}
@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "Vulkan/Device.h"
+#include "Vulkan/Buffer.hpp"
+
+namespace RxEngine
+{
+    struct UploadAllocation
+    {
+        VkBuffer buffer{VK_NULL_HANDLE};
+        VkDeviceSize offset{};
+        VkDeviceSize size{};
+        uint64_t address{};
+
+        explicit operator bool() const
+        {
+            return buffer != VK_NULL_HANDLE;
+        }
+    };
+
+    struct UploadRingStats
+    {
+        VkDeviceSize capacity;
+        VkDeviceSize frameBytes;
+        VkDeviceSize inFlightBytes;
+        VkDeviceSize peakInFlightBytes;
+        uint32_t failedAllocations;
+    };
+
+    // One persistently mapped CPU to GPU buffer that vertex, index, storage and indirect data
+    // written fresh each frame is sub-allocated from. Space handed out in a frame is only reused
+    // once upload_ring_frames frames have started since, the same depth the per-module buffer
+    // rotations relied on. Allocation fails rather than overwriting anything still in flight.
+    class UploadRing
+    {
+    public:
+        UploadRing(RxCore::Device * device, VkDeviceSize capacity);
+
+        void beginFrame();
+
+        UploadAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+        UploadAllocation upload(const void * data, VkDeviceSize size, VkDeviceSize alignment);
+        void write(const UploadAllocation & allocation,
+                   VkDeviceSize offset,
+                   const void * data,
+                   VkDeviceSize size) const;
+
+        [[nodiscard]] UploadRingStats getStats() const;
+
+    private:
+        std::shared_ptr<RxCore::Buffer> buffer_;
+        VkBuffer handle_;
+        uint64_t address_;
+        VkDeviceSize capacity_;
+
+        // Both only ever increase, the position in the buffer is modulo capacity
+        VkDeviceSize head_{};
+        VkDeviceSize tail_{};
+        VkDeviceSize frameStart_{};
+
+        uint64_t frameNo_{};
+        std::deque<std::pair<uint64_t, VkDeviceSize>> frameEnds_{};
+
+        VkDeviceSize peakInFlight_{};
+        uint32_t failedAllocations_{};
+
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "UploadService.h"
+#include "optick/optick.h"
+
+namespace RxEngine
+{
+    constexpr uint64_t staging_page_frames = 5;
+    constexpr size_t max_free_staging_pages = 4;
+
+    UploadService::UploadService(RxCore::Device * device, VkDeviceSize pageSize)
+        : device_(device)
+        , pageSize_(pageSize)
+    {}
+
+    UploadService::StagingPage & UploadService::stagingPageFor(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        for (auto & page: activePages_) {
+            const VkDeviceSize offset = (page.used + alignment - 1) & ~(alignment - 1);
+            if (offset + size <= page.size) {
+                page.used = offset;
+                return page;
+            }
+        }
+
+        if (size <= pageSize_ && !freePages_.empty()) {
+            activePages_.push_back(freePages_.back());
+            freePages_.pop_back();
+        } else {
+            const VkDeviceSize page_size = std::max(size, pageSize_);
+            auto buffer = device_->createBuffer(
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, page_size
+            );
+            buffer->map();
+            activePages_.push_back({buffer, page_size, 0});
+        }
+        activePages_.back().used = 0;
+
+        return activePages_.back();
+    }
+
+    uint64_t UploadService::uploadBuffer(VkBuffer destination,
+                                         VkDeviceSize destinationOffset,
+                                         const void * data,
+                                         VkDeviceSize size)
+    {
+        std::lock_guard lock(mutex_);
+
+        if (size == 0) {
+            return completedTicket_;
+        }
+
+        // Copies into index and vertex buffers want 4 byte aligned sources
+        auto & page = stagingPageFor(size, 4);
+        page.buffer->update(data, page.used, size);
+
+        pending_.push_back({page.buffer->handle(), destination, {page.used, destinationOffset, size}});
+        page.used += size;
+        pendingBytes_ += size;
+
+        return nextTicket_++;
+    }
+
+    uint64_t UploadService::uploadImage(const std::shared_ptr<RxCore::Image> & image,
+                                        uint32_t mipLevel,
+                                        VkExtent3D extent,
+                                        const void * data,
+                                        VkDeviceSize size)
+    {
+        std::lock_guard lock(mutex_);
+
+        if (size == 0) {
+            return completedTicket_;
+        }
+
+        // Block compressed sources have to start on a whole block
+        auto & page = stagingPageFor(size, 16);
+        page.buffer->update(data, page.used, size);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = page.used;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 0, 1};
+        region.imageExtent = extent;
+
+        imageCopies_.push_back({page.buffer->handle(), image->handle_, region});
+        images_.push_back(image);
+        page.used += size;
+        pendingBytes_ += size;
+
+        return nextTicket_++;
+    }
+
+    void UploadService::copyBuffer(const std::shared_ptr<RxCore::Buffer> & source,
+                                   const std::shared_ptr<RxCore::Buffer> & destination,
+                                   std::vector<VkBufferCopy> regions)
+    {
+        std::lock_guard lock(mutex_);
+
+        if (!regions.empty()) {
+            moves_.push_back({source, destination, std::move(regions)});
+        }
+    }
+
+    std::function<void(VkCommandBuffer)> UploadService::flush()
+    {
+        OPTICK_EVENT()
+        std::lock_guard lock(mutex_);
+
+        flushNo_++;
+        while (!retired_.empty() && retired_.front().flushNo + staging_page_frames <= flushNo_) {
+            for (auto & page: retired_.front().pages) {
+                if (page.size == pageSize_ && freePages_.size() < max_free_staging_pages) {
+                    freePages_.push_back(page);
+                }
+            }
+            retired_.pop_front();
+        }
+
+        if (pending_.empty() && moves_.empty() && imageCopies_.empty()) {
+            return {};
+        }
+
+        // One vkCmdCopyBuffer per source and destination pair, adjacent regions merged
+        std::ranges::sort(
+            pending_, [](const PendingCopy & a, const PendingCopy & b) {
+                if (a.source != b.source) {
+                    return a.source < b.source;
+                }
+                if (a.destination != b.destination) {
+                    return a.destination < b.destination;
+                }
+                return a.region.dstOffset < b.region.dstOffset;
+            }
+        );
+
+        std::vector<std::tuple<VkBuffer, VkBuffer, std::vector<VkBufferCopy>>> batches;
+        for (auto & copy: pending_) {
+            if (batches.empty() ||
+                std::get<0>(batches.back()) != copy.source ||
+                std::get<1>(batches.back()) != copy.destination) {
+                batches.emplace_back(copy.source, copy.destination, std::vector<VkBufferCopy>{});
+            }
+            auto & regions = std::get<2>(batches.back());
+            if (!regions.empty() &&
+                regions.back().srcOffset + regions.back().size == copy.region.srcOffset &&
+                regions.back().dstOffset + regions.back().size == copy.region.dstOffset) {
+                regions.back().size += copy.region.size;
+            } else {
+                regions.push_back(copy.region);
+            }
+        }
+
+        std::vector<std::tuple<VkBuffer, VkBuffer, std::vector<VkBufferCopy>>> moves;
+        RetiredFlush retired{flushNo_, std::move(activePages_), {}, std::move(images_)};
+        for (auto & move: moves_) {
+            moves.emplace_back(move.source->handle(), move.destination->handle(), std::move(move.regions));
+            retired.buffers.push_back(std::move(move.source));
+            retired.buffers.push_back(std::move(move.destination));
+        }
+
+        // Each mip goes from undefined to transfer destination and on to shader read around its
+        // copy, the layouts of other mips of the image are left alone
+        std::vector<VkImageMemoryBarrier> to_transfer;
+        std::vector<VkImageMemoryBarrier> to_shader;
+        std::vector<std::tuple<VkBuffer, VkImage, VkBufferImageCopy>> image_copies;
+        for (auto & copy: imageCopies_) {
+            VkImageMemoryBarrier imb{};
+            imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imb.image = copy.destination;
+            imb.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, copy.region.imageSubresource.mipLevel, 1, 0, 1};
+
+            imb.srcAccessMask = 0;
+            imb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            imb.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imb.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            to_transfer.push_back(imb);
+
+            imb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            imb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            imb.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            imb.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            to_shader.push_back(imb);
+
+            image_copies.emplace_back(copy.source, copy.destination, copy.region);
+        }
+
+        pending_.clear();
+        moves_.clear();
+        imageCopies_.clear();
+        pendingBytes_ = 0;
+        retired_.push_back(std::move(retired));
+        activePages_.clear();
+        completedTicket_ = nextTicket_ - 1;
+
+        return [batches = std::move(batches),
+                moves = std::move(moves),
+                image_copies = std::move(image_copies),
+                to_transfer = std::move(to_transfer),
+                to_shader = std::move(to_shader)](VkCommandBuffer cb) {
+            if (!image_copies.empty()) {
+                vkCmdPipelineBarrier(
+                    cb,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    0, 0, nullptr, 0, nullptr,
+                    static_cast<uint32_t>(to_transfer.size()), to_transfer.data()
+                );
+                for (auto & [source, destination, region]: image_copies) {
+                    vkCmdCopyBufferToImage(
+                        cb, source, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region
+                    );
+                }
+                vkCmdPipelineBarrier(
+                    cb,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    0, 0, nullptr, 0, nullptr,
+                    static_cast<uint32_t>(to_shader.size()), to_shader.data()
+                );
+            }
+
+            for (auto & [source, destination, regions]: batches) {
+                vkCmdCopyBuffer(
+                    cb, source, destination, static_cast<uint32_t>(regions.size()), regions.data()
+                );
+            }
+
+            // Moves run in the order they were queued, each one reading what the uploads and
+            // earlier moves wrote
+            for (auto & [source, destination, regions]: moves) {
+                VkMemoryBarrier tb{};
+                tb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                tb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                tb.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+                vkCmdPipelineBarrier(
+                    cb,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    0, 1, &tb, 0, nullptr, 0, nullptr
+                );
+                vkCmdCopyBuffer(
+                    cb, source, destination, static_cast<uint32_t>(regions.size()), regions.data()
+                );
+            }
+
+            VkMemoryBarrier mb{};
+            mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            mb.dstAccessMask = VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(
+                cb,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 1, &mb, 0, nullptr, 0, nullptr
+            );
+        };
+    }
+
+    bool UploadService::isComplete(uint64_t ticket) const
+    {
+        std::lock_guard lock(mutex_);
+        return ticket <= completedTicket_;
+    }
+
+    uint64_t UploadService::getPendingBytes() const
+    {
+        std::lock_guard lock(mutex_);
+        return pendingBytes_;
+    }
+}
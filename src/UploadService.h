@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Vulkan/Device.h"
+#include "Vulkan/Buffer.hpp"
+#include "Vulkan/Image.hpp"
+
+namespace RxEngine
+{
+    // Collects buffer uploads from anywhere in the engine into large staging pages and copies
+    // them all in one batch at the start of the next frame, instead of a staging buffer and a
+    // blocking transfer submit per upload. Each upload returns a ticket that completes once its
+    // copy has been recorded, after which the destination is safe to draw from. Image mips can
+    // be uploaded the same way.
+    class UploadService
+    {
+    public:
+        UploadService(RxCore::Device * device, VkDeviceSize pageSize);
+
+        uint64_t uploadBuffer(VkBuffer destination,
+                              VkDeviceSize destinationOffset,
+                              const void * data,
+                              VkDeviceSize size);
+
+        // Fills one mip level of a 2D colour image whose contents are undefined, leaving it in
+        // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL for the fragment shader. The image is kept
+        // alive until the copy can no longer be in flight
+        uint64_t uploadImage(const std::shared_ptr<RxCore::Image> & image,
+                             uint32_t mipLevel,
+                             VkExtent3D extent,
+                             const void * data,
+                             VkDeviceSize size);
+
+        // Device side copy, recorded after the uploads of the same flush so it sees them, with
+        // both buffers kept alive until it can no longer be in flight
+        void copyBuffer(const std::shared_ptr<RxCore::Buffer> & source,
+                        const std::shared_ptr<RxCore::Buffer> & destination,
+                        std::vector<VkBufferCopy> regions);
+
+        // Hands back the recording of every pending copy, then completes their tickets
+        std::function<void(VkCommandBuffer)> flush();
+
+        [[nodiscard]] bool isComplete(uint64_t ticket) const;
+
+        [[nodiscard]] uint64_t getPendingBytes() const;
+
+    private:
+        struct StagingPage
+        {
+            std::shared_ptr<RxCore::Buffer> buffer;
+            VkDeviceSize size;
+            VkDeviceSize used;
+        };
+
+        struct PendingCopy
+        {
+            VkBuffer source;
+            VkBuffer destination;
+            VkBufferCopy region;
+        };
+
+        struct PendingImageCopy
+        {
+            VkBuffer source;
+            VkImage destination;
+            VkBufferImageCopy region;
+        };
+
+        struct PendingMove
+        {
+            std::shared_ptr<RxCore::Buffer> source;
+            std::shared_ptr<RxCore::Buffer> destination;
+            std::vector<VkBufferCopy> regions;
+        };
+
+        struct RetiredFlush
+        {
+            uint64_t flushNo;
+            std::vector<StagingPage> pages;
+            std::vector<std::shared_ptr<RxCore::Buffer>> buffers;
+            std::vector<std::shared_ptr<RxCore::Image>> images;
+        };
+
+        StagingPage & stagingPageFor(VkDeviceSize size, VkDeviceSize alignment);
+
+        RxCore::Device * device_;
+        VkDeviceSize pageSize_;
+
+        std::vector<StagingPage> activePages_{};
+        std::deque<RetiredFlush> retired_{};
+        std::vector<StagingPage> freePages_{};
+        std::vector<PendingCopy> pending_{};
+        std::vector<PendingMove> moves_{};
+        std::vector<PendingImageCopy> imageCopies_{};
+        std::vector<std::shared_ptr<RxCore::Image>> images_{};
+        VkDeviceSize pendingBytes_{};
+
+        uint64_t nextTicket_{1};
+        uint64_t completedTicket_{};
+        uint64_t flushNo_{};
+
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Times each sphere culling kernel over the same spheres and checks they all return the same
+// visible list. Takes an optional sphere count, odd by default so the scalar tail is run too.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "Geometry/Culling.h"
+
+using namespace RxEngine;
+
+namespace
+{
+    const char * isaName(CullIsa isa)
+    {
+        switch (isa) {
+            case CullIsa::AVX2:
+                return "AVX2";
+            case CullIsa::SSE:
+                return "SSE";
+            default:
+                return "Scalar";
+        }
+    }
+
+    // Spheres per nanosecond of the fastest of several runs
+    double timeKernel(
+        const CullSpheres & spheres,
+        const CullPlanes & planes,
+        CullIsa isa,
+        std::vector<uint32_t> & visible)
+    {
+        double best = 1e30;
+        for (uint32_t run = 0; run < 10; run++) {
+            visible.clear();
+            const auto start = std::chrono::steady_clock::now();
+            cullSpheres(spheres, planes, 0, spheres.size(), visible, isa);
+            const auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+        }
+        return spheres.size() / best;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    const uint32_t count = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10))
+                                    : (1u << 20) + 5;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> xy(-500.f, 500.f);
+    std::uniform_real_distribution<float> depth(-100.f, 600.f);
+    std::uniform_real_distribution<float> radius(0.5f, 5.f);
+
+    CullSpheres spheres;
+    spheres.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        spheres.x[i] = xy(rng);
+        spheres.y[i] = xy(rng);
+        spheres.z[i] = depth(rng);
+        spheres.radius[i] = radius(rng);
+    }
+
+    // A 90 degree frustum looking down +z, planes facing out
+    const float s = std::sqrt(0.5f);
+    const CullPlanes planes{
+        {
+            {s, 0.f, -s, 0.f},
+            {-s, 0.f, -s, 0.f},
+            {0.f, s, -s, 0.f},
+            {0.f, -s, -s, 0.f},
+            {0.f, 0.f, -1.f, 0.1f},
+            {0.f, 0.f, 1.f, -500.f}
+        },
+        6
+    };
+
+    std::vector<CullIsa> kernels{CullIsa::Scalar, CullIsa::SSE};
+    if (cullIsa() == CullIsa::AVX2) {
+        kernels.push_back(CullIsa::AVX2);
+    } else {
+        std::printf("AVX2 is not supported, skipping it\n");
+    }
+
+    std::vector<uint32_t> reference;
+    std::vector<uint32_t> visible;
+    reference.reserve(count);
+    visible.reserve(count);
+
+    int result = EXIT_SUCCESS;
+    for (auto isa: kernels) {
+        const double rate = timeKernel(spheres, planes, isa, visible);
+        std::printf(
+            "%-6s %8zu of %u visible, %.3f spheres/ns\n", isaName(isa), visible.size(), count, rate
+        );
+
+        if (isa == CullIsa::Scalar) {
+            reference = visible;
+        } else if (visible != reference) {
+            std::printf("%s visible list differs from the scalar kernel\n", isaName(isa));
+            result = EXIT_FAILURE;
+        }
+    }
+
+    if (reference.empty() || reference.size() == count) {
+        std::printf("Every sphere was culled or every sphere was visible\n");
+        result = EXIT_FAILURE;
+    }
+
+    return result;
+}
@@ -0,0 +1,171 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Deterministic checks of the CPU occlusion buffer, drawn with an identity view projection so
+// clip space is the screen: x and y from -1 to 1 across it and depth 0 at the near plane.
+
+#include <cstdio>
+#include <cstdlib>
+#include "Geometry/OcclusionBuffer.h"
+
+using namespace DirectX;
+using namespace RxEngine;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char * what)
+    {
+        if (!condition) {
+            std::printf("FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    // A quad facing the camera covering [x0, x1] x [y0, y1] at depth z
+    void addQuad(OcclusionBuffer & ob, float x0, float y0, float x1, float y1, float z)
+    {
+        const XMFLOAT3 vertices[4] = {{x0, y0, z}, {x1, y0, z}, {x0, y1, z}, {x1, y1, z}};
+        const uint32_t indices[6] = {0, 1, 2, 1, 3, 2};
+
+        ob.addOccluder(vertices, indices, 6, XMMatrixIdentity());
+    }
+
+    void rasterizeKnownQuad()
+    {
+        OcclusionBuffer ob(64, 64);
+        addQuad(ob, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f);
+        check(ob.triangleCount() == 2, "quad queues two triangles");
+        ob.rasterize();
+
+        // The quad spans pixels 16 to 47 on both axes
+        uint32_t covered = 0;
+        bool exact = true;
+        for (uint32_t y = 0; y < ob.height(); y++) {
+            for (uint32_t x = 0; x < ob.width(); x++) {
+                const bool inside = x >= 16 && x < 48 && y >= 16 && y < 48;
+                const float d = ob.depth(x, y);
+                covered += d < 1.0f ? 1 : 0;
+                exact = exact && d == (inside ? 0.5f : 1.0f);
+            }
+        }
+        check(covered == 32 * 32, "quad covers 32x32 pixels");
+        check(exact, "quad pixels hold its depth and the rest the far plane");
+    }
+
+    void occlusionQueries()
+    {
+        OcclusionBuffer ob(64, 64);
+        addQuad(ob, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f);
+        ob.rasterize();
+
+        const auto vp = XMMatrixIdentity();
+
+        check(
+            ob.boxOccluded(BoundingBox({0.0f, 0.0f, 0.8f}, {0.2f, 0.2f, 0.1f}), vp),
+            "box fully behind the quad is occluded"
+        );
+        check(
+            !ob.boxOccluded(BoundingBox({0.0f, 0.0f, 0.2f}, {0.2f, 0.2f, 0.1f}), vp),
+            "box in front of the quad is visible"
+        );
+        check(
+            !ob.boxOccluded(BoundingBox({0.5f, 0.0f, 0.8f}, {0.2f, 0.2f, 0.1f}), vp),
+            "box behind the quad but partly outside it is visible"
+        );
+        check(
+            !ob.boxOccluded(BoundingBox({0.0f, 0.0f, 0.05f}, {0.2f, 0.2f, 0.1f}), vp),
+            "box crossing the near plane is visible"
+        );
+        check(
+            !ob.boxOccluded(BoundingBox({3.0f, 0.0f, 0.8f}, {0.2f, 0.2f, 0.1f}), vp),
+            "box off screen is not reported occluded"
+        );
+    }
+
+    void nearPlaneOccluders()
+    {
+        OcclusionBuffer ob(64, 64);
+        const XMFLOAT3 vertices[3] = {{-0.5f, -0.5f, -0.1f}, {0.5f, -0.5f, 0.5f}, {0.0f, 0.5f, 0.5f}};
+        const uint32_t indices[3] = {0, 1, 2};
+
+        ob.addOccluder(vertices, indices, 3, XMMatrixIdentity());
+        check(ob.triangleCount() == 0, "triangle crossing the near plane is dropped");
+    }
+
+    void bandedRasterize()
+    {
+        OcclusionBuffer whole(64, 64);
+        addQuad(whole, -0.9f, -0.3f, 0.2f, 0.7f, 0.6f);
+        addQuad(whole, -0.4f, -0.8f, 0.8f, 0.1f, 0.3f);
+        addQuad(whole, 0.1f, 0.0f, 0.95f, 0.95f, 0.9f);
+
+        // A triangle sloping in depth, with edges that don't fall on tile boundaries
+        const XMFLOAT3 vertices[3] = {{-0.7f, 0.8f, 0.2f}, {0.6f, 0.55f, 0.7f}, {-0.1f, -0.9f, 0.4f}};
+        const uint32_t indices[3] = {0, 1, 2};
+        whole.addOccluder(vertices, indices, 3, XMMatrixIdentity());
+
+        OcclusionBuffer banded = whole;
+
+        whole.rasterize();
+        for (uint32_t row = 0; row < banded.height(); row += 2 * OcclusionBuffer::tile_height) {
+            banded.rasterize(row, row + 2 * OcclusionBuffer::tile_height);
+        }
+
+        bool same = true;
+        for (uint32_t y = 0; y < whole.height(); y++) {
+            for (uint32_t x = 0; x < whole.width(); x++) {
+                same = same && whole.depth(x, y) == banded.depth(x, y);
+            }
+        }
+        check(same, "banded rasterize matches a single pass");
+
+        const auto vp = XMMatrixIdentity();
+        bool queries_same = true;
+        for (float y = -0.9f; y < 0.9f; y += 0.15f) {
+            for (float x = -0.9f; x < 0.9f; x += 0.15f) {
+                const BoundingBox box({x, y, 0.75f}, {0.07f, 0.07f, 0.05f});
+                queries_same = queries_same && whole.boxOccluded(box, vp) == banded.boxOccluded(box, vp);
+            }
+        }
+        check(queries_same, "banded rasterize answers queries the same as a single pass");
+    }
+}
+
+int main()
+{
+    rasterizeKnownQuad();
+    occlusionQueries();
+    nearPlaneOccluders();
+    bandedRasterize();
+
+    if (failures) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,268 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+//
+// Copyright (c) 2021.  Shane Hyde (shane@noctonyx.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the render graph's compile step, which needs no device: pass culling, the barriers
+// and layout transitions it infers and the DOT output.
+
+#include <cstdio>
+#include <cstdlib>
+#include "Modules/Renderer/RenderGraph.h"
+
+using namespace RxEngine;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char * what)
+    {
+        if (!condition) {
+            std::printf("FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    void noop(VkCommandBuffer) {}
+
+    void passCulling()
+    {
+        RenderGraph graph;
+        const auto output = graph.importImage(
+            "Output", VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED
+        );
+        const auto used = graph.importBuffer("Used", VK_NULL_HANDLE);
+        const auto unused = graph.importBuffer("Unused", VK_NULL_HANDLE);
+        const auto logged = graph.importBuffer("Logged", VK_NULL_HANDLE);
+        graph.markOutput(output);
+
+        graph.addPass("Producer", noop)
+             .write(used, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        graph.addPass("Dead", noop)
+             .write(unused, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        graph.addPass("Side Effect", noop)
+             .write(logged, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+             .sideEffect();
+        graph.addPass("Main", noop)
+             .read(used, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT)
+             .attachment(
+                 output, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+             );
+        graph.compile();
+
+        check(!graph.culled(0), "pass feeding the output is kept");
+        check(graph.culled(1), "pass whose writes reach no output is culled");
+        check(!graph.culled(2), "side effect pass is kept");
+        check(!graph.culled(3), "pass writing the output is kept");
+        check(
+            graph.schedule() == std::vector<uint32_t>({0, 2, 3}),
+            "schedule holds the kept passes in order"
+        );
+    }
+
+    void writeThenRead()
+    {
+        RenderGraph graph;
+        const auto draws = graph.importBuffer("Draws", VK_NULL_HANDLE);
+        graph.markOutput(draws);
+
+        graph.addPass("Cull", noop)
+             .write(draws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        graph.addPass("Draw", noop)
+             .read(draws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+             .sideEffect();
+        graph.addPass("Draw Again", noop)
+             .read(draws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+             .sideEffect();
+        graph.compile();
+
+        check(graph.barriers(0).empty(), "first write needs no barrier");
+
+        const auto & b = graph.barriers(1);
+        check(b.size() == 1, "read after write gets one barrier");
+        if (b.size() == 1) {
+            check(b[0].resource == draws, "barrier is on the written resource");
+            check(b[0].srcStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, "waits on the writing stage");
+            check(b[0].dstStages == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, "blocks the reading stage");
+            check(b[0].srcAccess == VK_ACCESS_SHADER_WRITE_BIT, "makes the write available");
+            check(b[0].dstAccess == VK_ACCESS_INDIRECT_COMMAND_READ_BIT, "makes it visible to the read");
+            check(b[0].oldLayout == b[0].newLayout, "buffer barrier has no layout change");
+        }
+        check(graph.barriers(2).empty(), "second read of a visible write needs no barrier");
+    }
+
+    void readThenWrite()
+    {
+        RenderGraph graph;
+        const auto image = graph.importImage(
+            "Image", VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        );
+        graph.markOutput(image);
+
+        graph.addPass("Sample", noop)
+             .read(
+                 image, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+             )
+             .sideEffect();
+        graph.addPass("Overwrite", noop)
+             .write(
+                 image, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                 VK_IMAGE_LAYOUT_GENERAL
+             );
+        graph.compile();
+
+        check(graph.barriers(0).empty(), "read in the imported layout needs no barrier");
+
+        const auto & b = graph.barriers(1);
+        check(b.size() == 1, "write after read gets one barrier");
+        if (b.size() == 1) {
+            check(b[0].srcStages == VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, "waits on the reading stage");
+            check(b[0].dstStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, "blocks the writing stage");
+            check(b[0].srcAccess == 0, "a read has nothing to make available");
+            check(
+                b[0].oldLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                "transitions from the read layout"
+            );
+            check(b[0].newLayout == VK_IMAGE_LAYOUT_GENERAL, "transitions to the write layout");
+        }
+    }
+
+    void attachmentThenSampled()
+    {
+        RenderGraph graph;
+        const auto ready = graph.importImage(
+            "Ready", VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED
+        );
+        const auto left = graph.importImage(
+            "Left", VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED
+        );
+        const auto result = graph.importBuffer("Result", VK_NULL_HANDLE);
+        graph.markOutput(result);
+
+        graph.addPass("Render", noop)
+             .attachment(
+                 ready, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+             )
+             .attachment(
+                 left, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+             );
+        graph.addPass("Sample", noop)
+             .read(
+                 ready, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+             )
+             .read(
+                 left, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+             )
+             .write(result, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        graph.compile();
+
+        check(graph.barriers(0).empty(), "attachments are synchronised by their render pass");
+
+        const auto & b = graph.barriers(1);
+        check(b.size() == 1, "only the attachment left in another layout gets a barrier");
+        if (b.size() == 1) {
+            check(b[0].resource == left, "barrier is on the attachment left in another layout");
+            check(
+                b[0].srcStages == VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                "waits on the attachment write"
+            );
+            check(
+                b[0].srcAccess == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                "makes the attachment write available"
+            );
+            check(b[0].dstAccess == VK_ACCESS_SHADER_READ_BIT, "makes it visible to sampling");
+            check(
+                b[0].oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+                b[0].newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                "transitions from the render pass's final layout to the sampled layout"
+            );
+        }
+    }
+
+    void dotOutput()
+    {
+        RenderGraph graph;
+        const auto draws = graph.importBuffer("Draws", VK_NULL_HANDLE);
+        const auto image = graph.importImage(
+            "Swap \"Chain\"", VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED
+        );
+        const auto unused = graph.importBuffer("Unused", VK_NULL_HANDLE);
+        graph.markOutput(image);
+
+        graph.addPass("Cull", noop)
+             .write(draws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        graph.addPass("Dead", noop)
+             .write(unused, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        graph.addPass("Draw", noop)
+             .read(draws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+             .attachment(
+                 image, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+             );
+        graph.compile();
+
+        const std::string expected =
+            "digraph RenderGraph {\n"
+            "    rankdir=LR;\n"
+            "    r0 [label=\"Draws\", shape=cylinder];\n"
+            "    r1 [label=\"Swap \\\"Chain\\\"\", shape=ellipse, peripheries=2];\n"
+            "    r2 [label=\"Unused\", shape=cylinder];\n"
+            "    p0 [label=\"Cull\", shape=box];\n"
+            "    p0 -> r0;\n"
+            "    p1 [label=\"Dead\", shape=box, style=dashed, color=gray];\n"
+            "    p1 -> r2;\n"
+            "    p2 [label=\"Draw\\n1 barrier\", shape=box];\n"
+            "    r0 -> p2;\n"
+            "    p2 -> r1;\n"
+            "}\n";
+
+        const auto dot = graph.dot();
+        check(dot == expected, "dot output lists resources, passes, culling and barriers");
+        if (dot != expected) {
+            std::printf("%s", dot.c_str());
+        }
+    }
+}
+
+int main()
+{
+    passCulling();
+    writeThenRead();
+    readThenWrite();
+    attachmentThenSampled();
+    dotOutput();
+
+    if (failures) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}